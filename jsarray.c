@@ -17,30 +17,6 @@ void js_setlength(js_State *J, int idx, int len)
 	js_setproperty(J, idx < 0 ? idx - 1 : idx, "length");
 }
 
-int js_hasindex(js_State *J, int idx, int i)
-{
-	char buf[32];
-	return js_hasproperty(J, idx, js_itoa(buf, i));
-}
-
-void js_getindex(js_State *J, int idx, int i)
-{
-	char buf[32];
-	js_getproperty(J, idx, js_itoa(buf, i));
-}
-
-void js_setindex(js_State *J, int idx, int i)
-{
-	char buf[32];
-	js_setproperty(J, idx, js_itoa(buf, i));
-}
-
-void js_delindex(js_State *J, int idx, int i)
-{
-	char buf[32];
-	js_delproperty(J, idx, js_itoa(buf, i));
-}
-
 static void jsB_new_Array(js_State *J)
 {
 	int i, top = js_gettop(J);
@@ -207,6 +183,7 @@ static void Ap_reverse(js_State *J)
 
 static void Ap_shift(js_State *J)
 {
+	js_Object *self;
 	int k, len;
 
 	len = js_getlength(J, 0);
@@ -219,6 +196,14 @@ static void Ap_shift(js_State *J)
 
 	js_getindex(J, 0, 0);
 
+	/* slide the element vector of dense arrays down in one go */
+	self = js_toobject(J, 0);
+	if (self->type == JS_CARRAY && self->u.a.flat_length == len) {
+		memmove(self->u.a.array, self->u.a.array + 1, (len - 1) * sizeof *self->u.a.array);
+		self->u.a.flat_length = self->u.a.length = len - 1;
+		return;
+	}
+
 	for (k = 1; k < len; ++k) {
 		if (js_hasindex(J, 0, k))
 			js_setindex(J, 0, k - 1);
@@ -232,6 +217,7 @@ static void Ap_shift(js_State *J)
 
 static void Ap_slice(js_State *J)
 {
+	js_Object *self, *res;
 	int len, s, e, n;
 	double sv, ev;
 
@@ -247,6 +233,17 @@ static void Ap_slice(js_State *J)
 	s = sv < 0 ? 0 : sv > len ? len : sv;
 	e = ev < 0 ? 0 : ev > len ? len : ev;
 
+	/* copy straight from the element vector of dense arrays */
+	self = js_toobject(J, 0);
+	if (self->type == JS_CARRAY && e <= self->u.a.flat_length && s < e) {
+		res = js_toobject(J, -1);
+		if (jsV_growarray(J, res, e - s)) {
+			memcpy(res->u.a.array, self->u.a.array + s, (e - s) * sizeof *res->u.a.array);
+			res->u.a.flat_length = res->u.a.length = e - s;
+			return;
+		}
+	}
+
 	for (n = 0; s < e; ++s, ++n)
 		if (js_hasindex(J, 0, s))
 			js_setindex(J, -2, n);
@@ -266,8 +263,8 @@ static int sortcmp(const void *avoid, const void *bvoid)
 	double v;
 	int c;
 
-	int unx = (a->type == JS_TUNDEFINED);
-	int uny = (b->type == JS_TUNDEFINED);
+	int unx = (JSV_TYPE(a) == JS_TUNDEFINED);
+	int uny = (JSV_TYPE(b) == JS_TUNDEFINED);
 	if (unx) return !uny;
 	if (uny) return -1;
 
@@ -0,0 +1,880 @@
+#include "jsi.h"
+#include "jscompile.h"
+#include "jsvalue.h"
+
+#include <stdint.h>
+
+/*
+	Precompiled bytecode files hold the tree of compiled functions of a
+	script, so that it can be loaded without parsing and compiling it again.
+
+	Integers are written as unsigned LEB128 (negative values only occur in
+	the function header, and are biased by one), numbers as their IEEE 754
+	bits in little-endian order, and strings as their length followed by
+	their bytes. The code is written in a portable form where every operand
+	takes one slot: string and number operands are written in place, and
+	jump addresses and line table offsets are counted in slots. The loader
+	converts it back to the instruction size and pointer size of the host,
+	so a file made on one machine can be loaded on another.
+
+	The loader checks the structure of the file and verifies the code of
+	every function before it can run, rejecting operands out of range and
+	code that would unbalance the stack. Files are tied to the
+	set of opcodes of the version of mujs that made them by a hash of the
+	opcode names.
+*/
+
+#define JS_BYTECODEMAGIC "\033MJS"
+#define JS_BYTECODEVERSION 1
+
+#define NPTR (int)(sizeof(void*) / sizeof(js_Instruction))
+#define NNUM (int)(sizeof(double) / sizeof(js_Instruction))
+
+int js_isbytecode(const char *buf, int size)
+{
+	return size >= 4 && !memcmp(buf, JS_BYTECODEMAGIC, 4);
+}
+
+/* Number of opcodes, and a hash of their names */
+static int opcodecount(unsigned int *hash)
+{
+	const char *name;
+	int op;
+	*hash = 0;
+	for (op = 0; strcmp(name = jsC_opcodestring(op), "<unknown>"); ++op)
+		*hash = *hash * 31 + jsS_hash(name);
+	return op;
+}
+
+/* Number of words used by the constant operand of an instruction */
+static int constlength(int op)
+{
+	return op == OP_NUMBER ? NNUM : NPTR;
+}
+
+/* Number of slots used by an instruction in a bytecode file */
+static int slotlength(int op)
+{
+	int n = jsC_oplength(op);
+	if (jsC_constoperand(op) > 0)
+		n -= constlength(op) - 1;
+	return n;
+}
+
+/* Writing */
+
+static void putint(js_State *J, js_Buffer **sb, unsigned int v)
+{
+	while (v >= 0x80) {
+		js_putc(J, sb, (v & 0x7F) | 0x80);
+		v >>= 7;
+	}
+	js_putc(J, sb, v);
+}
+
+static void putsigned(js_State *J, js_Buffer **sb, int v)
+{
+	putint(J, sb, (unsigned int)v + 1);
+}
+
+static void putstring(js_State *J, js_Buffer **sb, const char *s, int n)
+{
+	putint(J, sb, n);
+	js_putm(J, sb, s, s + n);
+}
+
+static void putnumber(js_State *J, js_Buffer **sb, double x)
+{
+	uint64_t bits;
+	int i;
+	memcpy(&bits, &x, sizeof bits);
+	for (i = 0; i < 8; ++i)
+		js_putc(J, sb, (int)(bits >> i * 8) & 0xFF);
+}
+
+static void putconstant(js_State *J, js_Buffer **sb, int op, const js_Instruction *p)
+{
+	const char *str;
+	js_String *lit;
+	double num;
+	if (op == OP_NUMBER) {
+		memcpy(&num, p, sizeof num);
+		putnumber(J, sb, num);
+	} else if (op == OP_MEMSTRING) {
+		memcpy(&lit, p, sizeof lit);
+		putstring(J, sb, lit->p, lit->length);
+	} else {
+		memcpy(&str, p, sizeof str);
+		putstring(J, sb, str, strlen(str));
+	}
+}
+
+static void putfunction(js_State *J, js_Buffer **sb, js_Function *F, int *slot)
+{
+	int pc, i, n, k, op;
+
+	putstring(J, sb, F->name, strlen(F->name));
+	putstring(J, sb, F->filename, strlen(F->filename));
+	putsigned(J, sb, F->line);
+	putsigned(J, sb, F->lastline);
+	putint(J, sb, F->script);
+	putint(J, sb, F->lightweight);
+	putint(J, sb, F->dynamic);
+	putint(J, sb, F->strict);
+	putint(J, sb, F->arguments);
+	putint(J, sb, F->varargs);
+	putint(J, sb, F->numparams);
+	putint(J, sb, F->cachelen);
+
+	putint(J, sb, F->varlen);
+	for (i = 0; i < F->varlen; ++i)
+		putstring(J, sb, F->vartab[i], strlen(F->vartab[i]));
+
+	/* slot of every instruction, to translate jump addresses */
+	for (pc = n = 0; pc < F->codelen; pc += jsC_oplength(F->code[pc])) {
+		slot[pc] = n;
+		n += slotlength(F->code[pc]);
+	}
+	slot[pc] = n;
+
+	putint(J, sb, n);
+	for (pc = 0; pc < F->codelen; pc += n) {
+		op = F->code[pc];
+		n = jsC_oplength(op);
+		k = jsC_constoperand(op);
+		putint(J, sb, op);
+		for (i = 1; i < n; ++i) {
+			if (i == k) {
+				putconstant(J, sb, op, F->code + pc + i);
+				i += constlength(op) - 1;
+			} else if (i == jsC_jumpoperand(op)) {
+				putint(J, sb, slot[F->code[pc + i]]);
+			} else {
+				putint(J, sb, F->code[pc + i]);
+			}
+		}
+	}
+
+	putint(J, sb, F->linelen);
+	for (i = 0; i < F->linelen; ++i) {
+		putint(J, sb, slot[F->linetab[i * 2]]);
+		putsigned(J, sb, F->linetab[i * 2 + 1]);
+	}
+
+	putint(J, sb, F->funlen);
+	for (i = 0; i < F->funlen; ++i)
+		putfunction(J, sb, F->funtab[i], slot);
+}
+
+static int maxcodelen(js_Function *F)
+{
+	int i, n = F->codelen;
+	for (i = 0; i < F->funlen; ++i) {
+		int k = maxcodelen(F->funtab[i]);
+		if (k > n)
+			n = k;
+	}
+	return n;
+}
+
+void js_dumpbytecode(js_State *J, int idx, js_Writer write, void *data)
+{
+	js_Buffer *sb = NULL;
+	js_Object *obj;
+	unsigned int hash;
+	int *slot;
+
+	obj = js_toobject(J, idx);
+	if (obj->type != JS_CSCRIPT)
+		js_typeerror(J, "not a script");
+
+	slot = js_malloc(J, (maxcodelen(obj->u.f.function) + 1) * (int)sizeof *slot);
+
+	if (js_try(J)) {
+		js_free(J, slot);
+		js_free(J, sb);
+		js_throw(J);
+	}
+
+	js_putm(J, &sb, JS_BYTECODEMAGIC, JS_BYTECODEMAGIC + 4);
+	putint(J, &sb, JS_BYTECODEVERSION);
+	putint(J, &sb, opcodecount(&hash));
+	putint(J, &sb, hash);
+	putfunction(J, &sb, obj->u.f.function, slot);
+
+	js_endtry(J);
+	js_free(J, slot);
+
+	write(data, sb->s, sb->n);
+	js_free(J, sb);
+}
+
+/* Loading */
+
+struct reader
+{
+	const char *filename;
+	const unsigned char *p, *end;
+	int *map; /* code offset of every slot, or -1 inside an instruction */
+	int mapcap;
+	int *state; /* stack, try and scope depth at every code offset, and a work list */
+	int statecap;
+	int *work, nwork;
+	int nops;
+	js_Function *nest[JS_ASTLIMIT + 1]; /* the enclosing functions */
+};
+
+static void badbytecode(js_State *J, struct reader *R)
+{
+	js_syntaxerror(J, "%s: invalid bytecode", R->filename);
+}
+
+static unsigned int getint(js_State *J, struct reader *R)
+{
+	unsigned int v = 0;
+	int shift = 0;
+	do {
+		if (R->p >= R->end || shift > 28)
+			badbytecode(J, R);
+		v |= (unsigned int)(*R->p & 0x7F) << shift;
+		shift += 7;
+	} while (*R->p++ & 0x80);
+	return v;
+}
+
+/* Read the length of a table, each entry of which takes at least a byte */
+static int getcount(js_State *J, struct reader *R)
+{
+	unsigned int v = getint(J, R);
+	if (v > (unsigned int)(R->end - R->p))
+		badbytecode(J, R);
+	return v;
+}
+
+static int getsigned(js_State *J, struct reader *R)
+{
+	return (int)(getint(J, R) - 1);
+}
+
+static const char *getstring(js_State *J, struct reader *R, int *np)
+{
+	const char *s;
+	unsigned int n = getint(J, R);
+	if (n > (unsigned int)(R->end - R->p))
+		badbytecode(J, R);
+	s = (const char *)R->p;
+	R->p += n;
+	*np = n;
+	return s;
+}
+
+static const char *getatom(js_State *J, struct reader *R)
+{
+	char buf[256];
+	const char *s, *atom;
+	char *tmp;
+	int n;
+	s = getstring(J, R, &n);
+	if (memchr(s, 0, n))
+		badbytecode(J, R);
+	if (n < (int)sizeof buf) {
+		memcpy(buf, s, n);
+		buf[n] = 0;
+		return js_intern(J, buf);
+	}
+	tmp = js_malloc(J, n + 1);
+	memcpy(tmp, s, n);
+	tmp[n] = 0;
+	if (js_try(J)) {
+		js_free(J, tmp);
+		js_throw(J);
+	}
+	atom = js_intern(J, tmp);
+	js_endtry(J);
+	js_free(J, tmp);
+	return atom;
+}
+
+static double getnumber(js_State *J, struct reader *R)
+{
+	uint64_t bits = 0;
+	double x;
+	int i;
+	if (R->end - R->p < 8)
+		badbytecode(J, R);
+	for (i = 0; i < 8; ++i)
+		bits |= (uint64_t)*R->p++ << i * 8;
+	memcpy(&x, &bits, sizeof x);
+	return x;
+}
+
+static void addcode(js_State *J, js_Function *F, int value)
+{
+	if (value != (js_Instruction)value)
+		js_syntaxerror(J, "integer overflow in instruction coding");
+	if (F->codelen >= F->codecap) {
+		F->codecap = F->codecap ? F->codecap * 2 : 64;
+		F->code = js_realloc(J, F->code, F->codecap * sizeof *F->code);
+	}
+	F->code[F->codelen++] = value;
+}
+
+static void addcodeptr(js_State *J, js_Function *F, const void *ptr, int n)
+{
+	js_Instruction x[sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*)];
+	int i;
+	memcpy(x, ptr, n * sizeof *x);
+	for (i = 0; i < n; ++i)
+		addcode(J, F, x[i]);
+}
+
+static void getconstant(js_State *J, struct reader *R, js_Function *F, int op)
+{
+	const char *str;
+	js_String *lit;
+	double num;
+	int n;
+
+	if (op == OP_NUMBER) {
+		num = getnumber(J, R);
+		addcodeptr(J, F, &num, NNUM);
+	} else if (op == OP_MEMSTRING) {
+		str = getstring(J, R, &n);
+		if (F->litlen >= F->litcap) {
+			F->litcap = F->litcap ? F->litcap * 2 : 16;
+			F->littab = js_realloc(J, F->littab, F->litcap * sizeof *F->littab);
+		}
+		lit = jsV_newmemstring(J, str, n);
+		F->littab[F->litlen++] = lit;
+		jsV_utflen(J, lit);
+		addcodeptr(J, F, &lit, NPTR);
+	} else {
+		str = getatom(J, R);
+		if (F->strlen >= F->strcap) {
+			F->strcap = F->strcap ? F->strcap * 2 : 16;
+			F->strtab = js_realloc(J, F->strtab, F->strcap * sizeof *F->strtab);
+		}
+		F->strtab[F->strlen++] = str;
+		addcodeptr(J, F, &str, NPTR);
+	}
+}
+
+/* Translate a slot to the code offset of the instruction there */
+static int getaddress(js_State *J, struct reader *R, int nslots, int slot)
+{
+	if (slot < 0 || slot > nslots || R->map[slot] < 0)
+		badbytecode(J, R);
+	return R->map[slot];
+}
+
+/*
+	Verify a loaded function, so that bad bytecode is rejected here instead
+	of corrupting memory when it runs: every local, register, upvalue, table
+	and cache operand is in range, the opcodes suit the kind of function, and
+	on every path through the code the stack, try and scope depths are the
+	same where paths meet and never drop below zero.
+*/
+
+static int isbinaryop(int op)
+{
+	switch (op) {
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+	case OP_SHL: case OP_SHR: case OP_USHR:
+	case OP_BITAND: case OP_BITXOR: case OP_BITOR:
+		return 1;
+	}
+	return 0;
+}
+
+static int iscompareop(int op)
+{
+	switch (op) {
+	case OP_LT: case OP_GT: case OP_LE: case OP_GE:
+	case OP_EQ: case OP_NE: case OP_STRICTEQ: case OP_STRICTNE:
+		return 1;
+	}
+	return 0;
+}
+
+static void checkrange(js_State *J, struct reader *R, int v, int lo, int hi)
+{
+	if (v < lo || v > hi)
+		badbytecode(J, R);
+}
+
+/* The register instructions only run in lightweight functions */
+static void checklocal(js_State *J, struct reader *R, js_Function *F, int k)
+{
+	if (!F->lightweight)
+		badbytecode(J, R);
+	checkrange(J, R, k, 1, F->varlen);
+}
+
+/* Upvalues are found by following the scope chain out through the slot environments of the enclosing functions */
+static void checkupvalue(js_State *J, struct reader *R, js_Function *F, int depth, int d, int k)
+{
+	js_Function *P = F;
+	if (d < 1 || d > depth)
+		badbytecode(J, R);
+	while (d-- > 0) {
+		P = R->nest[--depth];
+		if (P->dynamic || P->lightweight)
+			badbytecode(J, R);
+	}
+	checkrange(J, R, k, 1, P->varlen);
+}
+
+static void checkoperands(js_State *J, struct reader *R, js_Function *F, int depth)
+{
+	js_Instruction *code = F->code;
+	int pc, op;
+
+	for (pc = 0; pc < F->codelen; pc += jsC_oplength(op)) {
+		op = code[pc];
+		switch (op) {
+		case OP_CLOSURE:
+			checkrange(J, R, code[pc + 1], 0, F->funlen - 1);
+			break;
+		case OP_GETLOCAL:
+		case OP_SETLOCAL:
+		case OP_DELLOCAL:
+			checkrange(J, R, code[pc + 1], 1, F->varlen);
+			break;
+		case OP_GETUPVAL:
+		case OP_SETUPVAL:
+			checkupvalue(J, R, F, depth, code[pc + 1], code[pc + 2]);
+			break;
+		case OP_ARGC:
+		case OP_GETARG:
+			if (!F->varargs)
+				badbytecode(J, R);
+			break;
+		case OP_EVAL:
+		case OP_CATCH:
+		case OP_ENDCATCH:
+		case OP_WITH:
+		case OP_ENDWITH:
+			if (!F->dynamic)
+				badbytecode(J, R);
+			break;
+		case OP_CALL:
+		case OP_TAILCALL:
+		case OP_NEW:
+			checkrange(J, R, code[pc + 1], 0, JS_STACKSIZE);
+			break;
+		case OP_INCLOCAL:
+		case OP_DECLOCAL:
+			checklocal(J, R, F, code[pc + 1]);
+			break;
+		case OP_MOVELOCAL:
+			checklocal(J, R, F, code[pc + 1]);
+			checklocal(J, R, F, code[pc + 2]);
+			break;
+		case OP_BINARYLOCAL:
+			if (!isbinaryop(code[pc + 1]))
+				badbytecode(J, R);
+			checklocal(J, R, F, code[pc + 2]);
+			checklocal(J, R, F, code[pc + 3]);
+			break;
+		case OP_BINARYTOLOCAL:
+			if (!isbinaryop(code[pc + 1]))
+				badbytecode(J, R);
+			checklocal(J, R, F, code[pc + 2]);
+			checklocal(J, R, F, code[pc + 3]);
+			checklocal(J, R, F, code[pc + 4]);
+			break;
+		case OP_CMPLOCALJFALSE:
+			if (!iscompareop(code[pc + 1]))
+				badbytecode(J, R);
+			checklocal(J, R, F, code[pc + 2]);
+			checklocal(J, R, F, code[pc + 3]);
+			break;
+		case OP_CMPINTEGERJFALSE:
+			if (!iscompareop(code[pc + 1]))
+				badbytecode(J, R);
+			checklocal(J, R, F, code[pc + 2]);
+			break;
+		case OP_GETLOCALPROP:
+			checklocal(J, R, F, code[pc + 1]);
+			break;
+		case OP_GETPROPTOLOCAL:
+		case OP_SETPROPFROMLOCAL:
+			checklocal(J, R, F, code[pc + 1]);
+			checklocal(J, R, F, code[pc + 2]);
+			break;
+		}
+		switch (op) {
+		case OP_GETPROP_S:
+		case OP_SETPROP_S:
+		case OP_GETLOCALPROP:
+		case OP_GETPROPTOLOCAL:
+		case OP_SETPROPFROMLOCAL:
+			checkrange(J, R, code[pc + jsC_constoperand(op) + NPTR], 0, F->cachelen - 1);
+			break;
+		}
+	}
+}
+
+/* Number of values an instruction pops and pushes, when it falls through */
+static int stackeffect(js_Instruction *code, int pc, int *push)
+{
+	switch (code[pc]) {
+	default:
+		*push = 1;
+		return 0;
+
+	case OP_DEBUGGER:
+	case OP_INCLOCAL:
+	case OP_DECLOCAL:
+	case OP_MOVELOCAL:
+	case OP_BINARYTOLOCAL:
+	case OP_GETPROPTOLOCAL:
+	case OP_SETPROPFROMLOCAL:
+		*push = 0;
+		return 0;
+
+	case OP_GETARG:
+	case OP_SETLOCAL:
+	case OP_SETUPVAL:
+	case OP_SETVAR:
+	case OP_GETPROP_S:
+	case OP_DELPROP_S:
+	case OP_ITERATOR:
+	case OP_EVAL:
+	case OP_TYPEOF:
+	case OP_POS:
+	case OP_NEG:
+	case OP_BITNOT:
+	case OP_LOGNOT:
+	case OP_INC:
+	case OP_DEC:
+	case OP_ADDINTEGER:
+		*push = 1;
+		return 1;
+
+	case OP_POP:
+		*push = 0;
+		return 1;
+	case OP_DUP:
+	case OP_POSTINC:
+	case OP_POSTDEC:
+		*push = 2;
+		return 1;
+	case OP_DUP2:
+		*push = 4;
+		return 2;
+	case OP_ROT2:
+		*push = 2;
+		return 2;
+	case OP_ROT3:
+		*push = 3;
+		return 3;
+	case OP_ROT4:
+		*push = 4;
+		return 4;
+
+	case OP_IN:
+	case OP_INITARRAY:
+	case OP_GETPROP:
+	case OP_SETPROP_S:
+	case OP_DELPROP:
+	case OP_MUL: case OP_DIV: case OP_MOD: case OP_ADD: case OP_SUB:
+	case OP_SHL: case OP_SHR: case OP_USHR:
+	case OP_LT: case OP_GT: case OP_LE: case OP_GE:
+	case OP_EQ: case OP_NE: case OP_STRICTEQ: case OP_STRICTNE:
+	case OP_BITAND: case OP_BITXOR: case OP_BITOR:
+	case OP_INSTANCEOF:
+		*push = 1;
+		return 2;
+
+	case OP_INITPROP:
+	case OP_INITGETTER:
+	case OP_INITSETTER:
+	case OP_SETPROP:
+		*push = 1;
+		return 3;
+
+	case OP_CALL:
+	case OP_TAILCALL:
+		*push = 1;
+		return code[pc + 1] + 2;
+	case OP_NEW:
+		*push = 1;
+		return code[pc + 1] + 1;
+	}
+}
+
+enum { VSTACK, VTRY, VSCOPE, VITER, VSIZE };
+
+/* Record the depths on entry to an instruction, or check that they agree with an earlier path */
+static void reach(js_State *J, struct reader *R, js_Function *F, int pc, int top, int try, int scope, int iter)
+{
+	int *s;
+	if (pc >= F->codelen || top < 0 || try < 0 || scope < 0)
+		badbytecode(J, R);
+	s = R->state + pc * VSIZE;
+	if (s[VSTACK] < 0) {
+		s[VSTACK] = top;
+		s[VTRY] = try;
+		s[VSCOPE] = scope;
+		s[VITER] = iter;
+		R->work[R->nwork++] = pc;
+	} else if (s[VSTACK] != top || s[VTRY] != try || s[VSCOPE] != scope || s[VITER] != iter) {
+		badbytecode(J, R);
+	}
+}
+
+static void checkflow(js_State *J, struct reader *R, js_Function *F)
+{
+	js_Instruction *code = F->code;
+	int pc, next, addr, op, top, try, scope, iter, pop, push, k;
+
+	if (F->codelen * (VSIZE + 1) > R->statecap) {
+		R->statecap = F->codelen * (VSIZE + 1);
+		R->state = js_realloc(J, R->state, R->statecap * (int)sizeof *R->state);
+	}
+	for (pc = 0; pc < F->codelen; ++pc)
+		R->state[pc * VSIZE + VSTACK] = -1;
+	R->work = R->state + F->codelen * VSIZE;
+	R->nwork = 0;
+
+	reach(J, R, F, 0, 0, 0, 0, 0);
+	while (R->nwork > 0) {
+		pc = R->work[--R->nwork];
+		top = R->state[pc * VSIZE + VSTACK];
+		try = R->state[pc * VSIZE + VTRY];
+		scope = R->state[pc * VSIZE + VSCOPE];
+		iter = R->state[pc * VSIZE + VITER];
+
+		op = code[pc];
+		next = pc + jsC_oplength(op);
+		k = jsC_jumpoperand(op);
+		addr = k > 0 ? code[pc + k] : 0;
+
+		switch (op) {
+		case OP_JUMP:
+			reach(J, R, F, addr, top, try, scope, 0);
+			break;
+		case OP_JTRUE:
+		case OP_JFALSE:
+			if (iter) {
+				/* the end of the loop pops the iterator */
+				reach(J, R, F, next, top + 1, try, scope, 0);
+				reach(J, R, F, addr, top - 1, try, scope, 0);
+			} else {
+				reach(J, R, F, next, top - 1, try, scope, 0);
+				reach(J, R, F, addr, top - 1, try, scope, 0);
+			}
+			break;
+		case OP_NEXTITER:
+			if (top < 1 || next >= F->codelen || code[next] != OP_JFALSE)
+				badbytecode(J, R);
+			reach(J, R, F, next, top, try, scope, 1);
+			break;
+		case OP_JCASE:
+			reach(J, R, F, next, top - 1, try, scope, 0);
+			reach(J, R, F, addr, top - 2, try, scope, 0);
+			break;
+		case OP_LTJFALSE:
+		case OP_GTJFALSE:
+		case OP_LEJFALSE:
+		case OP_GEJFALSE:
+		case OP_EQJFALSE:
+		case OP_NEJFALSE:
+		case OP_STRICTEQJFALSE:
+		case OP_STRICTNEJFALSE:
+			reach(J, R, F, next, top - 2, try, scope, 0);
+			reach(J, R, F, addr, top - 2, try, scope, 0);
+			break;
+		case OP_CMPLOCALJFALSE:
+		case OP_CMPINTEGERJFALSE:
+			reach(J, R, F, next, top, try, scope, 0);
+			reach(J, R, F, addr, top, try, scope, 0);
+			break;
+		case OP_TRY:
+			/* the handler follows, and the body is at the jump address */
+			reach(J, R, F, next, top + 1, try, scope, 0);
+			reach(J, R, F, addr, top, try + 1, scope, 0);
+			break;
+		case OP_ENDTRY:
+			reach(J, R, F, next, top, try - 1, scope, 0);
+			break;
+		case OP_CATCH:
+		case OP_WITH:
+			reach(J, R, F, next, top - 1, try, scope + 1, 0);
+			break;
+		case OP_ENDCATCH:
+		case OP_ENDWITH:
+			reach(J, R, F, next, top, try, scope - 1, 0);
+			break;
+		case OP_THROW:
+			if (top < 1)
+				badbytecode(J, R);
+			break;
+		case OP_RETURN:
+			if (top < 1 || try > 0)
+				badbytecode(J, R);
+			break;
+		default:
+			if (op == OP_TAILCALL && try > 0)
+				badbytecode(J, R);
+			pop = stackeffect(code, pc, &push);
+			if (top < pop)
+				badbytecode(J, R);
+			reach(J, R, F, next, top - pop + push, try, scope, 0);
+			break;
+		}
+	}
+}
+
+static void verifyfunction(js_State *J, struct reader *R, js_Function *F, int depth)
+{
+	if (F->numparams < 0 || F->numparams > F->varlen)
+		badbytecode(J, R);
+	if (!F->dynamic && (F->arguments < 0 || F->arguments > F->varlen))
+		badbytecode(J, R);
+	if (F->script && (depth > 0 || !F->dynamic))
+		badbytecode(J, R);
+	if ((F->lightweight || F->varargs) && (F->dynamic || F->script))
+		badbytecode(J, R);
+	checkoperands(J, R, F, depth);
+	checkflow(J, R, F);
+}
+
+static js_Function *getfunction(js_State *J, struct reader *R, int depth)
+{
+	js_Function *F;
+	int nslots, slot, pc, i, n, k, op;
+
+	if (depth > JS_ASTLIMIT)
+		badbytecode(J, R);
+
+	jsG_grow(J, sizeof *F);
+	F = js_malloc(J, sizeof *F);
+	memset(F, 0, sizeof *F);
+	F->gcmark = JS_NEWMARK(J);
+	F->gcnext = J->gcfun;
+	J->gcfun = F;
+
+	F->name = getatom(J, R);
+	F->filename = getatom(J, R);
+	F->line = getsigned(J, R);
+	F->lastline = getsigned(J, R);
+	F->script = getint(J, R);
+	F->lightweight = getint(J, R);
+	F->dynamic = getint(J, R);
+	F->strict = getint(J, R);
+	F->arguments = getint(J, R);
+	F->varargs = getint(J, R);
+	F->numparams = getint(J, R);
+	F->cachelen = getcount(J, R);
+
+	n = getcount(J, R);
+	if (n > 0)
+		F->vartab = js_malloc(J, n * (int)sizeof *F->vartab);
+	F->varcap = n;
+	for (i = 0; i < n; ++i)
+		F->vartab[F->varlen++] = getatom(J, R);
+
+	nslots = getcount(J, R);
+	if (nslots >= R->mapcap) {
+		R->mapcap = nslots + 1;
+		R->map = js_realloc(J, R->map, R->mapcap * (int)sizeof *R->map);
+	}
+	for (slot = 0; slot <= nslots; ++slot)
+		R->map[slot] = -1;
+
+	for (slot = 0; slot < nslots; slot += slotlength(op)) {
+		R->map[slot] = F->codelen;
+		op = getint(J, R);
+		if (op >= R->nops)
+			badbytecode(J, R);
+		n = jsC_oplength(op);
+		k = jsC_constoperand(op);
+		addcode(J, F, op);
+		for (i = 1; i < n; ++i) {
+			if (i == k) {
+				getconstant(J, R, F, op);
+				i += constlength(op) - 1;
+			} else {
+				addcode(J, F, getint(J, R));
+			}
+		}
+	}
+	if (slot != nslots)
+		badbytecode(J, R);
+	R->map[nslots] = F->codelen;
+
+	/* jump addresses are slots until now */
+	for (pc = 0; pc < F->codelen; pc += jsC_oplength(F->code[pc])) {
+		k = jsC_jumpoperand(F->code[pc]);
+		if (k > 0)
+			F->code[pc + k] = getaddress(J, R, nslots, F->code[pc + k]);
+	}
+
+	n = getcount(J, R);
+	if (n > 0)
+		F->linetab = js_malloc(J, n * 2 * (int)sizeof *F->linetab);
+	F->linecap = n;
+	for (i = 0; i < n; ++i) {
+		F->linetab[i * 2] = getaddress(J, R, nslots, getint(J, R));
+		F->linetab[i * 2 + 1] = getsigned(J, R);
+		F->linelen++;
+	}
+
+	n = getcount(J, R);
+	if (n > 0)
+		F->funtab = js_malloc(J, n * (int)sizeof *F->funtab);
+	F->funcap = n;
+	R->nest[depth] = F;
+	for (i = 0; i < n; ++i)
+		F->funtab[F->funlen++] = getfunction(J, R, depth + 1);
+
+	verifyfunction(J, R, F, depth);
+
+	if (F->cachelen > 0) {
+		F->cachetab = js_malloc(J, F->cachelen * JS_PROPCACHE * (int)sizeof *F->cachetab);
+		memset(F->cachetab, 0, F->cachelen * JS_PROPCACHE * sizeof *F->cachetab);
+	}
+
+	jsG_growfunction(J, F);
+	return F;
+}
+
+void js_loadbytecode(js_State *J, const char *filename, const char *buf, int size)
+{
+	struct reader R;
+	js_Function *F;
+	unsigned int hash;
+
+	R.filename = filename;
+	R.p = (const unsigned char *)buf;
+	R.end = R.p + size;
+	R.map = NULL;
+	R.mapcap = 0;
+	R.state = NULL;
+	R.statecap = 0;
+
+	if (!js_isbytecode(buf, size))
+		badbytecode(J, &R);
+	R.p += 4;
+	R.nops = opcodecount(&hash);
+	if (getint(J, &R) != JS_BYTECODEVERSION || getint(J, &R) != (unsigned int)R.nops || getint(J, &R) != hash)
+		js_syntaxerror(J, "%s: bytecode made by another version of mujs", filename);
+
+	if (js_try(J)) {
+		js_free(J, R.map);
+		js_free(J, R.state);
+		js_throw(J);
+	}
+
+	F = getfunction(J, &R, 0);
+	if (R.p != R.end || !F->script)
+		badbytecode(J, &R);
+
+	js_endtry(J);
+	js_free(J, R.map);
+	js_free(J, R.state);
+
+	js_newscript(J, F, J->GE);
+}
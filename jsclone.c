@@ -0,0 +1,486 @@
+#include "jsi.h"
+#include "jscompile.h"
+#include "jsvalue.h"
+#include "jsrun.h"
+
+#include "regexp.h"
+
+#include <stdint.h>
+
+/*
+	Cloning copies the whole heap of a state into a new state, so that a
+	state with the builtins and any library code already loaded can be
+	used as a template for fresh isolated states without running the
+	initialization again.
+
+	Every object, function, environment, memstr and shape is first created
+	empty in the new state and entered in a table that maps the old address
+	to the new one. Then the contents are copied, translating the pointers
+	through the table. Atoms are copied to the same places in the string
+	table of the new state, property trees are rebuilt with the same
+	insertion numbers, regular expressions are compiled again from their
+	source and property caches start out empty.
+
+	The new state is always consistent enough for js_freestate, so running
+	out of memory half way just frees it again.
+*/
+
+struct clone
+{
+	js_State *J, *K;
+	void **key, **val;
+	unsigned int mask;
+};
+
+static unsigned int hashptr(const void *p)
+{
+	unsigned int h = (unsigned int)((uintptr_t)p >> 4) * 2654435761u;
+	return h ^ (h >> 16);
+}
+
+static void addclone(struct clone *C, void *old, void *new)
+{
+	unsigned int i = hashptr(old) & C->mask;
+	while (C->key[i])
+		i = (i + 1) & C->mask;
+	C->key[i] = old;
+	C->val[i] = new;
+}
+
+static void *findclone(struct clone *C, void *old)
+{
+	unsigned int i;
+	if (!old)
+		return NULL;
+	i = hashptr(old) & C->mask;
+	while (C->key[i] != old)
+		i = (i + 1) & C->mask;
+	return C->val[i];
+}
+
+static const char *cloneatom(struct clone *C, const char *atom)
+{
+	return jsS_copiedatom(C->K, C->J, atom);
+}
+
+static void clonevalues(struct clone *C, js_Value *dst, js_Value *src, int n)
+{
+	while (n--) {
+		*dst = *src;
+		if (JSV_ISATOM(src))
+			JSV_SETATOM(dst, cloneatom(C, JSV_LITSTR(src)));
+		if (JSV_TYPE(src) == JS_TMEMSTR)
+			JSV_SETMEMSTR(dst, findclone(C, JSV_MEMSTR(src)));
+		if (JSV_TYPE(src) == JS_TOBJECT)
+			JSV_SETOBJECT(dst, findclone(C, JSV_OBJECT(src)));
+		++dst, ++src;
+	}
+}
+
+static void *clonearray(js_State *K, const void *src, int n, int size)
+{
+	void *dst;
+	if (n == 0)
+		return NULL;
+	dst = js_malloc(K, n * size);
+	memcpy(dst, src, n * size);
+	return dst;
+}
+
+static void cloneshapes(struct clone *C, js_Shape *shape, js_Shape *copy)
+{
+	js_Shape *kid, *kidcopy;
+	addclone(C, shape, copy);
+	for (kid = shape->kids; kid; kid = kid->sibling) {
+		kidcopy = jsV_newshape(C->K, copy, cloneatom(C, kid->name), kid->atts);
+		cloneshapes(C, kid, kidcopy);
+	}
+}
+
+static void clonememstring(struct clone *C, js_String *s, js_String *src)
+{
+	s->left = findclone(C, src->left);
+	s->right = findclone(C, src->right);
+	s->length = src->length;
+	s->runes = src->runes;
+	s->ascii = src->ascii;
+	s->depth = src->depth;
+}
+
+/* Translate the string operands in the code */
+static void clonecode(struct clone *C, js_Function *F)
+{
+	js_Instruction *p;
+	const char *str;
+	js_String *lit;
+	int pc, op, k;
+	for (pc = 0; pc < F->codelen; pc += jsC_oplength(op)) {
+		op = F->code[pc];
+		k = jsC_constoperand(op);
+		if (k == 0 || op == OP_NUMBER)
+			continue;
+		p = F->code + pc + k;
+		if (op == OP_MEMSTRING) {
+			memcpy(&lit, p, sizeof lit);
+			lit = findclone(C, lit);
+			memcpy(p, &lit, sizeof lit);
+		} else {
+			memcpy(&str, p, sizeof str);
+			str = cloneatom(C, str);
+			memcpy(p, &str, sizeof str);
+		}
+	}
+}
+
+static void clonefunction(struct clone *C, js_Function *F, js_Function *src)
+{
+	js_State *K = C->K;
+	int i;
+
+	F->name = cloneatom(C, src->name);
+	F->filename = cloneatom(C, src->filename);
+	F->script = src->script;
+	F->lightweight = src->lightweight;
+	F->dynamic = src->dynamic;
+	F->strict = src->strict;
+	F->arguments = src->arguments;
+	F->varargs = src->varargs;
+	F->numparams = src->numparams;
+	F->line = src->line;
+	F->lastline = src->lastline;
+
+	F->code = clonearray(K, src->code, src->codelen, sizeof *F->code);
+	F->codecap = F->codelen = src->codelen;
+	clonecode(C, F);
+
+	F->linetab = clonearray(K, src->linetab, src->linelen * 2, sizeof *F->linetab);
+	F->linecap = F->linelen = src->linelen;
+
+	F->funtab = clonearray(K, src->funtab, src->funlen, sizeof *F->funtab);
+	F->funcap = F->funlen = src->funlen;
+	for (i = 0; i < F->funlen; ++i)
+		F->funtab[i] = findclone(C, src->funtab[i]);
+
+	F->vartab = clonearray(K, src->vartab, src->varlen, sizeof *F->vartab);
+	F->varcap = F->varlen = src->varlen;
+	for (i = 0; i < F->varlen; ++i)
+		F->vartab[i] = cloneatom(C, src->vartab[i]);
+
+	F->strtab = clonearray(K, src->strtab, src->strlen, sizeof *F->strtab);
+	F->strcap = F->strlen = src->strlen;
+	for (i = 0; i < F->strlen; ++i)
+		F->strtab[i] = cloneatom(C, src->strtab[i]);
+
+	F->littab = clonearray(K, src->littab, src->litlen, sizeof *F->littab);
+	F->litcap = F->litlen = src->litlen;
+	for (i = 0; i < F->litlen; ++i)
+		F->littab[i] = findclone(C, src->littab[i]);
+
+	if (src->cachelen > 0) {
+		F->cachetab = js_malloc(K, src->cachelen * JS_PROPCACHE * (int)sizeof *F->cachetab);
+		memset(F->cachetab, 0, src->cachelen * JS_PROPCACHE * sizeof *F->cachetab);
+		F->cachelen = src->cachelen;
+	}
+
+	F->gcsize = src->gcsize;
+}
+
+static void cloneenvironment(struct clone *C, js_Environment *E, js_Environment *src)
+{
+	E->outer = findclone(C, src->outer);
+	E->variables = findclone(C, src->variables);
+	if (!src->variables)
+		clonevalues(C, E->slots, src->slots, src->count);
+}
+
+static void cloneproperty(struct clone *C, js_Object *obj, js_Property *prop)
+{
+	js_Property *ref;
+	if (prop->left->level)
+		cloneproperty(C, obj, prop->left);
+	ref = jsV_setproperty(C->K, obj, cloneatom(C, prop->name));
+	ref->atts = prop->atts;
+	ref->order = prop->order;
+	clonevalues(C, &ref->value, &prop->value, 1);
+	ref->getter = findclone(C, prop->getter);
+	ref->setter = findclone(C, prop->setter);
+	if (prop->right->level)
+		cloneproperty(C, obj, prop->right);
+}
+
+/* Capacity of the slots of an object in shape mode, see jsV_addslot */
+static void cloneobject(struct clone *C, js_Object *obj, js_Object *src)
+{
+	js_State *K = C->K;
+	js_Iterator *node, *tail;
+	const char *error;
+	int opts;
+
+	obj->type = src->type;
+	obj->prototype = findclone(C, src->prototype);
+
+	if (src->shape) {
+		obj->shape = findclone(C, src->shape);
+		if (src->count > 0) {
+			obj->slots = js_malloc(K, jsV_slotcapacity(src->count) * (int)sizeof *obj->slots);
+			obj->count = src->count;
+			clonevalues(C, obj->slots, src->slots, src->count);
+		}
+	} else {
+		obj->shape = NULL;
+		if (src->properties->level)
+			cloneproperty(C, obj, src->properties);
+		obj->nextorder = src->nextorder;
+	}
+
+	switch (src->type) {
+	default:
+		obj->u = src->u;
+		break;
+	case JS_CARRAY:
+		obj->u.a = src->u.a;
+		obj->u.a.array = NULL;
+		if (src->u.a.array) {
+			obj->u.a.array = js_malloc(K, src->u.a.flat_capacity * (int)sizeof *obj->u.a.array);
+			clonevalues(C, obj->u.a.array, src->u.a.array, src->u.a.flat_length);
+		}
+		break;
+	case JS_CFUNCTION:
+	case JS_CSCRIPT:
+		obj->u.f.function = findclone(C, src->u.f.function);
+		obj->u.f.scope = findclone(C, src->u.f.scope);
+		break;
+	case JS_CSTRING:
+		obj->u.s.length = src->u.s.length;
+		obj->u.s.memstr = findclone(C, src->u.s.memstr);
+		if (obj->u.s.memstr)
+			obj->u.s.string = jsV_flatten(K, obj->u.s.memstr);
+		else
+			obj->u.s.string = cloneatom(C, src->u.s.string);
+		break;
+	case JS_CREGEXP:
+		obj->u.r.source = js_strdup(K, src->u.r.source);
+		obj->u.r.flags = src->u.r.flags;
+		obj->u.r.last = src->u.r.last;
+		opts = 0;
+		if (src->u.r.flags & JS_REGEXP_I) opts |= REG_ICASE;
+		if (src->u.r.flags & JS_REGEXP_M) opts |= REG_NEWLINE;
+		obj->u.r.prog = js_regcompx(K->alloc, K->actx, obj->u.r.source, opts, &error);
+		if (!obj->u.r.prog)
+			js_error(K, "cannot clone regular expression: %s", error);
+		break;
+	case JS_CITERATOR:
+		obj->u.iter.target = findclone(C, src->u.iter.target);
+		if (src->u.iter.name)
+			obj->u.iter.name = cloneatom(C, src->u.iter.name);
+		tail = NULL;
+		for (node = src->u.iter.head; node; node = node->next) {
+			js_Iterator *copy = js_malloccell(K, sizeof *copy);
+			copy->name = NULL;
+			copy->next = NULL;
+			if (tail)
+				tail->next = copy;
+			else
+				obj->u.iter.head = copy;
+			tail = copy;
+			copy->name = cloneatom(C, node->name);
+		}
+		break;
+	}
+
+	obj->extensible = src->extensible;
+}
+
+/* Userdata and C function data can only be shared if nothing frees it */
+static int iscloneable(js_State *J)
+{
+	js_Object *obj;
+	if (J->tracetop > 0 || J->envtop > 0 || J->frametop > 0 || J->bot > 0)
+		return 0;
+	for (obj = J->gcobj; obj; obj = obj->gcnext) {
+		if (obj->type == JS_CUSERDATA && obj->u.user.finalize)
+			return 0;
+		if (obj->type == JS_CCFUNCTION && obj->u.c.finalize)
+			return 0;
+	}
+	return 1;
+}
+
+static int countshapes(js_Shape *shape)
+{
+	int n = 1;
+	for (shape = shape->kids; shape; shape = shape->sibling)
+		n += countshapes(shape);
+	return n;
+}
+
+static void cloneheap(struct clone *C)
+{
+	js_State *J = C->J, *K = C->K;
+	js_Environment *env, *E;
+	js_Function *fun, *F;
+	js_Object *obj, *O;
+	js_String *str, *S;
+	int i, flat;
+
+	/* create everything empty, so that the contents can refer to it */
+
+	jsS_copystrings(K, J);
+	for (i = 0; i < JS_ATOM_COUNT; ++i)
+		K->atoms[i] = cloneatom(C, J->atoms[i]);
+	K->rootshape = jsV_newshape(K, NULL, NULL, 0);
+	cloneshapes(C, J->rootshape, K->rootshape);
+
+	for (str = J->gcstr; str; str = str->gcnext) {
+		flat = !str->left && !str->right;
+		S = jsV_newmemstring(K, flat ? str->p : NULL, flat ? str->length : 0);
+		addclone(C, str, S);
+	}
+	for (fun = J->gcfun; fun; fun = fun->gcnext) {
+		F = js_malloc(K, sizeof *F);
+		memset(F, 0, sizeof *F);
+		F->gcnext = K->gcfun;
+		K->gcfun = F;
+		addclone(C, fun, F);
+	}
+	for (env = J->gcenv; env; env = env->gcnext) {
+		if (env->variables)
+			E = jsR_newenvironment(K, NULL, NULL);
+		else
+			E = jsR_newslotenvironment(K, env->count, NULL);
+		addclone(C, env, E);
+	}
+	for (obj = J->gcobj; obj; obj = obj->gcnext) {
+		O = jsV_newobject(K, JS_COBJECT, NULL);
+		addclone(C, obj, O);
+	}
+
+	/* then copy the contents */
+
+	for (str = J->gcstr; str; str = str->gcnext)
+		clonememstring(C, findclone(C, str), str);
+	for (fun = J->gcfun; fun; fun = fun->gcnext)
+		clonefunction(C, findclone(C, fun), fun);
+	for (env = J->gcenv; env; env = env->gcnext)
+		cloneenvironment(C, findclone(C, env), env);
+	for (obj = J->gcobj; obj; obj = obj->gcnext)
+		cloneobject(C, findclone(C, obj), obj);
+
+	K->Object_prototype = findclone(C, J->Object_prototype);
+	K->Array_prototype = findclone(C, J->Array_prototype);
+	K->Function_prototype = findclone(C, J->Function_prototype);
+	K->Boolean_prototype = findclone(C, J->Boolean_prototype);
+	K->Number_prototype = findclone(C, J->Number_prototype);
+	K->String_prototype = findclone(C, J->String_prototype);
+	K->RegExp_prototype = findclone(C, J->RegExp_prototype);
+	K->Date_prototype = findclone(C, J->Date_prototype);
+
+	K->Error_prototype = findclone(C, J->Error_prototype);
+	K->EvalError_prototype = findclone(C, J->EvalError_prototype);
+	K->RangeError_prototype = findclone(C, J->RangeError_prototype);
+	K->ReferenceError_prototype = findclone(C, J->ReferenceError_prototype);
+	K->SyntaxError_prototype = findclone(C, J->SyntaxError_prototype);
+	K->TypeError_prototype = findclone(C, J->TypeError_prototype);
+	K->URIError_prototype = findclone(C, J->URIError_prototype);
+
+	K->R = findclone(C, J->R);
+	K->G = findclone(C, J->G);
+	K->E = findclone(C, J->E);
+	K->GE = findclone(C, J->GE);
+
+	clonevalues(C, K->stack, J->stack, J->top);
+	K->top = J->top;
+}
+
+js_State *js_clonestate(js_State *J)
+{
+	struct clone C;
+	js_Environment *env;
+	js_Function *fun;
+	js_Object *obj;
+	js_String *str;
+	js_State *K;
+	int n, cap;
+
+	if (!iscloneable(J))
+		return NULL;
+
+	/* the clone starts out between collection cycles */
+	jsG_finish(J);
+
+	K = J->alloc(J->actx, NULL, sizeof *K);
+	if (!K)
+		return NULL;
+	memset(K, 0, sizeof *K);
+	K->actx = J->actx;
+	K->uctx = J->uctx;
+	K->alloc = J->alloc;
+	K->report = J->report;
+	K->panic = J->panic;
+
+	K->strict = K->default_strict = J->default_strict;
+	K->seed = J->seed;
+	K->nextref = J->nextref;
+
+	if (!jsR_resizecalls(K, JS_ENVSTART)) {
+		J->alloc(J->actx, K, 0);
+		return NULL;
+	}
+
+	K->trace[0].name = "-top-";
+	K->trace[0].file = "native";
+	K->trace[0].line = 0;
+	K->trace[0].function = NULL;
+	K->trace[0].pc = NULL;
+
+	/* the table of clones has room for twice the number of entries */
+	n = countshapes(J->rootshape);
+	for (str = J->gcstr; str; str = str->gcnext) ++n;
+	for (fun = J->gcfun; fun; fun = fun->gcnext) ++n;
+	for (env = J->gcenv; env; env = env->gcnext) ++n;
+	for (obj = J->gcobj; obj; obj = obj->gcnext) ++n;
+	for (cap = 64; cap < n * 2; cap *= 2)
+		;
+
+	C.J = J;
+	C.K = K;
+	C.mask = cap - 1;
+	C.key = J->alloc(J->actx, NULL, cap * (int)sizeof *C.key);
+	C.val = J->alloc(J->actx, NULL, cap * (int)sizeof *C.val);
+	K->stack = J->alloc(J->actx, NULL, J->stacksize * (int)sizeof *K->stack);
+	K->stacksize = J->stacksize;
+	if (!C.key || !C.val || !K->stack) {
+		J->alloc(J->actx, C.key, 0);
+		J->alloc(J->actx, C.val, 0);
+		J->alloc(J->actx, K->stack, 0);
+		J->alloc(J->actx, K->envstack, 0);
+		J->alloc(J->actx, K->trace, 0);
+		J->alloc(J->actx, K->frames, 0);
+		J->alloc(J->actx, K, 0);
+		return NULL;
+	}
+	memset(C.key, 0, cap * sizeof *C.key);
+
+	if (js_try(K)) {
+		J->alloc(J->actx, C.key, 0);
+		J->alloc(J->actx, C.val, 0);
+		js_freestate(K);
+		return NULL;
+	}
+	cloneheap(&C);
+	js_endtry(K);
+
+	J->alloc(J->actx, C.key, 0);
+	J->alloc(J->actx, C.val, 0);
+
+	K->gcmark = J->gcmark;
+	K->gcbudget = J->gcbudget;
+	K->gcnursery = J->gcnursery;
+	K->gccounter = J->gccounter - J->oldstackbytes;
+	K->gcthresh = J->gcthresh;
+	K->gclimit = J->gclimit;
+	K->gcheaplimit = J->gcheaplimit;
+	K->gcold = J->gcold;
+
+	return K;
+}
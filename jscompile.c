@@ -2,7 +2,7 @@
 #include "jslex.h"
 #include "jsparse.h"
 #include "jscompile.h"
-#include "jsvalue.h" /* for jsV_numbertostring */
+#include "jsvalue.h" /* for jsV_numbertostring and memstr literals */
 
 #define cexp jsC_cexp /* collision with math.h */
 
@@ -51,23 +51,121 @@ static void checkfutureword(JF, js_Ast *exp)
 	}
 }
 
-static js_Function *newfun(js_State *J, int line, js_Ast *name, js_Ast *params, js_Ast *body, int script, int default_strict)
+static int hasfunction(js_Ast *node)
 {
-	js_Function *F = js_malloc(J, sizeof *F);
+	while (node && node->type == AST_LIST) {
+		if (hasfunction(node->a))
+			return 1;
+		node = node->b;
+	}
+	if (!node)
+		return 0;
+	if (node->type == EXP_FUN || node->type == AST_FUNDEC || node->type == EXP_PROP_GET || node->type == EXP_PROP_SET)
+		return 1;
+	return hasfunction(node->a) || hasfunction(node->b) || hasfunction(node->c) || hasfunction(node->d);
+}
+
+/* Look for eval, with, and closures over a catch variable, which need the variables in named scopes */
+static int isdynamic(js_Ast *node)
+{
+	while (node && node->type == AST_LIST) {
+		if (isdynamic(node->a))
+			return 1;
+		node = node->b;
+	}
+	if (!node)
+		return 0;
+	if (node->type == STM_WITH)
+		return 1;
+	if (node->type == STM_TRY && node->b && hasfunction(node->c))
+		return 1;
+	if (node->type == EXP_CALL && node->a->type == EXP_IDENTIFIER && !strcmp(node->a->string, "eval"))
+		return 1;
+	return isdynamic(node->a) || isdynamic(node->b) || isdynamic(node->c) || isdynamic(node->d);
+}
+
+static int isarguments(js_Ast *node)
+{
+	return node->type == EXP_IDENTIFIER && !strcmp(node->string, "arguments");
+}
+
+static int isargumentsref(js_Ast *node)
+{
+	return node && (node->type == EXP_INDEX || node->type == EXP_MEMBER) && isarguments(node->a);
+}
+
+/* Find the uses of 'arguments': 1 for reading its length and elements, 2 for anything else */
+static int argumentsuse(js_Ast *node)
+{
+	int use = 0;
+	while (node && node->type == AST_LIST) {
+		use |= argumentsuse(node->a);
+		node = node->b;
+	}
+	if (!node)
+		return use;
+	switch (node->type) {
+	case EXP_FUN:
+	case AST_FUNDEC:
+	case EXP_PROP_GET:
+	case EXP_PROP_SET:
+		return use; /* these have their own */
+	case EXP_IDENTIFIER:
+		return isarguments(node) ? 2 : 0;
+	case EXP_MEMBER:
+		if (isarguments(node->a))
+			return strcmp(node->b->string, "length") ? 2 : 1;
+		return argumentsuse(node->a);
+	case EXP_INDEX:
+		if (isarguments(node->a))
+			return 1 | argumentsuse(node->b);
+		break;
+	case EXP_CALL: /* would be called with arguments as this */
+	case EXP_POSTINC: case EXP_POSTDEC: case EXP_PREINC: case EXP_PREDEC:
+	case EXP_DELETE:
+	case EXP_ASS: case EXP_ASS_MUL: case EXP_ASS_DIV: case EXP_ASS_MOD:
+	case EXP_ASS_ADD: case EXP_ASS_SUB: case EXP_ASS_SHL: case EXP_ASS_SHR:
+	case EXP_ASS_USHR: case EXP_ASS_BITAND: case EXP_ASS_BITXOR: case EXP_ASS_BITOR:
+	case STM_FOR_IN:
+		if (isargumentsref(node->a))
+			return 2;
+		break;
+	default:
+		break;
+	}
+	return argumentsuse(node->a) | argumentsuse(node->b) | argumentsuse(node->c) | argumentsuse(node->d);
+}
+
+static js_Function *newfun(js_State *J, js_Function *parent, int line, js_Ast *name, js_Ast *params, js_Ast *body, int script, int default_strict)
+{
+	js_Function *F;
+	jsG_grow(J, sizeof *F);
+	F = js_malloc(J, sizeof *F);
 	memset(F, 0, sizeof *F);
-	F->gcmark = 0;
+	F->gcmark = JS_NEWMARK(J);
 	F->gcnext = J->gcfun;
 	J->gcfun = F;
-	++J->gccounter;
 
 	F->filename = js_intern(J, J->filename);
 	F->line = line;
 	F->script = script;
 	F->strict = default_strict;
-	F->name = name ? name->string : "";
+	F->name = name ? name->string : js_intern(J, "");
+
+	/* a function nested in one without eval or with cannot have them either */
+	F->dynamic = script || ((!parent || parent->dynamic) && isdynamic(body));
 
+	F->parent = parent;
 	cfunbody(J, F, name, params, body);
+	F->parent = NULL;
+	jsC_optimize(J, F);
+
+	if (F->cachelen > 0) {
+		F->cachetab = js_malloc(J, F->cachelen * JS_PROPCACHE * (int)sizeof *F->cachetab);
+		memset(F->cachetab, 0, F->cachelen * JS_PROPCACHE * sizeof *F->cachetab);
+	}
 
+	jsG_growfunction(J, F);
 	return F;
 }
 
@@ -86,7 +184,15 @@ static void emitraw(JF, int value)
 
 static void emit(JF, int value)
 {
-	emitraw(J, F, F->lastline);
+	if (F->linelen == 0 || F->linetab[F->linelen * 2 - 1] != F->lastline) {
+		if (F->linelen >= F->linecap) {
+			F->linecap = F->linecap ? F->linecap * 2 : 16;
+			F->linetab = js_realloc(J, F->linetab, F->linecap * 2 * sizeof *F->linetab);
+		}
+		F->linetab[F->linelen * 2] = F->codelen;
+		F->linetab[F->linelen * 2 + 1] = F->lastline;
+		++F->linelen;
+	}
 	emitraw(J, F, value);
 }
 
@@ -100,6 +206,22 @@ static void emitline(JF, js_Ast *node)
 	F->lastline = node->line;
 }
 
+/* Find the line of the instruction at pc */
+int jsC_pctoline(js_Function *F, int pc)
+{
+	int lo = 0, hi = F->linelen - 1;
+	if (hi < 0 || pc < F->linetab[0])
+		return F->line;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (F->linetab[mid * 2] <= pc)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return F->linetab[lo * 2 + 1];
+}
+
 static int addfunction(JF, js_Function *value)
 {
 	if (F->funlen >= F->funcap) {
@@ -110,6 +232,16 @@ static int addfunction(JF, js_Function *value)
 	return F->funlen++;
 }
 
+static int appendlocal(JF, const char *name)
+{
+	if (F->varlen >= F->varcap) {
+		F->varcap = F->varcap ? F->varcap * 2 : 16;
+		F->vartab = js_realloc(J, F->vartab, F->varcap * sizeof *F->vartab);
+	}
+	F->vartab[F->varlen] = name;
+	return ++F->varlen;
+}
+
 static int addlocal(JF, js_Ast *ident, int reuse)
 {
 	const char *name = ident->string;
@@ -133,12 +265,7 @@ static int addlocal(JF, js_Ast *ident, int reuse)
 			}
 		}
 	}
-	if (F->varlen >= F->varcap) {
-		F->varcap = F->varcap ? F->varcap * 2 : 16;
-		F->vartab = js_realloc(J, F->vartab, F->varcap * sizeof *F->vartab);
-	}
-	F->vartab[F->varlen] = name;
-	return ++F->varlen;
+	return appendlocal(J, F, name);
 }
 
 static int findlocal(JF, const char *name)
@@ -179,11 +306,21 @@ static void emitnumber(JF, double num)
 	}
 }
 
+static void addstring(JF, const char *value)
+{
+	if (F->strlen >= F->strcap) {
+		F->strcap = F->strcap ? F->strcap * 2 : 16;
+		F->strtab = js_realloc(J, F->strtab, F->strcap * sizeof *F->strtab);
+	}
+	F->strtab[F->strlen++] = value;
+}
+
 static void emitstring(JF, int opcode, const char *str)
 {
 #define N (sizeof(str) / sizeof(js_Instruction))
 	js_Instruction x[N];
 	size_t i;
+	addstring(J, F, str);
 	emit(J, F, opcode);
 	memcpy(x, &str, sizeof(str));
 	for (i = 0; i < N; ++i)
@@ -191,6 +328,61 @@ static void emitstring(JF, int opcode, const char *str)
 #undef N
 }
 
+static void emitliteral(JF, const char *str)
+{
+#define N (sizeof(js_String*) / sizeof(js_Instruction))
+	js_Instruction x[N];
+	js_String *v;
+	size_t i, n = strlen(str);
+
+	if (n <= JSV_SHRSTRLEN) {
+		emitstring(J, F, OP_STRING, str);
+		return;
+	}
+
+	/* count the characters now, so indexing the literal is cheap */
+	v = jsV_newmemstring(J, str, n);
+	jsV_utflen(J, v);
+	if (F->litlen >= F->litcap) {
+		F->litcap = F->litcap ? F->litcap * 2 : 16;
+		F->littab = js_realloc(J, F->littab, F->litcap * sizeof *F->littab);
+	}
+	F->littab[F->litlen++] = v;
+
+	emit(J, F, OP_MEMSTRING);
+	memcpy(x, &v, sizeof(v));
+	for (i = 0; i < N; ++i)
+		emitarg(J, F, x[i]);
+#undef N
+}
+
+static void emitprop(JF, int opcode, const char *str)
+{
+	emitstring(J, F, opcode, str);
+	emitarg(J, F, F->cachelen++);
+}
+
+/* Resolve a name to a local of an enclosing function without eval or with */
+static int emitupvalue(JF, int oploc, const char *name)
+{
+	js_Function *P;
+	int depth, i;
+	for (P = F->parent, depth = 1; P && !P->dynamic; P = P->parent, ++depth) {
+		i = findlocal(J, P, name);
+		if (i > 0) {
+			if (oploc == OP_DELLOCAL) {
+				emit(J, F, OP_FALSE);
+				return 1;
+			}
+			emit(J, F, oploc == OP_SETLOCAL ? OP_SETUPVAL : OP_GETUPVAL);
+			emitarg(J, F, depth);
+			emitarg(J, F, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
 static void emitlocal(JF, int oploc, int opvar, js_Ast *ident)
 {
 	int is_arguments = !strcmp(ident->string, "arguments");
@@ -199,7 +391,8 @@ static void emitlocal(JF, int oploc, int opvar, js_Ast *ident)
 
 	if (is_arguments) {
 		F->lightweight = 0;
-		F->arguments = 1;
+		if (F->dynamic)
+			F->arguments = 1;
 	}
 
 	checkfutureword(J, F, ident);
@@ -213,6 +406,13 @@ static void emitlocal(JF, int oploc, int opvar, js_Ast *ident)
 		js_evalerror(J, "%s:%d: invalid use of 'eval'", J->filename, ident->line);
 
 	i = findlocal(J, F, ident->string);
+	if (i < 0 && !F->dynamic) {
+		/* the arguments object goes in a local slot of its own */
+		if (is_arguments)
+			i = F->arguments = appendlocal(J, F, ident->string);
+		else if (emitupvalue(J, F, oploc, ident->string))
+			return;
+	}
 	if (i < 0) {
 		emitstring(J, F, opvar, ident->string);
 	} else {
@@ -347,12 +547,12 @@ static void cobject(JF, js_Ast *list)
 			emit(J, F, OP_INITPROP);
 			break;
 		case EXP_PROP_GET:
-			emitfunction(J, F, newfun(J, prop->line, NULL, NULL, kv->c, 0, F->strict));
+			emitfunction(J, F, newfun(J, F, prop->line, NULL, NULL, kv->c, 0, F->strict));
 			emitline(J, F, kv);
 			emit(J, F, OP_INITGETTER);
 			break;
 		case EXP_PROP_SET:
-			emitfunction(J, F, newfun(J, prop->line, NULL, kv->b, kv->c, 0, F->strict));
+			emitfunction(J, F, newfun(J, F, prop->line, NULL, kv->b, kv->c, 0, F->strict));
 			emitline(J, F, kv);
 			emit(J, F, OP_INITSETTER);
 			break;
@@ -394,7 +594,7 @@ static void cassign(JF, js_Ast *exp)
 		cexp(J, F, lhs->a);
 		cexp(J, F, rhs);
 		emitline(J, F, exp);
-		emitstring(J, F, OP_SETPROP_S, lhs->b->string);
+		emitprop(J, F, OP_SETPROP_S, lhs->b->string);
 		break;
 	default:
 		jsC_error(J, lhs, "invalid l-value in assignment");
@@ -432,7 +632,7 @@ static void cassignforin(JF, js_Ast *stm)
 		cexp(J, F, lhs->a);
 		emitline(J, F, lhs);
 		emit(J, F, OP_ROT2);
-		emitstring(J, F, OP_SETPROP_S, lhs->b->string);
+		emitprop(J, F, OP_SETPROP_S, lhs->b->string);
 		emit(J, F, OP_POP);
 		break;
 	default:
@@ -458,7 +658,7 @@ static void cassignop1(JF, js_Ast *lhs)
 		cexp(J, F, lhs->a);
 		emitline(J, F, lhs);
 		emit(J, F, OP_DUP);
-		emitstring(J, F, OP_GETPROP_S, lhs->b->string);
+		emitprop(J, F, OP_GETPROP_S, lhs->b->string);
 		break;
 	default:
 		jsC_error(J, lhs, "invalid l-value in assignment");
@@ -481,7 +681,7 @@ static void cassignop2(JF, js_Ast *lhs, int postfix)
 	case EXP_MEMBER:
 		emitline(J, F, lhs);
 		if (postfix) emit(J, F, OP_ROT3);
-		emitstring(J, F, OP_SETPROP_S, lhs->b->string);
+		emitprop(J, F, OP_SETPROP_S, lhs->b->string);
 		break;
 	default:
 		jsC_error(J, lhs, "invalid l-value in assignment");
@@ -537,7 +737,7 @@ static void ceval(JF, js_Ast *fun, js_Ast *args)
 	emit(J, F, OP_EVAL);
 }
 
-static void ccall(JF, js_Ast *fun, js_Ast *args)
+static void ccall(JF, js_Ast *fun, js_Ast *args, int tail)
 {
 	int n;
 	switch (fun->type) {
@@ -551,7 +751,7 @@ static void ccall(JF, js_Ast *fun, js_Ast *args)
 	case EXP_MEMBER:
 		cexp(J, F, fun->a);
 		emit(J, F, OP_DUP);
-		emitstring(J, F, OP_GETPROP_S, fun->b->string);
+		emitprop(J, F, OP_GETPROP_S, fun->b->string);
 		emit(J, F, OP_ROT2);
 		break;
 	case EXP_IDENTIFIER:
@@ -566,7 +766,7 @@ static void ccall(JF, js_Ast *fun, js_Ast *args)
 		break;
 	}
 	n = cargs(J, F, args);
-	emit(J, F, OP_CALL);
+	emit(J, F, tail ? OP_TAILCALL : OP_CALL);
 	emitarg(J, F, n);
 }
 
@@ -578,7 +778,7 @@ static void cexp(JF, js_Ast *exp)
 	switch (exp->type) {
 	case EXP_STRING:
 		emitline(J, F, exp);
-		emitstring(J, F, OP_STRING, exp->string);
+		emitliteral(J, F, exp->string);
 		break;
 	case EXP_NUMBER:
 		emitline(J, F, exp);
@@ -625,7 +825,7 @@ static void cexp(JF, js_Ast *exp)
 
 	case EXP_FUN:
 		emitline(J, F, exp);
-		emitfunction(J, F, newfun(J, exp->line, exp->a, exp->b, exp->c, 0, F->strict));
+		emitfunction(J, F, newfun(J, F, exp->line, exp->a, exp->b, exp->c, 0, F->strict));
 		break;
 
 	case EXP_IDENTIFIER:
@@ -634,6 +834,12 @@ static void cexp(JF, js_Ast *exp)
 		break;
 
 	case EXP_INDEX:
+		if (F->varargs && isarguments(exp->a)) {
+			cexp(J, F, exp->b);
+			emitline(J, F, exp);
+			emit(J, F, OP_GETARG);
+			break;
+		}
 		cexp(J, F, exp->a);
 		cexp(J, F, exp->b);
 		emitline(J, F, exp);
@@ -641,13 +847,18 @@ static void cexp(JF, js_Ast *exp)
 		break;
 
 	case EXP_MEMBER:
+		if (F->varargs && isarguments(exp->a)) {
+			emitline(J, F, exp);
+			emit(J, F, OP_ARGC);
+			break;
+		}
 		cexp(J, F, exp->a);
 		emitline(J, F, exp);
-		emitstring(J, F, OP_GETPROP_S, exp->b->string);
+		emitprop(J, F, OP_GETPROP_S, exp->b->string);
 		break;
 
 	case EXP_CALL:
-		ccall(J, F, exp->a, exp->b);
+		ccall(J, F, exp->a, exp->b, 0);
 		break;
 
 	case EXP_NEW:
@@ -783,6 +994,40 @@ static void cexp(JF, js_Ast *exp)
 	}
 }
 
+/* Emit a returned expression; the calls it ends in are tail calls */
+static void ctail(JF, js_Ast *exp)
+{
+	int then, end;
+
+	switch (exp->type) {
+	case EXP_CALL:
+		ccall(J, F, exp->a, exp->b, 1);
+		break;
+
+	case EXP_COMMA:
+		cexp(J, F, exp->a);
+		emitline(J, F, exp);
+		emit(J, F, OP_POP);
+		ctail(J, F, exp->b);
+		break;
+
+	case EXP_COND:
+		cexp(J, F, exp->a);
+		emitline(J, F, exp);
+		then = emitjump(J, F, OP_JTRUE);
+		ctail(J, F, exp->c);
+		end = emitjump(J, F, OP_JUMP);
+		label(J, F, then);
+		ctail(J, F, exp->b);
+		label(J, F, end);
+		break;
+
+	default:
+		cexp(J, F, exp);
+		break;
+	}
+}
+
 /* Patch break and continue statements */
 
 static void addjump(JF, enum js_AstType type, js_Ast *target, int inst)
@@ -870,6 +1115,19 @@ static js_Ast *returntarget(JF, js_Ast *node)
 	return NULL;
 }
 
+/* A returned call in a strict function can replace the caller's frame, unless a try is left */
+static int cantailcall(JF, js_Ast *node, js_Ast *target)
+{
+	if (!F->strict || F->script || !node->a)
+		return 0;
+	while (node != target) {
+		node = node->parent;
+		if (node->type == STM_TRY)
+			return 0;
+	}
+	return 1;
+}
+
 /* Emit code to rebalance stack and scopes during an abrupt exit */
 
 static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
@@ -918,11 +1176,13 @@ static void cexit(JF, enum js_AstType T, js_Ast *node, js_Ast *target)
 			if (prev == node->c) {
 				/* ... with finally */
 				if (node->d) {
-					emit(J, F, OP_ENDCATCH);
+					if (F->dynamic)
+						emit(J, F, OP_ENDCATCH);
 					emit(J, F, OP_ENDTRY);
 					cstm(J, F, node->d); /* finally */
 				} else {
-					emit(J, F, OP_ENDCATCH);
+					if (F->dynamic)
+						emit(J, F, OP_ENDCATCH);
 				}
 			}
 			break;
@@ -947,6 +1207,24 @@ static void ctryfinally(JF, js_Ast *trystm, js_Ast *finallystm)
 	cstm(J, F, finallystm);
 }
 
+static void ccatch(JF, js_Ast *catchvar, js_Ast *catchstm)
+{
+	int i;
+	if (F->dynamic) {
+		emitstring(J, F, OP_CATCH, catchvar->string);
+		cstm(J, F, catchstm);
+		emit(J, F, OP_ENDCATCH);
+	} else {
+		/* the exception goes in a new local, named only within the catch block */
+		i = appendlocal(J, F, catchvar->string);
+		emit(J, F, OP_SETLOCAL);
+		emitarg(J, F, i);
+		emit(J, F, OP_POP);
+		cstm(J, F, catchstm);
+		F->vartab[i-1] = js_intern(J, "(catch)");
+	}
+}
+
 static void ctrycatch(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catchstm)
 {
 	int L1, L2;
@@ -961,9 +1239,7 @@ static void ctrycatch(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catchstm)
 				jsC_error(J, catchvar, "redefining 'eval' is not allowed in strict mode");
 		}
 		emitline(J, F, catchvar);
-		emitstring(J, F, OP_CATCH, catchvar->string);
-		cstm(J, F, catchstm);
-		emit(J, F, OP_ENDCATCH);
+		ccatch(J, F, catchvar, catchstm);
 		L2 = emitjump(J, F, OP_JUMP); /* skip past the try block */
 	}
 	label(J, F, L1);
@@ -993,9 +1269,7 @@ static void ctrycatchfinally(JF, js_Ast *trystm, js_Ast *catchvar, js_Ast *catch
 				jsC_error(J, catchvar, "redefining 'eval' is not allowed in strict mode");
 		}
 		emitline(J, F, catchvar);
-		emitstring(J, F, OP_CATCH, catchvar->string);
-		cstm(J, F, catchstm);
-		emit(J, F, OP_ENDCATCH);
+		ccatch(J, F, catchvar, catchstm);
 		emit(J, F, OP_ENDTRY);
 		L3 = emitjump(J, F, OP_JUMP); /* skip past the try block to the finally block */
 	}
@@ -1240,13 +1514,15 @@ static void cstm(JF, js_Ast *stm)
 		break;
 
 	case STM_RETURN:
-		if (stm->a)
-			cexp(J, F, stm->a);
-		else
-			emit(J, F, OP_UNDEF);
 		target = returntarget(J, F, stm->parent);
 		if (!target)
 			jsC_error(J, stm, "return not in function");
+		if (cantailcall(J, F, stm, target))
+			ctail(J, F, stm->a);
+		else if (stm->a)
+			cexp(J, F, stm->a);
+		else
+			emit(J, F, OP_UNDEF);
 		cexit(J, F, STM_RETURN, stm, target);
 		emitline(J, F, stm);
 		emit(J, F, OP_RETURN);
@@ -1273,7 +1549,8 @@ static void cstm(JF, js_Ast *stm)
 	case STM_TRY:
 		emitline(J, F, stm);
 		if (stm->b && stm->c) {
-			F->lightweight = 0;
+			if (F->dynamic)
+				F->lightweight = 0;
 			if (stm->d)
 				ctrycatchfinally(J, F, stm->a, stm->b, stm->c, stm->d);
 			else
@@ -1353,16 +1630,27 @@ static void cvardecs(JF, js_Ast *node)
 	if (node->d) cvardecs(J, F, node->d);
 }
 
+/* Declare the function names first, so the inner functions can see each other */
+static void cfunnames(JF, js_Ast *list)
+{
+	while (list) {
+		js_Ast *stm = list->a;
+		if (stm->type == AST_FUNDEC)
+			stm->number = addlocal(J, F, stm->a, 0); /* slot for cfundecs */
+		list = list->b;
+	}
+}
+
 static void cfundecs(JF, js_Ast *list)
 {
 	while (list) {
 		js_Ast *stm = list->a;
 		if (stm->type == AST_FUNDEC) {
 			emitline(J, F, stm);
-			emitfunction(J, F, newfun(J, stm->line, stm->a, stm->b, stm->c, 0, F->strict));
+			emitfunction(J, F, newfun(J, F, stm->line, stm->a, stm->b, stm->c, 0, F->strict));
 			emitline(J, F, stm);
 			emit(J, F, OP_SETLOCAL);
-			emitarg(J, F, addlocal(J, F, stm->a, 0));
+			emitarg(J, F, stm->number);
 			emit(J, F, OP_POP);
 		}
 		list = list->b;
@@ -1373,6 +1661,7 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 {
 	F->lightweight = 1;
 	F->arguments = 0;
+	F->varargs = 0;
 
 	if (F->script)
 		F->lightweight = 0;
@@ -1388,7 +1677,7 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 
 	if (body) {
 		cvardecs(J, F, body);
-		cfundecs(J, F, body);
+		cfunnames(J, F, body);
 	}
 
 	if (name) {
@@ -1401,6 +1690,13 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 		}
 	}
 
+	/* read arguments from the stack unless the object itself is needed */
+	if (!F->script && !F->dynamic && findlocal(J, F, "arguments") < 0)
+		F->varargs = argumentsuse(body) == 1;
+
+	if (body)
+		cfundecs(J, F, body);
+
 	if (F->script) {
 		emit(J, F, OP_UNDEF);
 		cstmlist(J, F, body);
@@ -1414,10 +1710,10 @@ static void cfunbody(JF, js_Ast *name, js_Ast *params, js_Ast *body)
 
 js_Function *jsC_compilefunction(js_State *J, js_Ast *prog)
 {
-	return newfun(J, prog->line, prog->a, prog->b, prog->c, 0, J->default_strict);
+	return newfun(J, NULL, prog->line, prog->a, prog->b, prog->c, 0, J->default_strict);
 }
 
 js_Function *jsC_compilescript(js_State *J, js_Ast *prog, int default_strict)
 {
-	return newfun(J, prog ? prog->line : 0, NULL, NULL, prog, 1, default_strict);
+	return newfun(J, NULL, prog ? prog->line : 0, NULL, NULL, prog, 1, default_strict);
 }
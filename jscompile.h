@@ -13,6 +13,7 @@ enum js_OpCode
 	OP_INTEGER,	/* -K- (number-32768) */
 	OP_NUMBER,	/* -N- <number> */
 	OP_STRING,	/* -S- <string> */
+	OP_MEMSTRING,	/* -S- <memstr> */
 	OP_CLOSURE,	/* -F- <closure> */
 
 	OP_NEWARRAY,
@@ -26,10 +27,14 @@ enum js_OpCode
 
 	OP_THIS,
 	OP_CURRENT,	/* currently executing function object */
+	OP_ARGC,	/* -- <number of arguments> */
+	OP_GETARG,	/* <index> -- <argument> */
 
 	OP_GETLOCAL,	/* -K- <value> */
 	OP_SETLOCAL,	/* <value> -K- <value> */
 	OP_DELLOCAL,	/* -K- false */
+	OP_GETUPVAL,	/* -D,K- <value> */
+	OP_SETUPVAL,	/* <value> -D,K- <value> */
 
 	OP_HASVAR,	/* -S- ( <value> | undefined ) */
 	OP_GETVAR,	/* -S- <value> */
@@ -44,9 +49,9 @@ enum js_OpCode
 	OP_INITSETTER,	/* <obj> <key> <closure> -- <obj> */
 
 	OP_GETPROP,	/* <obj> <name> -- <value> */
-	OP_GETPROP_S,	/* <obj> -S- <value> */
+	OP_GETPROP_S,	/* <obj> -S,cache- <value> */
 	OP_SETPROP,	/* <obj> <name> <value> -- <value> */
-	OP_SETPROP_S,	/* <obj> <value> -S- <value> */
+	OP_SETPROP_S,	/* <obj> <value> -S,cache- <value> */
 	OP_DELPROP,	/* <obj> <name> -- <success> */
 	OP_DELPROP_S,	/* <obj> -S- <success> */
 
@@ -55,6 +60,7 @@ enum js_OpCode
 
 	OP_EVAL,	/* <args...> -(numargs)- <returnvalue> */
 	OP_CALL,	/* <closure> <this> <args...> -(numargs)- <returnvalue> */
+	OP_TAILCALL,	/* <closure> <this> <args...> -(numargs)- <returnvalue> */
 	OP_NEW,		/* <closure> <args...> -(numargs)- <returnvalue> */
 
 	OP_TYPEOF,
@@ -106,6 +112,38 @@ enum js_OpCode
 	OP_JTRUE,
 	OP_JFALSE,
 	OP_RETURN,
+
+	/* Superinstructions made by jsC_optimize */
+	OP_GETLOCALPROP,	/* -K,S,cache- <value> */
+	OP_INCLOCAL,	/* -K- */
+	OP_DECLOCAL,	/* -K- */
+	OP_ADDINTEGER,	/* <x> -K- <x+K> */
+	OP_LTJFALSE,	/* <x> <y> -ADDR- */
+	OP_GTJFALSE,
+	OP_LEJFALSE,
+	OP_GEJFALSE,
+	OP_EQJFALSE,
+	OP_NEJFALSE,
+	OP_STRICTEQJFALSE,
+	OP_STRICTNEJFALSE,
+
+	/* Register instructions made by jsC_optimize for lightweight functions */
+	OP_MOVELOCAL,	/* -D,A- */
+	OP_BINARYLOCAL,	/* -OP,A,B- <A op B> */
+	OP_BINARYTOLOCAL,	/* -OP,D,A,B- */
+	OP_CMPLOCALJFALSE,	/* -OP,A,B,ADDR- */
+	OP_CMPINTEGERJFALSE,	/* -OP,A,K,ADDR- */
+	OP_GETPROPTOLOCAL,	/* -D,A,S,cache- */
+	OP_SETPROPFROMLOCAL,	/* -A,B,S,cache- */
+};
+
+/* Remembers where a property was found for objects of a given shape */
+struct js_PropCache
+{
+	js_Shape *shape; /* shape of the object */
+	js_Object *holder; /* direct prototype with the property, or NULL if own */
+	js_Shape *holdershape;
+	int slot;
 };
 
 struct js_Function
@@ -113,8 +151,10 @@ struct js_Function
 	const char *name;
 	int script;
 	int lightweight;
+	int dynamic; /* uses eval or with, so locals are looked up by name */
 	int strict;
-	int arguments;
+	int arguments; /* the local slot of 'arguments' if not dynamic */
+	int varargs; /* keeps the arguments on the stack for arguments.length and arguments[i] */
 	int numparams;
 
 	js_Instruction *code;
@@ -126,16 +166,37 @@ struct js_Function
 	const char **vartab;
 	int varcap, varlen;
 
+	const char **strtab; /* atoms used by the code, for the garbage collector */
+	int strcap, strlen;
+
+	js_String **littab; /* long string literals, for the garbage collector */
+	int litcap, litlen;
+
+	js_PropCache *cachetab; /* JS_PROPCACHE entries per property access */
+	int cachelen;
+
+	int *linetab; /* pairs of code offset and line, where the line changes */
+	int linecap, linelen;
+
 	const char *filename;
 	int line, lastline;
 
+	js_Function *parent; /* enclosing function, while compiling */
+
 	js_Function *gcnext;
+	js_Function *gcroot; /* scan list */
 	int gcmark;
+	int gcsize; /* bytes of the tables counted on the heap */
 };
 
 js_Function *jsC_compilefunction(js_State *J, js_Ast *prog);
 js_Function *jsC_compilescript(js_State *J, js_Ast *prog, int default_strict);
 const char *jsC_opcodestring(enum js_OpCode opcode);
+int jsC_pctoline(js_Function *F, int pc);
+void jsC_optimize(js_State *J, js_Function *F);
+int jsC_oplength(int op);
+int jsC_jumpoperand(int op);
+int jsC_constoperand(int op);
 void jsC_dumpfunction(js_State *J, js_Function *fun);
 
 #endif
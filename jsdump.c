@@ -790,7 +790,9 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 	printf("%s(%d)\n", F->name, F->numparams);
 	if (F->strict) printf("\tstrict\n");
 	if (F->lightweight) printf("\tlightweight\n");
+	if (F->dynamic) printf("\tdynamic\n");
 	if (F->arguments) printf("\targuments\n");
+	if (F->varargs) printf("\tvarargs\n");
 	printf("\tsource %s:%d\n", F->filename, F->line);
 	for (i = 0; i < F->funlen; ++i)
 		printf("\tfunction %d %s\n", i, F->funtab[i]->name);
@@ -799,10 +801,10 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 
 	printf("{\n");
 	while (p < end) {
-		int ln = *p++;
+		int ln = jsC_pctoline(F, p - F->code);
 		int c = *p++;
 
-		printf("%5d(%3d): ", (int)(p - F->code) - 2, ln);
+		printf("%5d(%3d): ", (int)(p - F->code) - 1, ln);
 		ps(opname[c]);
 
 		switch (c) {
@@ -820,6 +822,15 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 			pc(' ');
 			pstr(s);
 			break;
+		case OP_MEMSTRING:
+			{
+				js_String *mem;
+				memcpy(&mem, p, sizeof(mem));
+				p += sizeof(mem) / sizeof(*p);
+				pc(' ');
+				pstr(mem->p);
+			}
+			break;
 		case OP_NEWREGEXP:
 			pc(' ');
 			memcpy(&s, p, sizeof(s));
@@ -827,12 +838,18 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 			pregexp(s, *p++);
 			break;
 
+		case OP_GETPROP_S:
+		case OP_SETPROP_S:
+			memcpy(&s, p, sizeof(s));
+			p += sizeof(s) / sizeof(*p);
+			pc(' ');
+			ps(s);
+			++p; /* cache index */
+			break;
 		case OP_GETVAR:
 		case OP_HASVAR:
 		case OP_SETVAR:
 		case OP_DELVAR:
-		case OP_GETPROP_S:
-		case OP_SETPROP_S:
 		case OP_DELPROP_S:
 		case OP_CATCH:
 			memcpy(&s, p, sizeof(s));
@@ -844,17 +861,86 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 		case OP_GETLOCAL:
 		case OP_SETLOCAL:
 		case OP_DELLOCAL:
+		case OP_INCLOCAL:
+		case OP_DECLOCAL:
+			printf(" %s", F->vartab[*p++ - 1]);
+			break;
+
+		case OP_GETLOCALPROP:
+			printf(" %s", F->vartab[*p++ - 1]);
+			memcpy(&s, p, sizeof(s));
+			p += sizeof(s) / sizeof(*p);
+			pc(' ');
+			ps(s);
+			++p; /* cache index */
+			break;
+
+		case OP_ADDINTEGER:
+			printf(" %ld", (long)((*p++) - 32768));
+			break;
+
+		case OP_GETUPVAL:
+		case OP_SETUPVAL:
+			printf(" %ld", (long)*p++);
+			printf(" %ld", (long)*p++);
+			break;
+
+		case OP_MOVELOCAL:
+			printf(" %s", F->vartab[*p++ - 1]);
 			printf(" %s", F->vartab[*p++ - 1]);
 			break;
 
+		case OP_BINARYLOCAL:
+		case OP_BINARYTOLOCAL:
+			printf(" %s", opname[*p++]);
+			if (c == OP_BINARYTOLOCAL)
+				printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			break;
+
+		case OP_CMPLOCALJFALSE:
+			printf(" %s", opname[*p++]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %ld", (long)*p++);
+			break;
+
+		case OP_CMPINTEGERJFALSE:
+			printf(" %s", opname[*p++]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %ld", (long)((*p++) - 32768));
+			printf(" %ld", (long)*p++);
+			break;
+
+		case OP_GETPROPTOLOCAL:
+		case OP_SETPROPFROMLOCAL:
+			printf(" %s", F->vartab[*p++ - 1]);
+			printf(" %s", F->vartab[*p++ - 1]);
+			memcpy(&s, p, sizeof(s));
+			p += sizeof(s) / sizeof(*p);
+			pc(' ');
+			ps(s);
+			++p; /* cache index */
+			break;
+
 		case OP_CLOSURE:
 		case OP_CALL:
+		case OP_TAILCALL:
 		case OP_NEW:
 		case OP_JUMP:
 		case OP_JTRUE:
 		case OP_JFALSE:
 		case OP_JCASE:
 		case OP_TRY:
+		case OP_LTJFALSE:
+		case OP_GTJFALSE:
+		case OP_LEJFALSE:
+		case OP_GEJFALSE:
+		case OP_EQJFALSE:
+		case OP_NEJFALSE:
+		case OP_STRICTEQJFALSE:
+		case OP_STRICTNEJFALSE:
 			printf(" %ld", (long)*p++);
 			break;
 		}
@@ -876,41 +962,41 @@ void jsC_dumpfunction(js_State *J, js_Function *F)
 void js_dumpvalue(js_State *J, js_Value v)
 {
 	minify = 0;
-	switch (v.type) {
+	switch (JSV_TYPE(&v)) {
 	case JS_TUNDEFINED: printf("undefined"); break;
 	case JS_TNULL: printf("null"); break;
-	case JS_TBOOLEAN: printf(v.u.boolean ? "true" : "false"); break;
-	case JS_TNUMBER: printf("%.9g", v.u.number); break;
-	case JS_TSHRSTR: printf("'%s'", v.u.shrstr); break;
-	case JS_TLITSTR: printf("'%s'", v.u.litstr); break;
-	case JS_TMEMSTR: printf("'%s'", v.u.memstr->p); break;
+	case JS_TBOOLEAN: printf(JSV_BOOLEAN(&v) ? "true" : "false"); break;
+	case JS_TNUMBER: printf("%.9g", JSV_NUMBER(&v)); break;
+	case JS_TSHRSTR: printf("'%s'", JSV_SHRSTR(&v)); break;
+	case JS_TLITSTR: printf("'%s'", JSV_LITSTR(&v)); break;
+	case JS_TMEMSTR: printf("'%s'", jsV_flatten(J, JSV_MEMSTR(&v))); break;
 	case JS_TOBJECT:
-		if (v.u.object == J->G) {
+		if (JSV_OBJECT(&v) == J->G) {
 			printf("[Global]");
 			break;
 		}
-		switch (v.u.object->type) {
-		case JS_COBJECT: printf("[Object %p]", (void*)v.u.object); break;
-		case JS_CARRAY: printf("[Array %p]", (void*)v.u.object); break;
+		switch (JSV_OBJECT(&v)->type) {
+		case JS_COBJECT: printf("[Object %p]", (void*)JSV_OBJECT(&v)); break;
+		case JS_CARRAY: printf("[Array %p]", (void*)JSV_OBJECT(&v)); break;
 		case JS_CFUNCTION:
 			printf("[Function %p, %s, %s:%d]",
-				(void*)v.u.object,
-				v.u.object->u.f.function->name,
-				v.u.object->u.f.function->filename,
-				v.u.object->u.f.function->line);
+				(void*)JSV_OBJECT(&v),
+				JSV_OBJECT(&v)->u.f.function->name,
+				JSV_OBJECT(&v)->u.f.function->filename,
+				JSV_OBJECT(&v)->u.f.function->line);
 			break;
-		case JS_CSCRIPT: printf("[Script %s]", v.u.object->u.f.function->filename); break;
-		case JS_CCFUNCTION: printf("[CFunction %s]", v.u.object->u.c.name); break;
-		case JS_CBOOLEAN: printf("[Boolean %d]", v.u.object->u.boolean); break;
-		case JS_CNUMBER: printf("[Number %g]", v.u.object->u.number); break;
-		case JS_CSTRING: printf("[String'%s']", v.u.object->u.s.string); break;
+		case JS_CSCRIPT: printf("[Script %s]", JSV_OBJECT(&v)->u.f.function->filename); break;
+		case JS_CCFUNCTION: printf("[CFunction %s]", JSV_OBJECT(&v)->u.c.name); break;
+		case JS_CBOOLEAN: printf("[Boolean %d]", JSV_OBJECT(&v)->u.boolean); break;
+		case JS_CNUMBER: printf("[Number %g]", JSV_OBJECT(&v)->u.number); break;
+		case JS_CSTRING: printf("[String'%s']", JSV_OBJECT(&v)->u.s.string); break;
 		case JS_CERROR: printf("[Error]"); break;
-		case JS_CARGUMENTS: printf("[Arguments %p]", (void*)v.u.object); break;
-		case JS_CITERATOR: printf("[Iterator %p]", (void*)v.u.object); break;
+		case JS_CARGUMENTS: printf("[Arguments %p]", (void*)JSV_OBJECT(&v)); break;
+		case JS_CITERATOR: printf("[Iterator %p]", (void*)JSV_OBJECT(&v)); break;
 		case JS_CUSERDATA:
-			printf("[Userdata %s %p]", v.u.object->u.user.tag, v.u.object->u.user.data);
+			printf("[Userdata %s %p]", JSV_OBJECT(&v)->u.user.tag, JSV_OBJECT(&v)->u.user.data);
 			break;
-		default: printf("[Object %p]", (void*)v.u.object); break;
+		default: printf("[Object %p]", (void*)JSV_OBJECT(&v)); break;
 		}
 		break;
 	}
@@ -928,11 +1014,31 @@ static void js_dumpproperty(js_State *J, js_Property *node)
 		js_dumpproperty(J, node->right);
 }
 
+static void js_dumpshape(js_State *J, js_Shape *shape, js_Value *slots)
+{
+	if (shape->parent) {
+		js_dumpshape(J, shape->parent, slots);
+		printf("\t%s: ", shape->name);
+		js_dumpvalue(J, slots[shape->slot]);
+		printf(",\n");
+	}
+}
+
 void js_dumpobject(js_State *J, js_Object *obj)
 {
+	int k;
 	minify = 0;
 	printf("{\n");
-	if (obj->properties->level)
+	if (obj->type == JS_CARRAY) {
+		for (k = 0; k < obj->u.a.flat_length; ++k) {
+			printf("\t%d: ", k);
+			js_dumpvalue(J, obj->u.a.array[k]);
+			printf(",\n");
+		}
+	}
+	if (obj->shape)
+		js_dumpshape(J, obj->shape, obj->slots);
+	else if (obj->properties->level)
 		js_dumpproperty(J, obj->properties);
 	printf("}\n");
 }
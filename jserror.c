@@ -5,6 +5,8 @@
 #define QQ(X) #X
 #define Q(X) QQ(X)
 
+#define STACKTRACE_MAX 64 /* innermost calls to list in stackTrace */
+
 static int jsB_stacktrace(js_State *J, int skip)
 {
 	char buf[256];
@@ -14,7 +16,7 @@ static int jsB_stacktrace(js_State *J, int skip)
 	for (; n > 0; --n) {
 		const char *name = J->trace[n].name;
 		const char *file = J->trace[n].file;
-		int line = J->trace[n].line;
+		int line = js_traceline(J, n);
 		if (line > 0) {
 			if (name[0])
 				snprintf(buf, sizeof buf, "\n\tat %s (%s:%d)", name, file, line);
@@ -25,6 +27,11 @@ static int jsB_stacktrace(js_State *J, int skip)
 		js_pushstring(J, buf);
 		if (n < J->tracetop - skip)
 			js_concat(J);
+		if (n > 1 && n == J->tracetop - skip - STACKTRACE_MAX + 1) {
+			js_pushliteral(J, "\n\t...");
+			js_concat(J);
+			break;
+		}
 	}
 	return 1;
 }
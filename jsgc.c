@@ -5,39 +5,128 @@
 
 #include "regexp.h"
 
+/* Bytes that each kind of thing counts on the heap, see jsG_grow */
+
+static int jsG_sizeofenvironment(js_Environment *env)
+{
+	return sizeof *env + env->count * (int)sizeof *env->slots;
+}
+
+static int jsG_sizeoffunction(js_Function *fun)
+{
+	return sizeof *fun + fun->gcsize;
+}
+
+static int jsG_sizeofstring(js_String *str)
+{
+	/* ropes keep no characters of their own, see jsV_newrope */
+	if (str->left)
+		return soffsetof(js_String, p) + 1;
+	return soffsetof(js_String, p) + str->length + 1;
+}
+
+static int jsG_sizeofobject(js_Object *obj)
+{
+	int size = sizeof *obj;
+	if (obj->shape)
+		size += jsV_slotcapacity(obj->count) * (int)sizeof *obj->slots;
+	else
+		size += obj->count * (int)sizeof *obj->properties;
+	if (obj->type == JS_CARRAY)
+		size += obj->u.a.flat_capacity * (int)sizeof *obj->u.a.array;
+	return size;
+}
+
+/* Count the tables of a function that has been compiled or loaded */
+void jsG_growfunction(js_State *J, js_Function *F)
+{
+	int size = F->codelen * (int)sizeof *F->code +
+		F->funlen * (int)sizeof *F->funtab +
+		F->varlen * (int)sizeof *F->vartab +
+		F->strlen * (int)sizeof *F->strtab +
+		F->litlen * (int)sizeof *F->littab +
+		F->linelen * 2 * (int)sizeof *F->linetab +
+		F->cachelen * JS_PROPCACHE * (int)sizeof *F->cachetab;
+	jsG_grow(J, size);
+	F->gcsize = size;
+}
+
 static void jsG_freeenvironment(js_State *J, js_Environment *env)
 {
-	js_free(J, env);
+	jsG_shrink(J, jsG_sizeofenvironment(env));
+	js_freecell(J, env, jsG_sizeofenvironment(env));
 }
 
 static void jsG_freefunction(js_State *J, js_Function *fun)
 {
+	jsG_shrink(J, jsG_sizeoffunction(fun));
 	js_free(J, fun->funtab);
 	js_free(J, fun->vartab);
+	js_free(J, fun->strtab);
+	js_free(J, fun->littab);
 	js_free(J, fun->code);
+	js_free(J, fun->linetab);
+	js_free(J, fun->cachetab);
 	js_free(J, fun);
 }
 
+static void jsG_freestring(js_State *J, js_String *str)
+{
+	jsG_shrink(J, jsG_sizeofstring(str));
+	js_free(J, str->index);
+	js_freecell(J, str, jsG_sizeofstring(str));
+}
+
 static void jsG_freeproperty(js_State *J, js_Property *node)
 {
 	if (node->left->level) jsG_freeproperty(J, node->left);
 	if (node->right->level) jsG_freeproperty(J, node->right);
-	js_free(J, node);
+	js_freecell(J, node, sizeof *node);
+}
+
+static void jsG_freeshape(js_State *J, js_Shape *shape)
+{
+	js_Shape *kid, *next;
+	for (kid = shape->kids; kid; kid = next) {
+		next = kid->sibling;
+		jsG_freeshape(J, kid);
+	}
+	jsG_shrink(J, sizeof *shape);
+	js_freecell(J, shape, sizeof *shape);
+}
+
+/* Unmarked shapes have no marked descendants, so drop whole subtrees */
+static void jsG_sweepshape(js_State *J, int mark, js_Shape *shape)
+{
+	js_Shape *kid, **prevkid = &shape->kids;
+	while ((kid = *prevkid) != NULL) {
+		if (kid->gcmark != mark) {
+			*prevkid = kid->sibling;
+			jsG_freeshape(J, kid);
+		} else {
+			jsG_sweepshape(J, mark, kid);
+			prevkid = &kid->sibling;
+		}
+	}
 }
 
 static void jsG_freeiterator(js_State *J, js_Iterator *node)
 {
 	while (node) {
 		js_Iterator *next = node->next;
-		js_free(J, node);
+		js_freecell(J, node, sizeof *node);
 		node = next;
 	}
 }
 
 static void jsG_freeobject(js_State *J, js_Object *obj)
 {
+	jsG_shrink(J, jsG_sizeofobject(obj));
 	if (obj->properties->level)
 		jsG_freeproperty(J, obj->properties);
+	js_free(J, obj->slots);
+	if (obj->type == JS_CARRAY)
+		js_free(J, obj->u.a.array);
 	if (obj->type == JS_CREGEXP) {
 		js_free(J, obj->u.r.source);
 		js_regfreex(J->alloc, J->actx, obj->u.r.prog);
@@ -48,31 +137,144 @@ static void jsG_freeobject(js_State *J, js_Object *obj)
 		obj->u.user.finalize(J, obj->u.user.data);
 	if (obj->type == JS_CCFUNCTION && obj->u.c.finalize)
 		obj->u.c.finalize(J, obj->u.c.data);
-	js_free(J, obj);
+	js_freecell(J, obj, sizeof *obj);
+}
+
+/*
+	The collector marks in three colors. White objects have not been seen
+	in this cycle, gray objects are marked but their contents have yet to
+	be scanned, and black objects are marked and scanned. Gray objects are
+	on the gcroot list. Functions, environments, strings, shapes and atoms
+	are marked and scanned at once, so they are only ever white or black.
+
+	With a work budget set, a cycle is split into steps that run between
+	the bytecode instructions: first the roots are marked, then each step
+	scans gray objects until the budget is used up. When no gray objects
+	remain, the roots are marked again and the scan finished in one go,
+	and the shape tree is swept. Then each step frees a budget's worth of
+	unmarked things from the allocation lists.
+
+	While marking, the program may store a white object where the scan has
+	already been. Write barriers keep a black object from pointing to a
+	white one: a black object that is stored into turns gray again, and
+	values stored in black environments or in the flat part of black
+	arrays, and shapes stored in property caches, are marked on the spot.
+	Objects that turn gray again wait on the gcagain list until the final
+	scan, so that an object that is often stored into is not scanned over
+	and over.
+
+	Things allocated while marking are white and must be reached like any
+	other. Things allocated while sweeping are marked, so that the rest of
+	the sweep leaves them alone.
+
+	With a nursery size set, the collector is generational. Marks are left
+	in place after a cycle, so everything that survived is black and old,
+	and everything allocated since is white and young. The write barriers
+	stay on between cycles: an old object that is stored into goes on the
+	gcagain list, which is the remembered set. A minor collection marks
+	from the roots and the remembered set, which stops at old things, and
+	sweeps only the young part at the head of each allocation list. What
+	survives it is marked and so becomes old. Atoms and shapes are left for
+	the full collections, which run once the old generation has grown by
+	JS_GCFACTOR.
+
+	The heap size is counted in bytes: each thing adds its size when it is
+	allocated or grows, and takes it off again when it is freed, so
+	gccounter is the size of the live and not yet collected things. The
+	thresholds, the nursery and the work budget are all in bytes too.
+	Iterator lists, string indexes and regular expression programs are
+	not counted. With a heap limit set, an allocation that would pass it
+	throws an out of memory error instead, and the collections run more
+	often as the heap gets close to the limit.
+*/
+
+#define JS_GCGRAY 4
+
+static int jsG_iswhite(js_Object *obj, int mark)
+{
+	return (obj->gcmark & ~JS_GCGRAY) != mark;
 }
 
 /* Mark and add object to scan queue */
 static void jsG_markobject(js_State *J, int mark, js_Object *obj)
 {
-	obj->gcmark = mark;
+	obj->gcmark = mark | JS_GCGRAY;
 	obj->gcroot = J->gcroot;
 	J->gcroot = obj;
 }
 
+static void jsG_markmemstring(int mark, js_String *s)
+{
+	while (s && s->gcmark != mark) {
+		s->gcmark = mark;
+		if (s->right)
+			jsG_markmemstring(mark, s->right);
+		s = s->left;
+	}
+}
+
+static void jsG_markshape(js_State *J, int mark, js_Shape *shape)
+{
+	while (shape && shape->gcmark != mark) {
+		shape->gcmark = mark;
+		if (shape->name)
+			jsS_markatom(shape->name, mark);
+		shape = shape->parent;
+	}
+}
+
+/* Mark a function and the functions nested in it, using a scan list of their own. */
 static void jsG_markfunction(js_State *J, int mark, js_Function *fun)
 {
+	js_Function *todo = fun;
 	int i;
 	fun->gcmark = mark;
-	for (i = 0; i < fun->funlen; ++i)
-		if (fun->funtab[i]->gcmark != mark)
-			jsG_markfunction(J, mark, fun->funtab[i]);
+	fun->gcroot = NULL;
+	while ((fun = todo) != NULL) {
+		todo = fun->gcroot;
+		jsS_markatom(fun->name, mark);
+		jsS_markatom(fun->filename, mark);
+		for (i = 0; i < fun->varlen; ++i)
+			jsS_markatom(fun->vartab[i], mark);
+		for (i = 0; i < fun->strlen; ++i)
+			jsS_markatom(fun->strtab[i], mark);
+		for (i = 0; i < fun->litlen; ++i)
+			jsG_markmemstring(mark, fun->littab[i]);
+		/* cached shapes must not be freed and reused for another layout */
+		for (i = 0; i < fun->cachelen * JS_PROPCACHE; ++i) {
+			jsG_markshape(J, mark, fun->cachetab[i].shape);
+			jsG_markshape(J, mark, fun->cachetab[i].holdershape);
+		}
+		for (i = 0; i < fun->funlen; ++i) {
+			if (fun->funtab[i]->gcmark != mark) {
+				fun->funtab[i]->gcmark = mark;
+				fun->funtab[i]->gcroot = todo;
+				todo = fun->funtab[i];
+			}
+		}
+	}
+}
+
+static void jsG_markvalues(js_State *J, int mark, js_Value *v, int n)
+{
+	while (n--) {
+		if (JSV_ISATOM(v))
+			jsS_markatom(JSV_LITSTR(v), mark);
+		if (JSV_TYPE(v) == JS_TMEMSTR)
+			jsG_markmemstring(mark, JSV_MEMSTR(v));
+		if (JSV_TYPE(v) == JS_TOBJECT && jsG_iswhite(JSV_OBJECT(v), mark))
+			jsG_markobject(J, mark, JSV_OBJECT(v));
+		++v;
+	}
 }
 
 static void jsG_markenvironment(js_State *J, int mark, js_Environment *env)
 {
 	do {
 		env->gcmark = mark;
-		if (env->variables->gcmark != mark)
+		if (!env->variables)
+			jsG_markvalues(J, mark, env->slots, env->count);
+		else if (jsG_iswhite(env->variables, mark))
 			jsG_markobject(J, mark, env->variables);
 		env = env->outer;
 	} while (env && env->gcmark != mark);
@@ -83,25 +285,46 @@ static void jsG_markproperty(js_State *J, int mark, js_Property *node)
 	if (node->left->level) jsG_markproperty(J, mark, node->left);
 	if (node->right->level) jsG_markproperty(J, mark, node->right);
 
-	if (node->value.type == JS_TMEMSTR && node->value.u.memstr->gcmark != mark)
-		node->value.u.memstr->gcmark = mark;
-	if (node->value.type == JS_TOBJECT && node->value.u.object->gcmark != mark)
-		jsG_markobject(J, mark, node->value.u.object);
-	if (node->getter && node->getter->gcmark != mark)
+	jsS_markatom(node->name, mark);
+	jsG_markvalues(J, mark, &node->value, 1);
+	if (node->getter && jsG_iswhite(node->getter, mark))
 		jsG_markobject(J, mark, node->getter);
-	if (node->setter && node->setter->gcmark != mark)
+	if (node->setter && jsG_iswhite(node->setter, mark))
 		jsG_markobject(J, mark, node->setter);
 }
 
+static void jsG_markiterator(js_State *J, int mark, js_Object *obj)
+{
+	js_Iterator *node;
+	for (node = obj->u.iter.head; node; node = node->next)
+		jsS_markatom(node->name, mark);
+	if (obj->u.iter.name)
+		jsS_markatom(obj->u.iter.name, mark);
+}
+
 /* Mark everything the object can reach. */
 static void jsG_scanobject(js_State *J, int mark, js_Object *obj)
 {
 	if (obj->properties->level)
 		jsG_markproperty(J, mark, obj->properties);
-	if (obj->prototype && obj->prototype->gcmark != mark)
+	if (obj->shape) {
+		jsG_markshape(J, mark, obj->shape);
+		jsG_markvalues(J, mark, obj->slots, obj->count);
+	}
+	if (obj->type == JS_CARRAY && obj->u.a.flat_length > 0)
+		jsG_markvalues(J, mark, obj->u.a.array, obj->u.a.flat_length);
+	if (obj->prototype && jsG_iswhite(obj->prototype, mark))
 		jsG_markobject(J, mark, obj->prototype);
-	if (obj->type == JS_CITERATOR && obj->u.iter.target->gcmark != mark) {
-		jsG_markobject(J, mark, obj->u.iter.target);
+	if (obj->type == JS_CITERATOR) {
+		if (jsG_iswhite(obj->u.iter.target, mark))
+			jsG_markobject(J, mark, obj->u.iter.target);
+		jsG_markiterator(J, mark, obj);
+	}
+	if (obj->type == JS_CSTRING) {
+		if (obj->u.s.memstr)
+			jsG_markmemstring(mark, obj->u.s.memstr);
+		else
+			jsS_markatom(obj->u.s.string, mark);
 	}
 	if (obj->type == JS_CFUNCTION || obj->type == JS_CSCRIPT) {
 		if (obj->u.f.scope && obj->u.f.scope->gcmark != mark)
@@ -111,142 +334,419 @@ static void jsG_scanobject(js_State *J, int mark, js_Object *obj)
 	}
 }
 
-static void jsG_markstack(js_State *J, int mark)
+static void jsG_markroot(js_State *J, int mark, js_Object *obj)
 {
-	js_Value *v = J->stack;
-	int n = J->top;
-	while (n--) {
-		if (v->type == JS_TMEMSTR && v->u.memstr->gcmark != mark)
-			v->u.memstr->gcmark = mark;
-		if (v->type == JS_TOBJECT && v->u.object->gcmark != mark)
-			jsG_markobject(J, mark, v->u.object);
-		++v;
-	}
+	if (jsG_iswhite(obj, mark))
+		jsG_markobject(J, mark, obj);
 }
 
-void js_gc(js_State *J, int report)
+static void jsG_markroots(js_State *J, int mark)
 {
-	js_Function *fun, *nextfun, **prevnextfun;
-	js_Object *obj, *nextobj, **prevnextobj;
-	js_String *str, *nextstr, **prevnextstr;
-	js_Environment *env, *nextenv, **prevnextenv;
-	unsigned int nenv = 0, nfun = 0, nobj = 0, nstr = 0, nprop = 0;
-	unsigned int genv = 0, gfun = 0, gobj = 0, gstr = 0, gprop = 0;
-	int mark;
 	int i;
 
-	if (J->gcpause) {
-		if (report)
-			js_report(J, "garbage collector is paused");
-		return;
-	}
+	jsG_markroot(J, mark, J->Object_prototype);
+	jsG_markroot(J, mark, J->Array_prototype);
+	jsG_markroot(J, mark, J->Function_prototype);
+	jsG_markroot(J, mark, J->Boolean_prototype);
+	jsG_markroot(J, mark, J->Number_prototype);
+	jsG_markroot(J, mark, J->String_prototype);
+	jsG_markroot(J, mark, J->RegExp_prototype);
+	jsG_markroot(J, mark, J->Date_prototype);
 
-	mark = J->gcmark = J->gcmark == 1 ? 2 : 1;
+	jsG_markroot(J, mark, J->Error_prototype);
+	jsG_markroot(J, mark, J->EvalError_prototype);
+	jsG_markroot(J, mark, J->RangeError_prototype);
+	jsG_markroot(J, mark, J->ReferenceError_prototype);
+	jsG_markroot(J, mark, J->SyntaxError_prototype);
+	jsG_markroot(J, mark, J->TypeError_prototype);
+	jsG_markroot(J, mark, J->URIError_prototype);
 
-	/* Add initial roots. */
+	jsG_markroot(J, mark, J->R);
+	jsG_markroot(J, mark, J->G);
 
-	jsG_markobject(J, mark, J->Object_prototype);
-	jsG_markobject(J, mark, J->Array_prototype);
-	jsG_markobject(J, mark, J->Function_prototype);
-	jsG_markobject(J, mark, J->Boolean_prototype);
-	jsG_markobject(J, mark, J->Number_prototype);
-	jsG_markobject(J, mark, J->String_prototype);
-	jsG_markobject(J, mark, J->RegExp_prototype);
-	jsG_markobject(J, mark, J->Date_prototype);
+	jsG_markvalues(J, mark, J->stack, J->top);
 
-	jsG_markobject(J, mark, J->Error_prototype);
-	jsG_markobject(J, mark, J->EvalError_prototype);
-	jsG_markobject(J, mark, J->RangeError_prototype);
-	jsG_markobject(J, mark, J->ReferenceError_prototype);
-	jsG_markobject(J, mark, J->SyntaxError_prototype);
-	jsG_markobject(J, mark, J->TypeError_prototype);
-	jsG_markobject(J, mark, J->URIError_prototype);
-
-	jsG_markobject(J, mark, J->R);
-	jsG_markobject(J, mark, J->G);
-
-	jsG_markstack(J, mark);
+	for (i = 0; i < JS_ATOM_COUNT; ++i)
+		jsS_markatom(J->atoms[i], mark);
+	/* the names in the call trace belong to functions on the stack, or are C strings */
 
 	jsG_markenvironment(J, mark, J->E);
 	jsG_markenvironment(J, mark, J->GE);
 	for (i = 0; i < J->envtop; ++i)
 		jsG_markenvironment(J, mark, J->envstack[i]);
+}
+
+/* Scan gray objects until none remain or the budget is used up. */
+static int jsG_propagate(js_State *J, int mark, int budget)
+{
+	js_Object *obj;
+	while (budget > 0 && (obj = J->gcroot) != NULL) {
+		J->gcroot = obj->gcroot;
+		js_prefetch(J->gcroot);
+		obj->gcroot = NULL;
+		obj->gcmark = mark;
+		jsG_scanobject(J, mark, obj);
+		budget -= jsG_sizeofobject(obj);
+	}
+	return budget;
+}
+
+/* Free unmarked things until all lists are swept or the budget is used up. */
+static int jsG_sweep(js_State *J, int mark, int budget)
+{
+	js_Environment *env;
+	js_Function *fun;
+	js_Object *obj;
+	js_String *str;
+
+	while (budget > 0 && (env = *J->gcsweepenv) != NULL) {
+		budget -= jsG_sizeofenvironment(env);
+		if (env->gcmark != mark) {
+			*J->gcsweepenv = env->gcnext;
+			jsG_freeenvironment(J, env);
+			++J->gcstats.genv;
+		} else {
+			J->gcsweepenv = &env->gcnext;
+		}
+		++J->gcstats.nenv;
+	}
+
+	while (budget > 0 && (fun = *J->gcsweepfun) != NULL) {
+		budget -= jsG_sizeoffunction(fun);
+		if (fun->gcmark != mark) {
+			*J->gcsweepfun = fun->gcnext;
+			jsG_freefunction(J, fun);
+			++J->gcstats.gfun;
+		} else {
+			J->gcsweepfun = &fun->gcnext;
+		}
+		++J->gcstats.nfun;
+	}
+
+	while (budget > 0 && (obj = *J->gcsweepobj) != NULL) {
+		js_prefetch(obj->gcnext);
+		budget -= jsG_sizeofobject(obj);
+		J->gcstats.nprop += obj->count;
+		if (obj->gcmark != mark) {
+			J->gcstats.gprop += obj->count;
+			*J->gcsweepobj = obj->gcnext;
+			jsG_freeobject(J, obj);
+			++J->gcstats.gobj;
+		} else {
+			J->gcsweepobj = &obj->gcnext;
+		}
+		++J->gcstats.nobj;
+	}
+
+	J->gcstats.gatom += jsS_sweepstrings(J, mark, &budget);
+
+	while (budget > 0 && (str = *J->gcsweepstr) != NULL) {
+		budget -= jsG_sizeofstring(str);
+		if (str->gcmark != mark) {
+			*J->gcsweepstr = str->gcnext;
+			jsG_freestring(J, str);
+			++J->gcstats.gstr;
+		} else {
+			J->gcsweepstr = &str->gcnext;
+		}
+		++J->gcstats.nstr;
+	}
+
+	return budget;
+}
 
-	/* Scan objects until none remain. */
+static int jsG_swept(js_State *J)
+{
+	return !*J->gcsweepenv && !*J->gcsweepfun && !*J->gcsweepobj &&
+		J->gcsweepatom >= J->strcap && !*J->gcsweepstr;
+}
 
+/* Empty the remembered set and the objects grayed by barriers since the last cycle. */
+static void jsG_forget(js_State *J)
+{
+	js_Object *obj;
 	while ((obj = J->gcroot) != NULL) {
 		J->gcroot = obj->gcroot;
 		obj->gcroot = NULL;
-		jsG_scanobject(J, mark, obj);
+		obj->gcmark &= ~JS_GCGRAY;
+	}
+	while ((obj = J->gcagain) != NULL) {
+		J->gcagain = obj->gcroot;
+		obj->gcroot = NULL;
+		obj->gcmark &= ~JS_GCGRAY;
+	}
+}
+
+/* Do up to budget units of collection work. Returns 1 when the cycle is done. */
+static int jsG_step(js_State *J, int budget)
+{
+	int mark;
+
+	if (J->gcstate == JS_GCIDLE) {
+		memset(&J->gcstats, 0, sizeof J->gcstats);
+		jsG_forget(J);
+		mark = J->gcmark = J->gcmark == 1 ? 2 : 1;
+		jsG_markroots(J, mark);
+		J->gcstate = JS_GCMARK;
+		J->gcbarrier = 1;
+	}
+
+	mark = J->gcmark;
+
+	if (J->gcstate == JS_GCMARK) {
+		budget = jsG_propagate(J, mark, budget);
+		if (J->gcroot)
+			return 0;
+
+		/* Catch up with the roots and stores and finish the scan in one go. */
+		J->gcroot = J->gcagain;
+		J->gcagain = NULL;
+		jsG_markroots(J, mark);
+		while (J->gcroot)
+			jsG_propagate(J, mark, INT_MAX);
+
+		jsG_sweepshape(J, mark, J->rootshape);
+
+		J->gcstate = JS_GCSWEEP;
+		J->gcbarrier = 0;
+		J->gcstats.natom = J->strcount;
+		J->gcsweepenv = &J->gcenv;
+		J->gcsweepfun = &J->gcfun;
+		J->gcsweepobj = &J->gcobj;
+		J->gcsweepstr = &J->gcstr;
+		J->gcsweepatom = 0;
+	}
+
+	jsG_sweep(J, mark, budget);
+	if (!jsG_swept(J))
+		return 0;
+
+	J->gcstate = JS_GCIDLE;
+	return 1;
+}
+
+/* Halfway between the heap size after the last collection and the heap limit */
+static size_t jsG_softlimit(js_State *J)
+{
+	if (J->gcold >= J->gclimit)
+		return J->gclimit;
+	return J->gcold + (J->gclimit - J->gcold) / 2;
+}
+
+/* Keep a threshold under the soft limit, so that collections run more often near the heap limit */
+static size_t jsG_underlimit(js_State *J, size_t thresh)
+{
+	size_t soft;
+	if (J->gclimit == 0)
+		return thresh;
+	soft = jsG_softlimit(J);
+	return thresh < soft ? thresh : soft;
+}
+
+/* Take back what the error handlers left of the reserve, after a full collection */
+static void jsG_endreserve(js_State *J)
+{
+	if (J->gclimit > J->gcheaplimit)
+		J->gclimit = J->gccounter > J->gcheaplimit ? J->gccounter : J->gcheaplimit;
+}
+
+/* An allocation would pass the heap limit: throw, and let the handler use the reserve. */
+void jsG_outofheap(js_State *J)
+{
+	/* collect before half of the reserve is gone, so there is room for the next error */
+	J->gcthresh = (J->gccounter < J->gcheaplimit ? J->gccounter : J->gcheaplimit) + JS_GCRESERVE / 2;
+	J->gclimit = J->gcheaplimit + JS_GCRESERVE;
+	js_outofmemory(J);
+}
+
+/* Set the next threshold from what is left after a full cycle. */
+static void jsG_endcycle(js_State *J)
+{
+	J->gcold = J->gccounter;
+	J->gcthresh = jsG_underlimit(J, J->gccounter * JS_GCFACTOR);
+	if (J->gcnursery > 0) {
+		/* everything left is old now */
+		J->gcoldenv = J->gcenv;
+		J->gcoldfun = J->gcfun;
+		J->gcoldobj = J->gcobj;
+		J->gcoldstr = J->gcstr;
+		J->gcmajor = J->gcthresh;
+		J->gcthresh = jsG_underlimit(J, J->gccounter + J->gcnursery);
+		J->gcbarrier = 1;
+	}
+}
+
+/* Finish the cycle in progress, if any. */
+void jsG_finish(js_State *J)
+{
+	if (J->gcstate != JS_GCIDLE) {
+		while (!jsG_step(J, INT_MAX))
+			;
+		jsG_endcycle(J);
 	}
+}
 
-	/* Free everything not marked. */
+/* Collect the young generation, see above. */
+static void jsG_minor(js_State *J)
+{
+	int mark = J->gcmark;
+	js_Environment *env, **prevenv;
+	js_Function *fun, **prevfun;
+	js_Object *obj, **prevobj;
+	js_String *str, **prevstr;
+
+	jsG_markroots(J, mark);
+	while (J->gcroot || J->gcagain) {
+		if (!J->gcroot) {
+			J->gcroot = J->gcagain;
+			J->gcagain = NULL;
+		}
+		jsG_propagate(J, mark, INT_MAX);
+	}
 
-	prevnextenv = &J->gcenv;
-	for (env = J->gcenv; env; env = nextenv) {
-		nextenv = env->gcnext;
+	prevenv = &J->gcenv;
+	while ((env = *prevenv) != J->gcoldenv) {
 		if (env->gcmark != mark) {
-			*prevnextenv = nextenv;
+			*prevenv = env->gcnext;
 			jsG_freeenvironment(J, env);
-			++genv;
 		} else {
-			prevnextenv = &env->gcnext;
+			prevenv = &env->gcnext;
 		}
-		++nenv;
 	}
 
-	prevnextfun = &J->gcfun;
-	for (fun = J->gcfun; fun; fun = nextfun) {
-		nextfun = fun->gcnext;
+	prevfun = &J->gcfun;
+	while ((fun = *prevfun) != J->gcoldfun) {
 		if (fun->gcmark != mark) {
-			*prevnextfun = nextfun;
+			*prevfun = fun->gcnext;
 			jsG_freefunction(J, fun);
-			++gfun;
 		} else {
-			prevnextfun = &fun->gcnext;
+			prevfun = &fun->gcnext;
 		}
-		++nfun;
 	}
 
-	prevnextobj = &J->gcobj;
-	for (obj = J->gcobj; obj; obj = nextobj) {
-		nprop += obj->count;
-		nextobj = obj->gcnext;
+	prevobj = &J->gcobj;
+	while ((obj = *prevobj) != J->gcoldobj) {
+		js_prefetch(obj->gcnext);
 		if (obj->gcmark != mark) {
-			gprop += obj->count;
-			*prevnextobj = nextobj;
+			*prevobj = obj->gcnext;
 			jsG_freeobject(J, obj);
-			++gobj;
 		} else {
-			prevnextobj = &obj->gcnext;
+			prevobj = &obj->gcnext;
 		}
-		++nobj;
 	}
 
-	prevnextstr = &J->gcstr;
-	for (str = J->gcstr; str; str = nextstr) {
-		nextstr = str->gcnext;
+	prevstr = &J->gcstr;
+	while ((str = *prevstr) != J->gcoldstr) {
 		if (str->gcmark != mark) {
-			*prevnextstr = nextstr;
-			js_free(J, str);
-			++gstr;
+			*prevstr = str->gcnext;
+			jsG_freestring(J, str);
 		} else {
-			prevnextstr = &str->gcnext;
+			prevstr = &str->gcnext;
 		}
-		++nstr;
 	}
 
-	unsigned int ntot = nenv + nfun + nobj + nstr + nprop;
-	unsigned int gtot = genv + gfun + gobj + gstr + gprop;
-	unsigned int remaining = ntot - gtot;
+	J->gcoldenv = J->gcenv;
+	J->gcoldfun = J->gcfun;
+	J->gcoldobj = J->gcobj;
+	J->gcoldstr = J->gcstr;
+
+	J->gcold = J->gccounter;
+	J->gcthresh = jsG_underlimit(J, J->gccounter + J->gcnursery);
+}
+
+/* Collect when the heap size passes the threshold. */
+void jsG_collect(js_State *J)
+{
+	if (J->gcpause)
+		return;
+	/* too close to the heap limit, or using the reserve, to leave any garbage for later */
+	if (J->gclimit > 0 && (J->gccounter >= jsG_softlimit(J) || J->gclimit > J->gcheaplimit)) {
+		js_gc(J, 0);
+		return;
+	}
+	if (J->gcnursery > 0 && J->gcstate == JS_GCIDLE && J->gcold < J->gcmajor) {
+		jsG_minor(J);
+		return;
+	}
+	if (J->gcbudget == 0) {
+		js_gc(J, 0);
+		return;
+	}
+	if (jsG_step(J, J->gcbudget))
+		jsG_endcycle(J);
+	else
+		J->gcthresh = jsG_underlimit(J, J->gccounter + J->gcbudget / JS_GCSTEPMUL);
+}
+
+/* Write barriers, see above. */
+
+void jsG_regray(js_State *J, js_Object *obj)
+{
+	obj->gcmark = J->gcmark | JS_GCGRAY;
+	obj->gcroot = J->gcagain;
+	J->gcagain = obj;
+}
+
+void jsG_markvalue(js_State *J, js_Value *v)
+{
+	jsG_markvalues(J, J->gcmark, v, 1);
+}
+
+void jsG_markcache(js_State *J, js_PropCache *cache)
+{
+	jsG_markshape(J, J->gcmark, cache->shape);
+	jsG_markshape(J, J->gcmark, cache->holdershape);
+}
+
+void js_setgcbudget(js_State *J, int budget)
+{
+	J->gcbudget = budget > 0 ? budget : 0;
+}
+
+void js_setgcnursery(js_State *J, int size)
+{
+	J->gcnursery = size > 0 ? size : 0;
+	/* stores into old objects have not been remembered, so start with a full collection */
+	J->gcmajor = 0;
+	if (J->gcstate == JS_GCIDLE)
+		J->gcbarrier = J->gcnursery > 0;
+}
+
+void js_setheaplimit(js_State *J, size_t limit)
+{
+	J->gclimit = J->gcheaplimit = limit;
+	J->gcthresh = jsG_underlimit(J, J->gcthresh);
+}
+
+void js_gc(js_State *J, int report)
+{
+	unsigned int ntot, gtot;
+
+	if (J->gcpause) {
+		if (report)
+			js_report(J, "garbage collector is paused");
+		return;
+	}
+
+	/* A cycle in progress may have missed garbage, so run another. */
+	jsG_finish(J);
+	while (!jsG_step(J, INT_MAX))
+		;
+
+	ntot = J->gcstats.nenv + J->gcstats.nfun + J->gcstats.nobj +
+		J->gcstats.nstr + J->gcstats.nprop + J->gcstats.natom;
+	gtot = J->gcstats.genv + J->gcstats.gfun + J->gcstats.gobj +
+		J->gcstats.gstr + J->gcstats.gprop + J->gcstats.gatom;
 
-	J->gccounter = remaining;
-	J->gcthresh = remaining * JS_GCFACTOR;
+	jsG_endreserve(J);
+	jsG_endcycle(J);
 
 	if (report) {
 		char buf[256];
-		snprintf(buf, sizeof buf, "garbage collected (%d%%): %d/%d envs, %d/%d funs, %d/%d objs, %d/%d props, %d/%d strs",
-			100*gtot/ntot, genv, nenv, gfun, nfun, gobj, nobj, gprop, nprop, gstr, nstr);
+		snprintf(buf, sizeof buf, "garbage collected (%d%%): %d/%d envs, %d/%d funs, %d/%d objs, %d/%d props, %d/%d strs, %d/%d atoms",
+			100*gtot/ntot, J->gcstats.genv, J->gcstats.nenv, J->gcstats.gfun, J->gcstats.nfun,
+			J->gcstats.gobj, J->gcstats.nobj, J->gcstats.gprop, J->gcstats.nprop,
+			J->gcstats.gstr, J->gcstats.nstr, J->gcstats.gatom, J->gcstats.natom);
 		js_report(J, buf);
 	}
 }
@@ -268,11 +768,18 @@ void js_freestate(js_State *J)
 	for (obj = J->gcobj; obj; obj = nextobj)
 		nextobj = obj->gcnext, jsG_freeobject(J, obj);
 	for (str = J->gcstr; str; str = nextstr)
-		nextstr = str->gcnext, js_free(J, str);
+		nextstr = str->gcnext, jsG_freestring(J, str);
+	if (J->rootshape)
+		jsG_freeshape(J, J->rootshape);
 
 	jsS_freestrings(J);
 
 	js_free(J, J->lexbuf.text);
+	jsR_freepool(J);
+	jsR_freestacks(J);
 	J->alloc(J->actx, J->stack, 0);
+	J->alloc(J->actx, J->envstack, 0);
+	J->alloc(J->actx, J->trace, 0);
+	J->alloc(J->actx, J->frames, 0);
 	J->alloc(J->actx, J, 0);
 }
@@ -20,6 +20,13 @@
 #endif
 #endif
 
+/* Hint that memory is about to be read */
+#ifdef __GNUC__
+#define js_prefetch(p) __builtin_prefetch(p)
+#else
+#define js_prefetch(p) ((void)0)
+#endif
+
 /* Microsoft Visual C */
 #ifdef _MSC_VER
 #pragma warning(disable:4996) /* _CRT_SECURE_NO_WARNINGS */
@@ -63,10 +70,16 @@ static __inline int signbit(double x) { __int64 i; memcpy(&i, &x, 8); return i>>
 void *js_malloc(js_State *J, int size);
 void *js_realloc(js_State *J, void *ptr, int size);
 void js_free(js_State *J, void *ptr);
+void *js_malloccell(js_State *J, int size);
+void js_freecell(js_State *J, void *ptr, int size);
+JS_NORETURN void js_outofmemory(js_State *J);
+JS_NORETURN void jsG_outofheap(js_State *J);
 
 typedef struct js_Regexp js_Regexp;
 typedef struct js_Value js_Value;
 typedef struct js_Object js_Object;
+typedef struct js_Shape js_Shape;
+typedef struct js_PropCache js_PropCache;
 typedef struct js_String js_String;
 typedef struct js_Ast js_Ast;
 typedef struct js_Function js_Function;
@@ -74,14 +87,31 @@ typedef struct js_Environment js_Environment;
 typedef struct js_StringNode js_StringNode;
 typedef struct js_Jumpbuf js_Jumpbuf;
 typedef struct js_StackTrace js_StackTrace;
+typedef struct js_Frame js_Frame;
 
 /* Limits */
 
+/*
+ * The value stack starts at JS_STACKSTART slots and doubles as it fills, up
+ * to JS_STACKSIZE, and is counted in the heap size. Strings returned by
+ * js_tostring may point into it, so the arrays it outgrows are only freed
+ * once the stack is empty. The environment, trace and frame stacks also
+ * start small and double as calls nest deeper, up to JS_ENVLIMIT.
+ */
 #ifndef JS_STACKSIZE
-#define JS_STACKSIZE 256	/* value stack size */
+#define JS_STACKSIZE 131072	/* max value stack size */
+#endif
+#ifndef JS_STACKSTART
+#define JS_STACKSTART 256	/* initial value stack size */
 #endif
 #ifndef JS_ENVLIMIT
-#define JS_ENVLIMIT 128		/* environment stack size */
+#define JS_ENVLIMIT 16384	/* max environment, trace and frame stack size */
+#endif
+#ifndef JS_ENVSTART
+#define JS_ENVSTART 64		/* initial environment, trace and frame stack size */
+#endif
+#ifndef JS_CALLLIMIT
+#define JS_CALLLIMIT 200	/* max calls through js_call nested on the C stack */
 #endif
 #ifndef JS_TRYLIMIT
 #define JS_TRYLIMIT 64		/* exception stack size */
@@ -89,20 +119,61 @@ typedef struct js_StackTrace js_StackTrace;
 #ifndef JS_GCFACTOR
 /*
  * GC will try to trigger when memory usage is this value times the minimum
- * needed memory. E.g. if there are 100 remaining objects after GC and this
- * value is 5.0, then the next GC will trigger when the overall number is 500.
+ * needed memory. E.g. if there are 100 KB remaining after GC and this
+ * value is 5.0, then the next GC will trigger when the heap reaches 500 KB.
  * I.e. a value of 5.0 aims at 80% garbage, 20% remain-used on each GC.
  * The bigger the value the less impact GC has on overall performance, but more
  * memory is used and individual GC pauses are longer (but fewer).
  */
 #define JS_GCFACTOR 5.0		/* memory overhead factor >= 1.0 */
 #endif
+#ifndef JS_GCSTEPMUL
+/*
+ * In incremental mode (see js_setgcbudget) the collector marks or sweeps this
+ * many bytes for every byte allocated, so that a cycle finishes well before
+ * the heap has grown by another JS_GCFACTOR.
+ */
+#define JS_GCSTEPMUL 2		/* incremental work per allocated byte */
+#endif
+#ifndef JS_GCRESERVE
+/*
+ * When an allocation would pass the heap limit (see js_setheaplimit), the
+ * limit is raised by this many bytes until the next full collection, so that
+ * the catch clause and the handler can still run.
+ */
+#define JS_GCRESERVE 65536	/* heap headroom after running out of heap */
+#endif
 #ifndef JS_ASTLIMIT
 #define JS_ASTLIMIT 100		/* max nested expressions */
 #endif
 #ifndef JS_STRLIMIT
 #define JS_STRLIMIT (1<<28)	/* max string length */
 #endif
+#ifndef JS_ARRAYLIMIT
+#define JS_ARRAYLIMIT (1<<26)	/* max length of dense array storage */
+#endif
+#ifndef JS_SHAPELIMIT
+#define JS_SHAPELIMIT 32	/* max properties of objects in shape mode */
+#endif
+#ifndef JS_PROPCACHE
+#define JS_PROPCACHE 4		/* entries per property access cache */
+#endif
+#ifndef JS_ROPEMIN
+#define JS_ROPEMIN 64		/* min length of concatenations kept as ropes */
+#endif
+#ifndef JS_ROPEDEPTH
+#define JS_ROPEDEPTH 32		/* max right side nesting of ropes */
+#endif
+#ifndef JS_UTFSTEP
+#define JS_UTFSTEP 64		/* characters between index entries of non-ASCII strings */
+#endif
+#ifndef JS_POOLMAX
+#define JS_POOLMAX 256		/* max size of pooled allocations, 0 to use the allocator for all */
+#endif
+
+/* define JS_NANBOX to pack values into 8 bytes on 64-bit little-endian targets (see jsvalue.h) */
+/* define JS_COMPUTEDGOTO to dispatch bytecode through a table of labels with GCC or Clang (see jsrun.c) */
+/* define JS_NOREGISTERS to keep lightweight functions on stack instructions only (see jsoptimize.c) */
 
 /* instruction size -- change to int if you get integer overflow syntax errors */
 
@@ -114,8 +185,40 @@ typedef unsigned short js_Instruction;
 
 /* String interning */
 
+/*
+	Interned strings are atoms, compared by pointer identity. Property names
+	are always atoms. Atoms are garbage collected, so anything that holds on
+	to one must mark it. The predefined atoms below are interned when the
+	state is created and always marked; the order must match the name table
+	in jsintern.c.
+*/
+
+enum {
+	JS_ATOM_length,
+	JS_ATOM_source,
+	JS_ATOM_global,
+	JS_ATOM_ignoreCase,
+	JS_ATOM_multiline,
+	JS_ATOM_lastIndex,
+	JS_ATOM_arguments,
+	JS_ATOM_prototype,
+	JS_ATOM_constructor,
+	JS_ATOM_callee,
+	JS_ATOM_COUNT
+};
+
+#define JS_ATOM(J, name) ((J)->atoms[JS_ATOM_##name])
+
 char *js_strdup(js_State *J, const char *s);
 const char *js_intern(js_State *J, const char *s);
+unsigned int jsS_hash(const char *s);
+unsigned int jsS_atomhash(const char *atom);
+const char *jsS_findatom(js_State *J, const char *s);
+void jsS_markatom(const char *atom, int mark);
+int jsS_sweepstrings(js_State *J, int mark, int *budget);
+void jsS_initatoms(js_State *J);
+void jsS_copystrings(js_State *K, js_State *J);
+const char *jsS_copiedatom(js_State *K, js_State *J, const char *atom);
 void jsS_dumpstrings(js_State *J);
 void jsS_freestrings(js_State *J);
 
@@ -133,6 +236,7 @@ void js_newarguments(js_State *J);
 void js_newfunction(js_State *J, js_Function *function, js_Environment *scope);
 void js_newscript(js_State *J, js_Function *function, js_Environment *scope);
 void js_loadeval(js_State *J, const char *filename, const char *source);
+int js_isbytecode(const char *buf, int size);
 
 js_Regexp *js_toregexp(js_State *J, int idx);
 int js_isarrayindex(js_State *J, const char *str, int *idx);
@@ -153,12 +257,25 @@ void js_dup1rot4(js_State *J);
 void js_RegExp_prototype_exec(js_State *J, js_Regexp *re, const char *text);
 
 void js_trap(js_State *J, int pc); /* dump stack and environment to stdout */
+int js_traceline(js_State *J, int n); /* current line of a stack trace entry */
 
 struct js_StackTrace
 {
 	const char *name;
 	const char *file;
-	int line;
+	int line; /* first line of the function, or 0 if native */
+	js_Function *function;
+	js_Instruction **pc; /* program counter of the running bytecode, or NULL */
+};
+
+/* Caller state of a function called from bytecode without recursing in C */
+
+struct js_Frame
+{
+	js_Function *function; /* the called function */
+	js_Instruction *pc; /* where the caller resumes */
+	int bot;
+	int strict;
 };
 
 /* Exception handling */
@@ -169,6 +286,8 @@ struct js_Jumpbuf
 	js_Environment *E;
 	int envtop;
 	int tracetop;
+	int frametop;
+	int calldepth;
 	int top, bot;
 	int strict;
 	js_Instruction *pc;
@@ -187,6 +306,17 @@ void js_putc(js_State *J, js_Buffer **sbp, int c);
 void js_puts(js_State *J, js_Buffer **sb, const char *s);
 void js_putm(js_State *J, js_Buffer **sb, const char *s, const char *e);
 
+/* Garbage collector phases */
+
+enum {
+	JS_GCIDLE, /* between cycles */
+	JS_GCMARK, /* marking, with write barriers active */
+	JS_GCSWEEP, /* freeing what was not marked */
+};
+
+/* Things allocated while sweeping must survive the sweep of their cycle */
+#define JS_NEWMARK(J) ((J)->gcstate == JS_GCSWEEP ? (J)->gcmark : 0)
+
 /* State struct */
 
 struct js_State
@@ -197,7 +327,14 @@ struct js_State
 	js_Report report;
 	js_Panic panic;
 
-	js_StringNode *strings;
+	js_StringNode **strings; /* interned strings, see jsintern.c */
+	int strcap, strcount;
+	const char *atoms[JS_ATOM_COUNT];
+
+	/* pool of small allocations, see jsrun.c */
+	void *poolfree[JS_POOLMAX / 8 + 1]; /* free cells of each size class */
+	char *poolnext, *poolend; /* unused part of the newest chunk */
+	void *poolchunk; /* list of chunks */
 
 	int default_strict;
 	int strict;
@@ -250,29 +387,84 @@ struct js_State
 	/* execution stack */
 	int top, bot;
 	js_Value *stack;
+	int stacksize;
+	js_Value *oldstack[32]; /* arrays the value stack has outgrown, one per doubling */
+	int oldstackcount, oldstackbytes;
 
 	/* garbage collector list */
 	int gcpause;
 	int gcmark;
-	unsigned int gccounter, gcthresh;
+	int gcstate; /* phase of the collection cycle, see jsgc.c */
+	int gcbudget; /* bytes to mark or sweep per incremental step, or 0 to stop the world */
+	int gcnursery; /* bytes allocated between minor collections, or 0 */
+	int gcbarrier; /* write barriers are active */
+	size_t gccounter, gcthresh; /* heap size in bytes, and the size that triggers a collection */
+	size_t gclimit; /* heap size that allocations may not pass, or 0 */
+	size_t gcheaplimit; /* the limit set by js_setheaplimit, gclimit is above it while in the reserve */
+	size_t gcold, gcmajor; /* heap size after the last collection, and size for a full collection */
 	js_Environment *gcenv;
 	js_Function *gcfun;
 	js_Object *gcobj;
 	js_String *gcstr;
+	js_Shape *rootshape; /* shape of objects without properties */
 
 	js_Object *gcroot; /* gc scan list */
+	js_Object *gcagain; /* objects to scan again at the end of marking */
+
+	/* first old thing in each list, the young ones come before it */
+	js_Environment *gcoldenv;
+	js_Function *gcoldfun;
+	js_Object *gcoldobj;
+	js_String *gcoldstr;
+
+	/* incremental sweep position in each list */
+	js_Environment **gcsweepenv;
+	js_Function **gcsweepfun;
+	js_Object **gcsweepobj;
+	js_String **gcsweepstr;
+	int gcsweepatom;
+
+	/* counts of the cycle in progress, for the js_gc report */
+	struct {
+		unsigned int nenv, nfun, nobj, nprop, nstr, natom;
+		unsigned int genv, gfun, gobj, gprop, gstr, gatom;
+	} gcstats;
+
+	/* size of the envstack, trace and frames arrays, see jsR_resizecalls */
+	int callcap;
 
 	/* environments on the call stack but currently not in scope */
 	int envtop;
-	js_Environment *envstack[JS_ENVLIMIT];
+	js_Environment **envstack;
 
 	/* debug info stack trace */
 	int tracetop;
-	js_StackTrace trace[JS_ENVLIMIT];
+	js_StackTrace *trace;
+
+	/* call frames of the bytecode functions in jsR_run */
+	int frametop;
+	js_Frame *frames;
+
+	/* calls through js_call that are nested on the C stack */
+	int calldepth;
 
 	/* exception stack */
 	int trytop;
 	js_Jumpbuf trybuf[JS_TRYLIMIT];
 };
 
+/* Count bytes of the heap before allocating them, see jsgc.c */
+static inline void jsG_grow(js_State *J, int size)
+{
+	if (J->gclimit > 0 && J->gccounter + size > J->gclimit)
+		jsG_outofheap(J);
+	J->gccounter += size;
+}
+
+/* Count bytes of the heap that have been freed */
+static inline void jsG_shrink(js_State *J, int size)
+{
+	J->gccounter -= size;
+}
+
 #endif
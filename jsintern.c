@@ -29,109 +29,249 @@ void js_putm(js_State *J, js_Buffer **sb, const char *s, const char *e)
 		js_putc(J, sb, *s++);
 }
 
-/* Use an AA-tree to quickly look up interned strings. */
+/*
+	Interned strings are kept in an open addressing hash table with linear
+	probing. Each string is stored after a header with its hash and length.
+
+	Interned strings are atoms: two atoms are equal if and only if their
+	pointers are equal, and property tables are ordered by the stored hash
+	so they never need to compare the bytes.
+
+	Atoms are collected by the garbage collector when nothing marks them.
+*/
 
 struct js_StringNode
 {
-	js_StringNode *left, *right;
-	int level;
+	unsigned int hash;
+	int length;
+	int gcmark;
 	char string[1];
 };
 
-static js_StringNode jsS_sentinel = { &jsS_sentinel, &jsS_sentinel, 0, ""};
+#define jsS_node(atom) ((js_StringNode*)((atom) - offsetof(js_StringNode, string)))
+
+/* FNV-1a */
+unsigned int jsS_hash(const char *s)
+{
+	unsigned int h = 2166136261u;
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+unsigned int jsS_atomhash(const char *atom)
+{
+	return jsS_node(atom)->hash;
+}
+
+static js_StringNode **jsS_find(js_State *J, const char *s, unsigned int hash, int n)
+{
+	unsigned int mask = J->strcap - 1;
+	unsigned int i = hash & mask;
+	js_StringNode *node;
+	while ((node = J->strings[i]) != NULL) {
+		if (node->string == s)
+			break;
+		if (node->hash == hash && node->length == n && !memcmp(node->string, s, n))
+			break;
+		i = (i + 1) & mask;
+	}
+	return &J->strings[i];
+}
+
+static void jsS_resize(js_State *J, int cap)
+{
+	js_StringNode **old = J->strings;
+	int oldcap = J->strcap;
+	int i;
+
+	J->strings = js_malloc(J, cap * (int)sizeof *J->strings);
+	memset(J->strings, 0, cap * sizeof *J->strings);
+	J->strcap = cap;
+
+	for (i = 0; i < oldcap; ++i) {
+		js_StringNode *node = old[i];
+		if (node) {
+			unsigned int k = node->hash & (cap - 1);
+			while (J->strings[k])
+				k = (k + 1) & (cap - 1);
+			J->strings[k] = node;
+		}
+	}
+
+	js_free(J, old);
+
+	/* the entries moved, so an incremental sweep has to start over */
+	J->gcsweepatom = 0;
+}
 
-static js_StringNode *jsS_newstringnode(js_State *J, const char *string, const char **result)
+const char *js_intern(js_State *J, const char *s)
 {
-	size_t n = strlen(string);
+	js_StringNode **slot, *node;
+	size_t n = strlen(s);
+	unsigned int hash;
+
 	if (n > JS_STRLIMIT)
 		js_rangeerror(J, "invalid string length");
-	js_StringNode *node = js_malloc(J, soffsetof(js_StringNode, string) + n + 1);
-	node->left = node->right = &jsS_sentinel;
-	node->level = 1;
-	memcpy(node->string, string, n + 1);
-	return *result = node->string, node;
+
+	/* keep the load factor between 1/8 and 3/4 */
+	if ((J->strcount + 1) * 4 > J->strcap * 3)
+		jsS_resize(J, J->strcap ? J->strcap * 2 : 256);
+	else if (J->strcap > 256 && J->strcount * 8 < J->strcap)
+		jsS_resize(J, J->strcap / 2);
+
+	hash = jsS_hash(s);
+	slot = jsS_find(J, s, hash, n);
+	if (*slot) {
+		/* revive an unmarked atom that the sweep has not reached yet */
+		if (J->gcstate == JS_GCSWEEP)
+			(*slot)->gcmark = J->gcmark;
+		return (*slot)->string;
+	}
+
+	jsG_grow(J, soffsetof(js_StringNode, string) + n + 1);
+	node = js_malloc(J, soffsetof(js_StringNode, string) + n + 1);
+	node->hash = hash;
+	node->length = n;
+	node->gcmark = JS_NEWMARK(J);
+	memcpy(node->string, s, n + 1);
+	*slot = node;
+	++J->strcount;
+	return node->string;
 }
 
-static js_StringNode *jsS_skew(js_StringNode *node)
+/* Find the atom for a string without interning it. */
+const char *jsS_findatom(js_State *J, const char *s)
 {
-	if (node->left->level == node->level) {
-		js_StringNode *temp = node;
-		node = node->left;
-		temp->left = node->right;
-		node->right = temp;
+	js_StringNode *node;
+	if (!J->strings)
+		return NULL;
+	node = *jsS_find(J, s, jsS_hash(s), strlen(s));
+	return node ? node->string : NULL;
+}
+
+void jsS_markatom(const char *atom, int mark)
+{
+	jsS_node(atom)->gcmark = mark;
+}
+
+/* Remove the atom at slot i, moving later entries of its probe sequence
+ * back so that no lookup has to step over a hole. */
+static void jsS_remove(js_State *J, unsigned int i)
+{
+	unsigned int mask = J->strcap - 1;
+	unsigned int k, home;
+	js_StringNode *node;
+
+	jsG_shrink(J, soffsetof(js_StringNode, string) + J->strings[i]->length + 1);
+	js_free(J, J->strings[i]);
+	J->strings[i] = NULL;
+	--J->strcount;
+
+	for (k = (i + 1) & mask; (node = J->strings[k]) != NULL; k = (k + 1) & mask) {
+		home = node->hash & mask;
+		/* leave it if its home is cyclically in (i, k] */
+		if (i <= k ? (i < home && home <= k) : (i < home || home <= k))
+			continue;
+		J->strings[i] = node;
+		J->strings[k] = NULL;
+		i = k;
 	}
-	return node;
 }
 
-static js_StringNode *jsS_split(js_StringNode *node)
+/* Free the atoms that are not marked, continuing from J->gcsweepatom and
+ * looking at about budget bytes of slots and atoms. Returns the number
+ * freed. The sweep is done when J->gcsweepatom reaches J->strcap. */
+int jsS_sweepstrings(js_State *J, int mark, int *budget)
 {
-	if (node->right->right->level == node->level) {
-		js_StringNode *temp = node;
-		node = node->right;
-		temp->right = node->left;
-		node->left = temp;
-		++node->level;
+	js_StringNode *node;
+	int n = 0;
+
+	while (*budget > 0 && J->gcsweepatom < J->strcap) {
+		node = J->strings[J->gcsweepatom];
+		*budget -= node ? soffsetof(js_StringNode, string) + node->length + 1 : (int)sizeof node;
+		if (node && node->gcmark != mark) {
+			/* look at the same slot again, an entry may have moved in */
+			jsS_remove(J, J->gcsweepatom);
+			++n;
+		} else {
+			++J->gcsweepatom;
+		}
 	}
-	return node;
-}
-
-static js_StringNode *jsS_insert(js_State *J, js_StringNode *node, const char *string, const char **result)
-{
-	if (node != &jsS_sentinel) {
-		int c = strcmp(string, node->string);
-		if (c < 0)
-			node->left = jsS_insert(J, node->left, string, result);
-		else if (c > 0)
-			node->right = jsS_insert(J, node->right, string, result);
-		else
-			return *result = node->string, node;
-		node = jsS_skew(node);
-		node = jsS_split(node);
-		return node;
+
+	return n;
+}
+
+/* Copy all the atoms of J into the empty table of K. They keep their
+ * places, so jsS_copiedatom can find the copy of an atom by pointer. */
+void jsS_copystrings(js_State *K, js_State *J)
+{
+	js_StringNode *node;
+	int i, n;
+
+	K->strings = js_malloc(K, J->strcap * (int)sizeof *K->strings);
+	memset(K->strings, 0, J->strcap * sizeof *K->strings);
+	K->strcap = J->strcap;
+
+	for (i = 0; i < J->strcap; ++i) {
+		if (J->strings[i]) {
+			n = soffsetof(js_StringNode, string) + J->strings[i]->length + 1;
+			node = js_malloc(K, n);
+			memcpy(node, J->strings[i], n);
+			node->gcmark = 0;
+			K->strings[i] = node;
+			++K->strcount;
+		}
 	}
-	return jsS_newstringnode(J, string, result);
 }
 
-static void dumpstringnode(js_StringNode *node, int level)
+const char *jsS_copiedatom(js_State *K, js_State *J, const char *atom)
 {
-	int i;
-	if (node->left != &jsS_sentinel)
-		dumpstringnode(node->left, level + 1);
-	printf("%d: ", node->level);
-	for (i = 0; i < level; ++i)
-		putchar('\t');
-	printf("'%s'\n", node->string);
-	if (node->right != &jsS_sentinel)
-		dumpstringnode(node->right, level + 1);
+	unsigned int mask = J->strcap - 1;
+	unsigned int i = jsS_node(atom)->hash & mask;
+	while (J->strings[i]->string != atom)
+		i = (i + 1) & mask;
+	return K->strings[i]->string;
 }
 
 void jsS_dumpstrings(js_State *J)
 {
-	js_StringNode *root = J->strings;
+	int i;
 	printf("interned strings {\n");
-	if (root && root != &jsS_sentinel)
-		dumpstringnode(root, 1);
+	for (i = 0; i < J->strcap; ++i)
+		if (J->strings[i])
+			printf("\t%08x '%s'\n", J->strings[i]->hash, J->strings[i]->string);
 	printf("}\n");
 }
 
-static void jsS_freestringnode(js_State *J, js_StringNode *node)
-{
-	if (node->left != &jsS_sentinel) jsS_freestringnode(J, node->left);
-	if (node->right != &jsS_sentinel) jsS_freestringnode(J, node->right);
-	js_free(J, node);
-}
-
 void jsS_freestrings(js_State *J)
 {
-	if (J->strings && J->strings != &jsS_sentinel)
-		jsS_freestringnode(J, J->strings);
+	int i;
+	for (i = 0; i < J->strcap; ++i)
+		js_free(J, J->strings[i]);
+	js_free(J, J->strings);
+	J->strings = NULL;
+	J->strcap = J->strcount = 0;
 }
 
-const char *js_intern(js_State *J, const char *s)
+/* Predefined atoms for the names the runtime checks for by identity. */
+
+static const char *jsS_atomnames[JS_ATOM_COUNT] = {
+	"length",
+	"source",
+	"global",
+	"ignoreCase",
+	"multiline",
+	"lastIndex",
+	"arguments",
+	"prototype",
+	"constructor",
+	"callee",
+};
+
+void jsS_initatoms(js_State *J)
 {
-	const char *result;
-	if (!J->strings)
-		J->strings = &jsS_sentinel;
-	J->strings = jsS_insert(J, J->strings, s, &result);
-	return result;
+	int i;
+	for (i = 0; i < JS_ATOM_COUNT; ++i)
+		J->atoms[i] = js_intern(J, jsS_atomnames[i]);
 }
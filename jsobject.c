@@ -58,12 +58,33 @@ static void Op_valueOf(js_State *J)
 	js_copy(J, 0);
 }
 
+/* Elements in dense array storage are writable, enumerable and configurable */
+static int O_isdenseindex(js_State *J, js_Object *obj, const char *name)
+{
+	int k;
+	if (obj->type == JS_CARRAY && obj->u.a.flat_length > 0)
+		return js_isarrayindex(J, name, &k) && k < obj->u.a.flat_length;
+	return 0;
+}
+
+/* Attributes of an own property, or -1 if there is no such property */
+static int O_getownatts(js_State *J, js_Object *obj, const char *name)
+{
+	js_Property *ref;
+	js_Shape *shape;
+	if (obj->shape) {
+		shape = jsV_getownshape(obj, name);
+		return shape ? shape->atts : -1;
+	}
+	ref = jsV_getownproperty(J, obj, name);
+	return ref ? ref->atts : -1;
+}
+
 static void Op_hasOwnProperty(js_State *J)
 {
 	js_Object *self = js_toobject(J, 0);
-	const char *name = js_tostring(J, 1);
-	js_Property *ref = jsV_getownproperty(J, self, name);
-	js_pushboolean(J, ref != NULL);
+	const char *name = js_intern(J, js_tostring(J, 1));
+	js_pushboolean(J, O_getownatts(J, self, name) >= 0 || O_isdenseindex(J, self, name));
 }
 
 static void Op_isPrototypeOf(js_State *J)
@@ -85,9 +106,9 @@ static void Op_isPrototypeOf(js_State *J)
 static void Op_propertyIsEnumerable(js_State *J)
 {
 	js_Object *self = js_toobject(J, 0);
-	const char *name = js_tostring(J, 1);
-	js_Property *ref = jsV_getownproperty(J, self, name);
-	js_pushboolean(J, ref && !(ref->atts & JS_DONTENUM));
+	const char *name = js_intern(J, js_tostring(J, 1));
+	int atts = O_getownatts(J, self, name);
+	js_pushboolean(J, (atts >= 0 && !(atts & JS_DONTENUM)) || O_isdenseindex(J, self, name));
 }
 
 static void O_getPrototypeOf(js_State *J)
@@ -104,13 +125,38 @@ static void O_getPrototypeOf(js_State *J)
 
 static void O_getOwnPropertyDescriptor(js_State *J)
 {
-	js_Object *obj;
+	js_Object *obj, *holder;
 	js_Property *ref;
+	js_Shape *shape;
+	const char *name;
 	if (!js_isobject(J, 1))
 		js_typeerror(J, "not an object");
 	obj = js_toobject(J, 1);
-	ref = jsV_getproperty(J, obj, js_tostring(J, 2));
-	if (!ref)
+	name = js_intern(J, js_tostring(J, 2));
+	if (O_isdenseindex(J, obj, name)) {
+		js_newobject(J);
+		js_getproperty(J, 1, name);
+		js_setproperty(J, -2, "value");
+		js_pushboolean(J, 1);
+		js_setproperty(J, -2, "writable");
+		js_pushboolean(J, 1);
+		js_setproperty(J, -2, "enumerable");
+		js_pushboolean(J, 1);
+		js_setproperty(J, -2, "configurable");
+		return;
+	}
+	holder = jsV_getproperty(J, obj, name, &ref, &shape);
+	if (shape) {
+		js_newobject(J);
+		js_pushvalue(J, holder->slots[shape->slot]);
+		js_setproperty(J, -2, "value");
+		js_pushboolean(J, !(shape->atts & JS_READONLY));
+		js_setproperty(J, -2, "writable");
+		js_pushboolean(J, !(shape->atts & JS_DONTENUM));
+		js_setproperty(J, -2, "enumerable");
+		js_pushboolean(J, !(shape->atts & JS_DONTCONF));
+		js_setproperty(J, -2, "configurable");
+	} else if (!ref)
 		js_pushundefined(J);
 	else {
 		js_newobject(J);
@@ -138,48 +184,14 @@ static void O_getOwnPropertyDescriptor(js_State *J)
 	}
 }
 
-static int O_getOwnPropertyNames_walk(js_State *J, js_Property *ref, int i)
-{
-	if (ref->left->level)
-		i = O_getOwnPropertyNames_walk(J, ref->left, i);
-	js_pushliteral(J, ref->name);
-	js_setindex(J, -2, i++);
-	if (ref->right->level)
-		i = O_getOwnPropertyNames_walk(J, ref->right, i);
-	return i;
-}
-
-static void O_getOwnPropertyNames(js_State *J)
+/* Names of the built-in properties that are not stored as properties */
+static int O_pushspecialnames(js_State *J, js_Object *obj, int i)
 {
-	js_Object *obj;
-	int k;
-	int i;
-
-	if (!js_isobject(J, 1))
-		js_typeerror(J, "not an object");
-	obj = js_toobject(J, 1);
-
-	js_newarray(J);
-
-	if (obj->properties->level)
-		i = O_getOwnPropertyNames_walk(J, obj->properties, 0);
-	else
-		i = 0;
-
-	if (obj->type == JS_CARRAY) {
+	if (obj->type == JS_CARRAY || obj->type == JS_CSTRING) {
 		js_pushliteral(J, "length");
 		js_setindex(J, -2, i++);
 	}
 
-	if (obj->type == JS_CSTRING) {
-		js_pushliteral(J, "length");
-		js_setindex(J, -2, i++);
-		for (k = 0; k < obj->u.s.length; ++k) {
-			js_pushnumber(J, k);
-			js_setindex(J, -2, i++);
-		}
-	}
-
 	if (obj->type == JS_CREGEXP) {
 		js_pushliteral(J, "source");
 		js_setindex(J, -2, i++);
@@ -192,6 +204,34 @@ static void O_getOwnPropertyNames(js_State *J)
 		js_pushliteral(J, "lastIndex");
 		js_setindex(J, -2, i++);
 	}
+	return i;
+}
+
+static void O_getOwnPropertyNames(js_State *J)
+{
+	js_Object *obj, *it;
+	const char *name;
+	int special = 0;
+	int i = 0, k;
+
+	if (!js_isobject(J, 1))
+		js_typeerror(J, "not an object");
+	obj = js_toobject(J, 1);
+
+	js_newarray(J);
+
+	/* the built-in names go after the array indices, like in for-in order */
+	it = jsV_newowniterator(J, obj, 1);
+	while ((name = jsV_nextiterator(J, it))) {
+		if (!special && !js_isarrayindex(J, name, &k)) {
+			i = O_pushspecialnames(J, obj, i);
+			special = 1;
+		}
+		js_pushatom(J, name);
+		js_setindex(J, -2, i++);
+	}
+	if (!special)
+		O_pushspecialnames(J, obj, i);
 }
 
 static void ToPropertyDescriptor(js_State *J, js_Object *obj, const char *name, js_Object *desc)
@@ -255,51 +295,29 @@ static void O_defineProperty(js_State *J)
 	js_copy(J, 1);
 }
 
-static void O_defineProperties_walk(js_State *J, js_Property *ref)
-{
-	if (ref->left->level)
-		O_defineProperties_walk(J, ref->left);
-	if (!(ref->atts & JS_DONTENUM)) {
-		js_pushvalue(J, ref->value);
-		ToPropertyDescriptor(J, js_toobject(J, 1), ref->name, js_toobject(J, -1));
-		js_pop(J, 1);
-	}
-	if (ref->right->level)
-		O_defineProperties_walk(J, ref->right);
-}
-
 static void O_defineProperties(js_State *J)
 {
-	js_Object *props;
+	const char *name;
 
 	if (!js_isobject(J, 1)) js_typeerror(J, "not an object");
 	if (!js_isobject(J, 2)) js_typeerror(J, "not an object");
 
-	props = js_toobject(J, 2);
-	if (props->properties->level)
-		O_defineProperties_walk(J, props->properties);
+	js_pushobject(J, jsV_newowniterator(J, js_toobject(J, 2), 0));
+	while ((name = jsV_nextiterator(J, js_toobject(J, -1)))) {
+		js_getproperty(J, 2, name);
+		ToPropertyDescriptor(J, js_toobject(J, 1), name, js_toobject(J, -1));
+		js_pop(J, 1);
+	}
+	js_pop(J, 1);
 
 	js_copy(J, 1);
 }
 
-static void O_create_walk(js_State *J, js_Object *obj, js_Property *ref)
-{
-	if (ref->left->level)
-		O_create_walk(J, obj, ref->left);
-	if (!(ref->atts & JS_DONTENUM)) {
-		if (ref->value.type != JS_TOBJECT)
-			js_typeerror(J, "not an object");
-		ToPropertyDescriptor(J, obj, ref->name, ref->value.u.object);
-	}
-	if (ref->right->level)
-		O_create_walk(J, obj, ref->right);
-}
-
 static void O_create(js_State *J)
 {
 	js_Object *obj;
 	js_Object *proto;
-	js_Object *props;
+	const char *name;
 
 	if (js_isobject(J, 1))
 		proto = js_toobject(J, 1);
@@ -314,29 +332,23 @@ static void O_create(js_State *J)
 	if (js_isdefined(J, 2)) {
 		if (!js_isobject(J, 2))
 			js_typeerror(J, "not an object");
-		props = js_toobject(J, 2);
-		if (props->properties->level)
-			O_create_walk(J, obj, props->properties);
-	}
-}
-
-static int O_keys_walk(js_State *J, js_Property *ref, int i)
-{
-	if (ref->left->level)
-		i = O_keys_walk(J, ref->left, i);
-	if (!(ref->atts & JS_DONTENUM)) {
-		js_pushliteral(J, ref->name);
-		js_setindex(J, -2, i++);
+		js_pushobject(J, jsV_newowniterator(J, js_toobject(J, 2), 0));
+		while ((name = jsV_nextiterator(J, js_toobject(J, -1)))) {
+			js_getproperty(J, 2, name);
+			if (!js_isobject(J, -1))
+				js_typeerror(J, "not an object");
+			ToPropertyDescriptor(J, obj, name, js_toobject(J, -1));
+			js_pop(J, 1);
+		}
+		js_pop(J, 1);
 	}
-	if (ref->right->level)
-		i = O_keys_walk(J, ref->right, i);
-	return i;
 }
 
 static void O_keys(js_State *J)
 {
-	js_Object *obj;
-	int i, k;
+	js_Object *obj, *it;
+	const char *name;
+	int i = 0;
 
 	if (!js_isobject(J, 1))
 		js_typeerror(J, "not an object");
@@ -344,16 +356,10 @@ static void O_keys(js_State *J)
 
 	js_newarray(J);
 
-	if (obj->properties->level)
-		i = O_keys_walk(J, obj->properties, 0);
-	else
-		i = 0;
-
-	if (obj->type == JS_CSTRING) {
-		for (k = 0; k < obj->u.s.length; ++k) {
-			js_pushnumber(J, k);
-			js_setindex(J, -2, i++);
-		}
+	it = jsV_newowniterator(J, obj, 0);
+	while ((name = jsV_nextiterator(J, it))) {
+		js_pushatom(J, name);
+		js_setindex(J, -2, i++);
 	}
 }
 
@@ -391,6 +397,12 @@ static void O_seal(js_State *J)
 	obj = js_toobject(J, 1);
 	obj->extensible = 0;
 
+	if (obj->type == JS_CARRAY) {
+		jsV_unflattenarray(J, obj, 0);
+		obj->u.a.dense = 0;
+	}
+	jsV_todictionary(J, obj);
+
 	if (obj->properties->level)
 		O_seal_walk(J, obj->properties);
 
@@ -410,6 +422,14 @@ static int O_isSealed_walk(js_State *J, js_Property *ref)
 	return 1;
 }
 
+static int O_isSealed_shape(js_Shape *shape, int atts)
+{
+	for (; shape->parent; shape = shape->parent)
+		if ((shape->atts & atts) != atts)
+			return 0;
+	return 1;
+}
+
 static void O_isSealed(js_State *J)
 {
 	js_Object *obj;
@@ -418,11 +438,16 @@ static void O_isSealed(js_State *J)
 		js_typeerror(J, "not an object");
 
 	obj = js_toobject(J, 1);
-	if (obj->extensible) {
+	if (obj->extensible || (obj->type == JS_CARRAY && obj->u.a.flat_length > 0)) {
 		js_pushboolean(J, 0);
 		return;
 	}
 
+	if (obj->shape) {
+		js_pushboolean(J, O_isSealed_shape(obj->shape, JS_DONTCONF));
+		return;
+	}
+
 	if (obj->properties->level)
 		js_pushboolean(J, O_isSealed_walk(J, obj->properties));
 	else
@@ -448,6 +473,12 @@ static void O_freeze(js_State *J)
 	obj = js_toobject(J, 1);
 	obj->extensible = 0;
 
+	if (obj->type == JS_CARRAY) {
+		jsV_unflattenarray(J, obj, 0);
+		obj->u.a.dense = 0;
+	}
+	jsV_todictionary(J, obj);
+
 	if (obj->properties->level)
 		O_freeze_walk(J, obj->properties);
 
@@ -478,6 +509,16 @@ static void O_isFrozen(js_State *J)
 
 	obj = js_toobject(J, 1);
 
+	if (obj->type == JS_CARRAY && obj->u.a.flat_length > 0) {
+		js_pushboolean(J, 0);
+		return;
+	}
+
+	if (obj->shape && !O_isSealed_shape(obj->shape, JS_READONLY | JS_DONTCONF)) {
+		js_pushboolean(J, 0);
+		return;
+	}
+
 	if (obj->properties->level) {
 		if (!O_isFrozen_walk(J, obj->properties)) {
 			js_pushboolean(J, 0);
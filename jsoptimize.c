@@ -0,0 +1,453 @@
+#include "jsi.h"
+#include "jscompile.h"
+
+/*
+	Peephole optimizer, run over the code of each function after it has
+	been compiled. It threads jumps to jumps, removes unreachable code and
+	jumps to the next instruction, and fuses common instruction sequences
+	into superinstructions.
+
+	Instructions that are jump targets are never fused into the instruction
+	before them. The code is rewritten into a shorter copy, then the jump
+	addresses and the line table are moved to the new offsets.
+*/
+
+#define NPTR (int)(sizeof(void*) / sizeof(js_Instruction))
+#define NNUM (int)(sizeof(double) / sizeof(js_Instruction))
+
+/* Number of js_Instruction words used by an instruction and its operands */
+int jsC_oplength(int op)
+{
+	switch (op) {
+	case OP_INTEGER:
+	case OP_CLOSURE:
+	case OP_GETLOCAL:
+	case OP_SETLOCAL:
+	case OP_DELLOCAL:
+	case OP_CALL:
+	case OP_TAILCALL:
+	case OP_NEW:
+	case OP_JCASE:
+	case OP_TRY:
+	case OP_JUMP:
+	case OP_JTRUE:
+	case OP_JFALSE:
+	case OP_INCLOCAL:
+	case OP_DECLOCAL:
+	case OP_ADDINTEGER:
+	case OP_LTJFALSE:
+	case OP_GTJFALSE:
+	case OP_LEJFALSE:
+	case OP_GEJFALSE:
+	case OP_EQJFALSE:
+	case OP_NEJFALSE:
+	case OP_STRICTEQJFALSE:
+	case OP_STRICTNEJFALSE:
+		return 2;
+	case OP_NUMBER:
+		return 1 + NNUM;
+	case OP_STRING:
+	case OP_MEMSTRING:
+	case OP_HASVAR:
+	case OP_GETVAR:
+	case OP_SETVAR:
+	case OP_DELVAR:
+	case OP_DELPROP_S:
+	case OP_CATCH:
+		return 1 + NPTR;
+	case OP_NEWREGEXP:
+	case OP_GETPROP_S:
+	case OP_SETPROP_S:
+		return 2 + NPTR;
+	case OP_GETLOCALPROP:
+		return 3 + NPTR;
+	case OP_GETUPVAL:
+	case OP_SETUPVAL:
+	case OP_MOVELOCAL:
+		return 3;
+	case OP_BINARYLOCAL:
+		return 4;
+	case OP_BINARYTOLOCAL:
+	case OP_CMPLOCALJFALSE:
+	case OP_CMPINTEGERJFALSE:
+		return 5;
+	case OP_GETPROPTOLOCAL:
+	case OP_SETPROPFROMLOCAL:
+		return 4 + NPTR;
+	default:
+		return 1;
+	}
+}
+
+/* Position of the address operand of an instruction, or 0 if it has none */
+int jsC_jumpoperand(int op)
+{
+	switch (op) {
+	case OP_JCASE:
+	case OP_TRY:
+	case OP_JUMP:
+	case OP_JTRUE:
+	case OP_JFALSE:
+	case OP_LTJFALSE:
+	case OP_GTJFALSE:
+	case OP_LEJFALSE:
+	case OP_GEJFALSE:
+	case OP_EQJFALSE:
+	case OP_NEJFALSE:
+	case OP_STRICTEQJFALSE:
+	case OP_STRICTNEJFALSE:
+		return 1;
+	case OP_CMPLOCALJFALSE:
+	case OP_CMPINTEGERJFALSE:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/* Position of the string or number operand of an instruction, or 0 if it has none */
+int jsC_constoperand(int op)
+{
+	switch (op) {
+	case OP_NUMBER:
+	case OP_STRING:
+	case OP_MEMSTRING:
+	case OP_HASVAR:
+	case OP_GETVAR:
+	case OP_SETVAR:
+	case OP_DELVAR:
+	case OP_DELPROP_S:
+	case OP_CATCH:
+	case OP_NEWREGEXP:
+	case OP_GETPROP_S:
+	case OP_SETPROP_S:
+		return 1;
+	case OP_GETLOCALPROP:
+		return 2;
+	case OP_GETPROPTOLOCAL:
+	case OP_SETPROPFROMLOCAL:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+/* Comparisons that can be fused with a following OP_JFALSE */
+static int cmpjfalse(int op)
+{
+	switch (op) {
+	case OP_LT: return OP_LTJFALSE;
+	case OP_GT: return OP_GTJFALSE;
+	case OP_LE: return OP_LEJFALSE;
+	case OP_GE: return OP_GEJFALSE;
+	case OP_EQ: return OP_EQJFALSE;
+	case OP_NE: return OP_NEJFALSE;
+	case OP_STRICTEQ: return OP_STRICTEQJFALSE;
+	case OP_STRICTNE: return OP_STRICTNEJFALSE;
+	default: return -1;
+	}
+}
+
+static void threadjumps(js_Instruction *code, int len)
+{
+	int pc, n, dest;
+	for (pc = 0; pc < len; pc += jsC_oplength(code[pc])) {
+		if (code[pc] == OP_JUMP || code[pc] == OP_JTRUE || code[pc] == OP_JFALSE || code[pc] == OP_JCASE) {
+			dest = code[pc+1];
+			for (n = 0; n < 8 && dest < len && code[dest] == OP_JUMP && code[dest+1] != dest; ++n)
+				dest = code[dest+1];
+			code[pc+1] = dest;
+		}
+	}
+}
+
+/* Check that the instructions of a sequence after the first are not jump targets */
+static int straight(const char *target, const js_Instruction *code, int pc, int len, int n)
+{
+	while (--n > 0) {
+		pc += jsC_oplength(code[pc]);
+		if (pc >= len || target[pc])
+			return 0;
+	}
+	return 1;
+}
+
+#ifndef JS_NOREGISTERS
+/* Binary operators with a register form */
+static int isbinary(int op)
+{
+	switch (op) {
+	case OP_ADD:
+	case OP_SUB:
+	case OP_MUL:
+	case OP_DIV:
+	case OP_MOD:
+	case OP_SHL:
+	case OP_SHR:
+	case OP_USHR:
+	case OP_BITAND:
+	case OP_BITXOR:
+	case OP_BITOR:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+	Register instructions of lightweight functions name their operands and
+	results by local variable slot instead of moving them through the stack.
+	Returns the length of the fused code, or 0 if no register form applies.
+*/
+static int fuseregisters(const char *target, const js_Instruction *code, int pc, int len, js_Instruction *out, int *np)
+{
+	const js_Instruction *p = code + pc;
+	int n = *np;
+
+	if (p[0] != OP_GETLOCAL)
+		return 0;
+
+	/* GETLOCAL a; GETLOCAL b; ADD; SETLOCAL d; POP -> BINARYTOLOCAL ADD d a b */
+	if (straight(target, code, pc, len, 5) && p[2] == OP_GETLOCAL && isbinary(p[4]) &&
+			p[5] == OP_SETLOCAL && p[7] == OP_POP) {
+		out[n++] = OP_BINARYTOLOCAL;
+		out[n++] = p[4];
+		out[n++] = p[6];
+		out[n++] = p[1];
+		out[n++] = p[3];
+		*np = n;
+		return 8;
+	}
+
+	/* GETLOCAL a; GETLOCAL b; LT; JFALSE addr -> CMPLOCALJFALSE LT a b addr */
+	if (straight(target, code, pc, len, 4) && p[2] == OP_GETLOCAL && cmpjfalse(p[4]) >= 0 &&
+			p[5] == OP_JFALSE) {
+		out[n++] = OP_CMPLOCALJFALSE;
+		out[n++] = p[4];
+		out[n++] = p[1];
+		out[n++] = p[3];
+		out[n++] = p[6];
+		*np = n;
+		return 7;
+	}
+
+	/* GETLOCAL a; INTEGER k; LT; JFALSE addr -> CMPINTEGERJFALSE LT a k addr */
+	if (straight(target, code, pc, len, 4) && p[2] == OP_INTEGER && cmpjfalse(p[4]) >= 0 &&
+			p[5] == OP_JFALSE) {
+		out[n++] = OP_CMPINTEGERJFALSE;
+		out[n++] = p[4];
+		out[n++] = p[1];
+		out[n++] = p[3];
+		out[n++] = p[6];
+		*np = n;
+		return 7;
+	}
+
+	/* GETLOCAL a; GETLOCAL b; ADD -> BINARYLOCAL ADD a b */
+	if (straight(target, code, pc, len, 3) && p[2] == OP_GETLOCAL && isbinary(p[4])) {
+		out[n++] = OP_BINARYLOCAL;
+		out[n++] = p[4];
+		out[n++] = p[1];
+		out[n++] = p[3];
+		*np = n;
+		return 5;
+	}
+
+	/* GETLOCAL a; GETPROP_S name; SETLOCAL d; POP -> GETPROPTOLOCAL d a name */
+	if (straight(target, code, pc, len, 4) && p[2] == OP_GETPROP_S &&
+			p[3+NPTR+1] == OP_SETLOCAL && p[3+NPTR+3] == OP_POP) {
+		out[n++] = OP_GETPROPTOLOCAL;
+		out[n++] = p[3+NPTR+2];
+		out[n++] = p[1];
+		memcpy(out + n, p + 3, (NPTR + 1) * sizeof *out);
+		*np = n + NPTR + 1;
+		return 2 + jsC_oplength(OP_GETPROP_S) + 3;
+	}
+
+	/* GETLOCAL a; GETLOCAL b; SETPROP_S name; POP -> SETPROPFROMLOCAL a b name */
+	if (straight(target, code, pc, len, 4) && p[2] == OP_GETLOCAL && p[4] == OP_SETPROP_S &&
+			p[5+NPTR+1] == OP_POP) {
+		out[n++] = OP_SETPROPFROMLOCAL;
+		out[n++] = p[1];
+		out[n++] = p[3];
+		memcpy(out + n, p + 5, (NPTR + 1) * sizeof *out);
+		*np = n + NPTR + 1;
+		return 4 + jsC_oplength(OP_SETPROP_S) + 1;
+	}
+
+	/* GETLOCAL a; SETLOCAL d; POP -> MOVELOCAL d a */
+	if (straight(target, code, pc, len, 3) && p[2] == OP_SETLOCAL && p[4] == OP_POP) {
+		out[n++] = OP_MOVELOCAL;
+		out[n++] = p[3];
+		out[n++] = p[1];
+		*np = n;
+		return 5;
+	}
+
+	return 0;
+}
+#endif
+
+void jsC_optimize(js_State *J, js_Function *F)
+{
+	js_Instruction *code = F->code;
+	int len = F->codelen;
+	js_Instruction *out;
+	char *target;
+	int *newpos;
+	size_t ntarget, nnewpos, nout;
+	int pc, next, n, k, op, dead;
+
+	if (len == 0)
+		return;
+
+	/* leave functions too large for the tables below as they are */
+	if ((size_t)len >= INT_MAX / sizeof *newpos)
+		return;
+	ntarget = (size_t)len + 1;
+	nnewpos = ntarget * sizeof *newpos;
+	nout = (size_t)len * sizeof *out;
+
+	threadjumps(code, len);
+
+	target = js_malloc(J, (int)ntarget);
+	newpos = js_malloc(J, (int)nnewpos);
+	out = js_malloc(J, (int)nout);
+
+	memset(target, 0, ntarget);
+	for (pc = 0; pc < len; pc += jsC_oplength(code[pc]))
+		if ((k = jsC_jumpoperand(code[pc])) > 0)
+			target[code[pc+k]] = 1;
+	for (pc = 0; pc <= len; ++pc)
+		newpos[pc] = -1;
+
+	n = 0;
+	dead = 0;
+	for (pc = 0; pc < len; pc = next) {
+		op = code[pc];
+		next = pc + jsC_oplength(op);
+
+		if (target[pc])
+			dead = 0;
+		if (dead)
+			continue;
+
+		newpos[pc] = n;
+
+		/* jump to the next live instruction */
+		if (op == OP_JUMP) {
+			for (k = next; k < len && !target[k]; k += jsC_oplength(code[k]))
+				;
+			if (k == code[pc+1]) {
+				newpos[pc] = -1;
+				dead = 1;
+				continue;
+			}
+		}
+
+#ifndef JS_NOREGISTERS
+		if (F->lightweight && (k = fuseregisters(target, code, pc, len, out, &n)) > 0) {
+			next = pc + k;
+			continue;
+		}
+#endif
+
+		/* GETLOCAL n; GETPROP_S -> GETLOCALPROP n */
+		if (F->lightweight && op == OP_GETLOCAL && straight(target, code, pc, len, 2) &&
+				code[next] == OP_GETPROP_S) {
+			out[n++] = OP_GETLOCALPROP;
+			out[n++] = code[pc+1];
+			memcpy(out + n, code + next + 1, (NPTR + 1) * sizeof *out);
+			n += NPTR + 1;
+			next += jsC_oplength(OP_GETPROP_S);
+			continue;
+		}
+
+		/* GETLOCAL n; INC; SETLOCAL n; POP -> INCLOCAL n */
+		if (F->lightweight && op == OP_GETLOCAL && straight(target, code, pc, len, 4) &&
+				(code[next] == OP_INC || code[next] == OP_DEC) &&
+				code[next+1] == OP_SETLOCAL && code[next+2] == code[pc+1] &&
+				code[next+3] == OP_POP) {
+			out[n++] = code[next] == OP_INC ? OP_INCLOCAL : OP_DECLOCAL;
+			out[n++] = code[pc+1];
+			next += 4;
+			continue;
+		}
+
+		/* GETLOCAL n; POSTINC; ROT2; SETLOCAL n; POP; POP -> INCLOCAL n */
+		if (F->lightweight && op == OP_GETLOCAL && straight(target, code, pc, len, 6) &&
+				(code[next] == OP_POSTINC || code[next] == OP_POSTDEC) &&
+				code[next+1] == OP_ROT2 &&
+				code[next+2] == OP_SETLOCAL && code[next+3] == code[pc+1] &&
+				code[next+4] == OP_POP && code[next+5] == OP_POP) {
+			out[n++] = code[next] == OP_POSTINC ? OP_INCLOCAL : OP_DECLOCAL;
+			out[n++] = code[pc+1];
+			next += 6;
+			continue;
+		}
+
+		/* INTEGER k; ADD -> ADDINTEGER k */
+		if (op == OP_INTEGER && straight(target, code, pc, len, 2) && code[next] == OP_ADD) {
+			out[n++] = OP_ADDINTEGER;
+			out[n++] = code[pc+1];
+			next += 1;
+			continue;
+		}
+
+		/* LT; JFALSE addr -> LTJFALSE addr */
+		if (cmpjfalse(op) >= 0 && straight(target, code, pc, len, 2) && code[next] == OP_JFALSE) {
+			out[n++] = cmpjfalse(op);
+			out[n++] = code[next+1];
+			next += 2;
+			continue;
+		}
+
+		/* JFALSE a; JUMP b; a: -> JTRUE b */
+		if ((op == OP_JFALSE || op == OP_JTRUE) && straight(target, code, pc, len, 2) &&
+				code[next] == OP_JUMP && code[pc+1] == next + 2) {
+			out[n++] = op == OP_JFALSE ? OP_JTRUE : OP_JFALSE;
+			out[n++] = code[next+1];
+			next += 2;
+			dead = 1;
+			continue;
+		}
+
+		memcpy(out + n, code + pc, (next - pc) * sizeof *out);
+		n += next - pc;
+
+		if (op == OP_JUMP || op == OP_RETURN || op == OP_THROW)
+			dead = 1;
+	}
+
+	/* removed and fused instructions move to the next instruction kept */
+	for (pc = len, k = n; pc >= 0; --pc) {
+		if (newpos[pc] < 0)
+			newpos[pc] = k;
+		else
+			k = newpos[pc];
+	}
+
+	for (pc = 0; pc < n; pc += jsC_oplength(out[pc]))
+		if ((k = jsC_jumpoperand(out[pc])) > 0)
+			out[pc+k] = newpos[out[pc+k]];
+
+	/* later entries win when several lines land on the same instruction */
+	for (k = 0, next = 0; k < F->linelen; ++k) {
+		pc = newpos[F->linetab[k*2]];
+		if (next > 0 && F->linetab[next*2-2] == pc)
+			--next;
+		if (next > 0 && F->linetab[next*2-1] == F->linetab[k*2+1])
+			continue;
+		F->linetab[next*2] = pc;
+		F->linetab[next*2+1] = F->linetab[k*2+1];
+		++next;
+	}
+	F->linelen = next;
+
+	memcpy(F->code, out, n * sizeof *out);
+	F->codelen = n;
+
+	js_free(J, out);
+	js_free(J, newpos);
+	js_free(J, target);
+}
@@ -61,7 +61,7 @@ static void jsP_warning(js_State *J, const char *fmt, ...)
 
 static js_Ast *jsP_newnode(js_State *J, enum js_AstType type, int line, js_Ast *a, js_Ast *b, js_Ast *c, js_Ast *d)
 {
-	js_Ast *node = js_malloc(J, sizeof *node);
+	js_Ast *node = js_malloccell(J, sizeof *node);
 
 	node->type = type;
 	node->line = line;
@@ -127,7 +127,7 @@ void jsP_freeparse(js_State *J)
 	while (node) {
 		js_Ast *next = node->gcnext;
 		jsP_freejumps(J, node->jumps);
-		js_free(J, node);
+		js_freecell(J, node, sizeof *node);
 		node = next;
 	}
 	J->gcast = NULL;
@@ -22,30 +22,56 @@ static js_Property sentinel = {
 	"",
 	&sentinel, &sentinel,
 	0, 0,
-	{ {0}, {0}, JS_TUNDEFINED },
-	NULL, NULL
+	JSV_UNDEFINED,
+	NULL, NULL,
+	0, 0
 };
 
-static js_Property *newproperty(js_State *J, js_Object *obj, const char *name)
+/*
+	Property names are atoms, so the tree is ordered by the precomputed hash
+	of the name and two names are equal only if they are the same pointer.
+	Atoms with colliding hashes are ordered by their contents.
+*/
+
+static int compare(const char *name, unsigned int hash, js_Property *node)
+{
+	if (name == node->name)
+		return 0;
+	if (hash != node->hash)
+		return hash < node->hash ? -1 : 1;
+	return strcmp(name, node->name);
+}
+
+static void renumber(js_State *J, js_Object *obj);
+
+static js_Property *newproperty(js_State *J, js_Object *obj, const char *name, unsigned int hash)
 {
-	js_Property *node = js_malloc(J, sizeof *node);
-	node->name = js_intern(J, name);
+	js_Property *node;
+	if (obj->nextorder == INT_MAX)
+		renumber(J, obj);
+	jsG_grow(J, sizeof *node);
+	node = js_malloccell(J, sizeof *node);
+	node->name = name;
+	node->hash = hash;
 	node->left = node->right = &sentinel;
 	node->level = 1;
 	node->atts = 0;
-	node->value.type = JS_TUNDEFINED;
-	node->value.u.number = 0;
+	JSV_SETUNDEFINED(&node->value);
 	node->getter = NULL;
 	node->setter = NULL;
+	node->order = obj->nextorder++;
 	++obj->count;
-	++J->gccounter;
 	return node;
 }
 
 static js_Property *lookup(js_Property *node, const char *name)
 {
+	unsigned int hash;
+	if (node == &sentinel)
+		return NULL;
+	hash = jsS_atomhash(name);
 	while (node != &sentinel) {
-		int c = strcmp(name, node->name);
+		int c = compare(name, hash, node);
 		if (c == 0)
 			return node;
 		else if (c < 0)
@@ -79,39 +105,40 @@ static js_Property *split(js_Property *node)
 	return node;
 }
 
-static js_Property *insert(js_State *J, js_Object *obj, js_Property *node, const char *name, js_Property **result)
+static js_Property *insert(js_State *J, js_Object *obj, js_Property *node, const char *name, unsigned int hash, js_Property **result)
 {
 	if (node != &sentinel) {
-		int c = strcmp(name, node->name);
+		int c = compare(name, hash, node);
 		if (c < 0)
-			node->left = insert(J, obj, node->left, name, result);
+			node->left = insert(J, obj, node->left, name, hash, result);
 		else if (c > 0)
-			node->right = insert(J, obj, node->right, name, result);
+			node->right = insert(J, obj, node->right, name, hash, result);
 		else
 			return *result = node;
 		node = skew(node);
 		node = split(node);
 		return node;
 	}
-	return *result = newproperty(J, obj, name);
+	return *result = newproperty(J, obj, name, hash);
 }
 
 static void freeproperty(js_State *J, js_Object *obj, js_Property *node)
 {
-	js_free(J, node);
+	js_freecell(J, node, sizeof *node);
+	jsG_shrink(J, sizeof *node);
 	--obj->count;
 }
 
-static js_Property *delete(js_State *J, js_Object *obj, js_Property *node, const char *name)
+static js_Property *delete(js_State *J, js_Object *obj, js_Property *node, const char *name, unsigned int hash)
 {
 	js_Property *temp, *succ;
 
 	if (node != &sentinel) {
-		int c = strcmp(name, node->name);
+		int c = compare(name, hash, node);
 		if (c < 0) {
-			node->left = delete(J, obj, node->left, name);
+			node->left = delete(J, obj, node->left, name, hash);
 		} else if (c > 0) {
-			node->right = delete(J, obj, node->right, name);
+			node->right = delete(J, obj, node->right, name, hash);
 		} else {
 			if (node->left == &sentinel) {
 				temp = node;
@@ -122,13 +149,18 @@ static js_Property *delete(js_State *J, js_Object *obj, js_Property *node, const
 				node = node->left;
 				freeproperty(J, obj, temp);
 			} else {
+				/* move the successor into this node and delete its old node */
 				succ = node->right;
 				while (succ->left != &sentinel)
 					succ = succ->left;
 				node->name = succ->name;
+				node->hash = succ->hash;
 				node->atts = succ->atts;
 				node->value = succ->value;
-				node->right = delete(J, obj, node->right, succ->name);
+				node->getter = succ->getter;
+				node->setter = succ->setter;
+				node->order = succ->order;
+				node->right = delete(J, obj, node->right, succ->name, succ->hash);
 			}
 		}
 
@@ -149,57 +181,184 @@ static js_Property *delete(js_State *J, js_Object *obj, js_Property *node, const
 
 js_Object *jsV_newobject(js_State *J, enum js_Class type, js_Object *prototype)
 {
-	js_Object *obj = js_malloc(J, sizeof *obj);
+	js_Object *obj;
+	jsG_grow(J, sizeof *obj);
+	obj = js_malloccell(J, sizeof *obj);
 	memset(obj, 0, sizeof *obj);
-	obj->gcmark = 0;
+	obj->gcmark = JS_NEWMARK(J);
 	obj->gcnext = J->gcobj;
 	J->gcobj = obj;
-	++J->gccounter;
 
 	obj->type = type;
 	obj->properties = &sentinel;
+	obj->shape = J->rootshape;
 	obj->prototype = prototype;
+
+	/* keep userdata in dictionary mode so property caches never bypass
+	 * the has/put/delete callbacks */
+	if (type == JS_CUSERDATA)
+		obj->shape = NULL;
 	obj->extensible = 1;
+
+	if (type == JS_CARRAY)
+		obj->u.a.dense = 1;
+
+	/* Property lookups through the prototype chain only search the property
+	 * trees, so an array that is used as a prototype must keep its elements
+	 * there too. */
+	if (prototype && prototype->type == JS_CARRAY && prototype->u.a.dense) {
+		jsV_unflattenarray(J, prototype, 0);
+		prototype->u.a.dense = 0;
+	}
+
 	return obj;
 }
 
-js_Property *jsV_getownproperty(js_State *J, js_Object *obj, const char *name)
+/* Shapes */
+
+js_Shape *jsV_newshape(js_State *J, js_Shape *parent, const char *name, int atts)
 {
-	return lookup(obj->properties, name);
+	js_Shape *shape;
+	jsG_grow(J, sizeof *shape);
+	shape = js_malloccell(J, sizeof *shape);
+	shape->name = name;
+	shape->atts = atts;
+	shape->slot = parent ? parent->slot + 1 : -1;
+	shape->parent = parent;
+	shape->kids = NULL;
+	shape->sibling = NULL;
+	shape->gcmark = 0;
+	if (parent) {
+		shape->sibling = parent->kids;
+		parent->kids = shape;
+	}
+	return shape;
 }
 
-js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int *own)
+js_Shape *jsV_getownshape(js_Object *obj, const char *name)
 {
-	*own = 1;
-	do {
-		js_Property *ref = lookup(obj->properties, name);
-		if (ref)
-			return ref;
-		obj = obj->prototype;
-		*own = 0;
-	} while (obj);
+	js_Shape *shape = obj->shape;
+	while (shape->parent) {
+		if (shape->name == name)
+			return shape;
+		shape = shape->parent;
+	}
 	return NULL;
 }
 
-js_Property *jsV_getproperty(js_State *J, js_Object *obj, const char *name)
+/* Number of slots allocated for n properties in shape mode: 4, 8, 16, ... */
+int jsV_slotcapacity(int n)
 {
-	do {
-		js_Property *ref = lookup(obj->properties, name);
-		if (ref)
-			return ref;
-		obj = obj->prototype;
-	} while (obj);
-	return NULL;
+	int cap = 4;
+	if (n == 0)
+		return 0;
+	while (cap < n)
+		cap *= 2;
+	return cap;
+}
+
+/* Add a data property to an object in shape mode. Returns NULL if the
+ * property cannot be described by a shape; use jsV_setproperty then. */
+js_Value *jsV_addslot(js_State *J, js_Object *obj, const char *name, int atts)
+{
+	js_Shape *shape;
+	int n = obj->count;
+	int k;
+
+	if (!obj->shape || !obj->extensible || n >= JS_SHAPELIMIT)
+		return NULL;
+
+	/* sparse array elements are kept in the tree */
+	if (obj->type == JS_CARRAY && js_isarrayindex(J, name, &k))
+		return NULL;
+
+	for (shape = obj->shape->kids; shape; shape = shape->sibling)
+		if (shape->name == name && shape->atts == atts)
+			break;
+	if (!shape)
+		shape = jsV_newshape(J, obj->shape, name, atts);
+
+	jsG_barrier(J, obj);
+
+	if (n == 0 || (n >= 4 && (n & (n - 1)) == 0)) {
+		jsG_grow(J, (jsV_slotcapacity(n + 1) - jsV_slotcapacity(n)) * (int)sizeof *obj->slots);
+		obj->slots = js_realloc(J, obj->slots, jsV_slotcapacity(n + 1) * (int)sizeof *obj->slots);
+	}
+
+	obj->shape = shape;
+	++obj->count;
+
+	JSV_SETUNDEFINED(&obj->slots[shape->slot]);
+	return &obj->slots[shape->slot];
+}
+
+static void todictionary(js_State *J, js_Object *obj, js_Shape *shape)
+{
+	js_Property *ref;
+	if (shape->parent) {
+		/* insert from the first added property to keep insertion order */
+		todictionary(J, obj, shape->parent);
+		obj->properties = insert(J, obj, obj->properties, shape->name, jsS_atomhash(shape->name), &ref);
+		ref->atts = shape->atts;
+		ref->value = obj->slots[shape->slot];
+	}
+}
+
+/* Move the properties of an object in shape mode into the property tree. */
+void jsV_todictionary(js_State *J, js_Object *obj)
+{
+	int count = obj->count;
+
+	if (!obj->shape)
+		return;
+
+	/* make sure the property nodes fit under the heap limit before moving any */
+	jsG_grow(J, count * (int)sizeof(js_Property));
+	jsG_shrink(J, count * (int)sizeof(js_Property));
+
+	todictionary(J, obj, obj->shape);
+
+	jsG_shrink(J, jsV_slotcapacity(count) * (int)sizeof *obj->slots);
+	js_free(J, obj->slots);
+	obj->slots = NULL;
+	obj->shape = NULL;
+	obj->count = count;
+}
+
+static void deleteproperty(js_State *J, js_Object *obj, const char *name)
+{
+	js_Property *ref = lookup(obj->properties, name);
+	if (ref)
+		obj->properties = delete(J, obj, obj->properties, name, ref->hash);
+}
+
+js_Property *jsV_getownproperty(js_State *J, js_Object *obj, const char *name)
+{
+	return lookup(obj->properties, name);
 }
 
-static js_Property *jsV_getenumproperty(js_State *J, js_Object *obj, const char *name)
+/* Find a property in the prototype chain. Returns the object that has it,
+ * with either the tree node (dictionary mode) or the shape (shape mode). */
+js_Object *jsV_getproperty(js_State *J, js_Object *obj, const char *name, js_Property **ref, js_Shape **shape)
 {
 	do {
-		js_Property *ref = lookup(obj->properties, name);
-		if (ref && !(ref->atts & JS_DONTENUM))
-			return ref;
+		if (obj->shape) {
+			*shape = jsV_getownshape(obj, name);
+			if (*shape) {
+				*ref = NULL;
+				return obj;
+			}
+		} else {
+			*ref = lookup(obj->properties, name);
+			if (*ref) {
+				*shape = NULL;
+				return obj;
+			}
+		}
 		obj = obj->prototype;
 	} while (obj);
+	*ref = NULL;
+	*shape = NULL;
 	return NULL;
 }
 
@@ -207,6 +366,11 @@ js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name)
 {
 	js_Property *result;
 
+	jsG_barrier(J, obj);
+
+	if (obj->shape)
+		jsV_todictionary(J, obj);
+
 	if (!obj->extensible) {
 		result = lookup(obj->properties, name);
 		if (J->strict && !result)
@@ -214,97 +378,229 @@ js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name)
 		return result;
 	}
 
-	obj->properties = insert(J, obj, obj->properties, name, &result);
+	obj->properties = insert(J, obj, obj->properties, name, jsS_atomhash(name), &result);
 
 	return result;
 }
 
 void jsV_delproperty(js_State *J, js_Object *obj, const char *name)
 {
-	obj->properties = delete(J, obj, obj->properties, name);
+	if (obj->shape) {
+		js_Shape *shape = jsV_getownshape(obj, name);
+		if (!shape)
+			return;
+		/* removing the last added property is the reverse transition */
+		if (shape == obj->shape) {
+			jsG_shrink(J, (jsV_slotcapacity(obj->count) - jsV_slotcapacity(obj->count - 1)) * (int)sizeof *obj->slots);
+			obj->shape = shape->parent;
+			--obj->count;
+			return;
+		}
+		jsV_todictionary(J, obj);
+	}
+	deleteproperty(J, obj, name);
 }
 
-/* Flatten hierarchy of enumerable properties into an iterator object */
+/*
+	Enumeration visits the objects on the prototype chain in turn. Each one
+	gives its array index names in ascending order, then its other names in
+	insertion order, leaving out names that an object earlier in the chain
+	has as its own property, so that every name is listed once.
+*/
 
-static js_Iterator *itwalk(js_State *J, js_Iterator *iter, js_Property *prop, js_Object *seen)
+static int itisown(js_State *J, js_Object *obj, const char *name)
 {
-	if (prop->right != &sentinel)
-		iter = itwalk(J, iter, prop->right, seen);
-	if (!(prop->atts & JS_DONTENUM)) {
-		if (!seen || !jsV_getenumproperty(J, seen, prop->name)) {
-			js_Iterator *head = js_malloc(J, sizeof *head);
-			head->name = prop->name;
-			head->next = iter;
-			iter = head;
-		}
+	int k;
+	if (obj->shape ? jsV_getownshape(obj, name) != NULL : lookup(obj->properties, name) != NULL)
+		return 1;
+	if (obj->type == JS_CARRAY && js_isarrayindex(J, name, &k))
+		return k < obj->u.a.flat_length;
+	if (obj->type == JS_CSTRING && js_isarrayindex(J, name, &k))
+		return k < obj->u.s.length;
+	return 0;
+}
+
+static js_Iterator *itname(js_State *J, js_Iterator *iter, js_Object *start, js_Object *obj, const char *name)
+{
+	js_Iterator *node;
+	for (; start != obj; start = start->prototype)
+		if (itisown(J, start, name))
+			return iter;
+	node = js_malloccell(J, sizeof *node);
+	node->name = name;
+	node->next = iter;
+	return node;
+}
+
+static int itindex(js_State *J, js_Object *obj, js_Iterator *node)
+{
+	int k;
+	return js_isarrayindex(J, node->name, &k) ? k : -1;
+}
+
+static int itorder(js_State *J, js_Object *obj, js_Iterator *node)
+{
+	return lookup(obj->properties, node->name)->order;
+}
+
+typedef int (*js_ItKey)(js_State *J, js_Object *obj, js_Iterator *node);
+
+/* Merge two lists of names sorted in ascending order of key */
+static js_Iterator *itmerge(js_State *J, js_Object *obj, js_ItKey key, js_Iterator *a, js_Iterator *b)
+{
+	js_Iterator *head = NULL, **tail = &head;
+	while (a && b) {
+		if (key(J, obj, a) < key(J, obj, b))
+			*tail = a, a = a->next;
+		else
+			*tail = b, b = b->next;
+		tail = &(*tail)->next;
 	}
-	if (prop->left != &sentinel)
-		iter = itwalk(J, iter, prop->left, seen);
-	return iter;
+	*tail = a ? a : b;
+	return head;
 }
 
-static js_Iterator *itflatten(js_State *J, js_Object *obj)
+static js_Iterator *itsort(js_State *J, js_Object *obj, js_ItKey key, js_Iterator *list)
 {
-	js_Iterator *iter = NULL;
-	if (obj->prototype)
-		iter = itflatten(J, obj->prototype);
-	if (obj->properties != &sentinel)
-		iter = itwalk(J, iter, obj->properties, obj->prototype);
+	js_Iterator *slow = list, *fast, *half;
+	if (!list || !list->next)
+		return list;
+	for (fast = list->next; fast && fast->next; fast = fast->next->next)
+		slow = slow->next;
+	half = slow->next;
+	slow->next = NULL;
+	return itmerge(J, obj, key, itsort(J, obj, key, list), itsort(J, obj, key, half));
+}
+
+static js_Iterator *itwalk(js_State *J, js_Iterator *iter, js_Object *start, js_Object *obj, js_Property *node, int hidden)
+{
+	if (node->right->level)
+		iter = itwalk(J, iter, start, obj, node->right, hidden);
+	if (hidden || !(node->atts & JS_DONTENUM))
+		iter = itname(J, iter, start, obj, node->name);
+	if (node->left->level)
+		iter = itwalk(J, iter, start, obj, node->left, hidden);
 	return iter;
 }
 
-js_Object *jsV_newiterator(js_State *J, js_Object *obj, int own)
+/* Own property names of obj in insertion order, or only the enumerable ones */
+static js_Iterator *itproperties(js_State *J, js_Iterator *iter, js_Object *start, js_Object *obj, int hidden)
+{
+	js_Iterator *list, *node;
+	js_Shape *shape;
+	/* walk backwards from the last added property, prepending each name */
+	if (obj->shape) {
+		for (shape = obj->shape; shape->parent; shape = shape->parent)
+			if (hidden || !(shape->atts & JS_DONTENUM))
+				iter = itname(J, iter, start, obj, shape->name);
+		return iter;
+	}
+	/* the tree is in hash order, sort its names by insertion number */
+	if (!obj->properties->level)
+		return iter;
+	list = itsort(J, obj, itorder, itwalk(J, NULL, start, obj, obj->properties, hidden));
+	if (!list)
+		return iter;
+	for (node = list; node->next; node = node->next)
+		;
+	node->next = iter;
+	return list;
+}
+
+/* Number the properties of a dictionary from zero again, keeping their order */
+static void renumber(js_State *J, js_Object *obj)
 {
+	js_Iterator *node = itproperties(J, NULL, obj, obj, 1), *next;
+	obj->nextorder = 0;
+	for (; node; node = next) {
+		next = node->next;
+		lookup(obj->properties, node->name)->order = obj->nextorder++;
+		js_freecell(J, node, sizeof *node);
+	}
+}
+
+/* Enumerable names of one object on the chain, linked in front of rest */
+static js_Iterator *itobject(js_State *J, js_Iterator *rest, js_Object *start, js_Object *obj, int hidden)
+{
+	js_Iterator *list, *node, *next, *indices = NULL, *names = NULL, **itail = &indices, **ntail = &names;
 	char buf[32];
-	int k;
+	int k, n;
+
+	/* split the names into array indices and others, keeping their order */
+	for (node = itproperties(J, NULL, start, obj, hidden); node; node = next) {
+		next = node->next;
+		if (js_isarrayindex(J, node->name, &k))
+			*itail = node, itail = &node->next;
+		else
+			*ntail = node, ntail = &node->next;
+		node->next = NULL;
+	}
+	*ntail = rest;
+
+	/* elements of arrays and characters of strings are in index order */
+	n = obj->type == JS_CARRAY ? obj->u.a.flat_length : obj->type == JS_CSTRING ? obj->u.s.length : 0;
+	list = NULL;
+	for (k = n - 1; k >= 0; --k)
+		list = itname(J, list, start, obj, js_intern(J, js_itoa(buf, k)));
+
+	list = itmerge(J, obj, itindex, list, itsort(J, obj, itindex, indices));
+	if (!list)
+		return names;
+	for (node = list; node->next; node = node->next)
+		;
+	node->next = names;
+	return list;
+}
+
+static js_Iterator *itflatten(js_State *J, js_Object *start, js_Object *obj)
+{
+	js_Iterator *rest = obj->prototype ? itflatten(J, start, obj->prototype) : NULL;
+	return itobject(J, rest, start, obj, 0);
+}
+
+js_Object *jsV_newiterator(js_State *J, js_Object *obj, int own)
+{
+	js_Object *io;
+	if (own)
+		return jsV_newowniterator(J, obj, 0);
+	io = jsV_newobject(J, JS_CITERATOR, NULL);
+	io->u.iter.target = obj;
+	io->u.iter.head = itflatten(J, obj, obj);
+	return io;
+}
+
+/* Iterate over the own property names, including the hidden ones if asked */
+js_Object *jsV_newowniterator(js_State *J, js_Object *obj, int hidden)
+{
 	js_Object *io = jsV_newobject(J, JS_CITERATOR, NULL);
 	io->u.iter.target = obj;
-	if (own) {
-		io->u.iter.head = NULL;
-		if (obj->properties != &sentinel)
-			io->u.iter.head = itwalk(J, io->u.iter.head, obj->properties, NULL);
-	} else {
-		io->u.iter.head = itflatten(J, obj);
-	}
-	if (obj->type == JS_CSTRING) {
-		js_Iterator *tail = io->u.iter.head;
-		if (tail)
-			while (tail->next)
-				tail = tail->next;
-		for (k = 0; k < obj->u.s.length; ++k) {
-			js_itoa(buf, k);
-			if (!jsV_getenumproperty(J, obj, buf)) {
-				js_Iterator *node = js_malloc(J, sizeof *node);
-				node->name = js_intern(J, js_itoa(buf, k));
-				node->next = NULL;
-				if (!tail)
-					io->u.iter.head = tail = node;
-				else {
-					tail->next = node;
-					tail = node;
-				}
-			}
-		}
-	}
+	io->u.iter.head = itobject(J, NULL, obj, obj, hidden);
 	return io;
 }
 
 const char *jsV_nextiterator(js_State *J, js_Object *io)
 {
+	js_Property *ref;
+	js_Shape *shape;
 	int k;
 	if (io->type != JS_CITERATOR)
 		js_typeerror(J, "not an iterator");
 	while (io->u.iter.head) {
 		js_Iterator *next = io->u.iter.head->next;
 		const char *name = io->u.iter.head->name;
-		js_free(J, io->u.iter.head);
+		js_freecell(J, io->u.iter.head, sizeof *io->u.iter.head);
 		io->u.iter.head = next;
-		if (jsV_getproperty(J, io->u.iter.target, name))
+		io->u.iter.name = name;
+		if (jsV_getproperty(J, io->u.iter.target, name, &ref, &shape))
 			return name;
 		if (io->u.iter.target->type == JS_CSTRING)
 			if (js_isarrayindex(J, name, &k) && k < io->u.iter.target->u.s.length)
 				return name;
+		if (io->u.iter.target->type == JS_CARRAY)
+			if (js_isarrayindex(J, name, &k) && k < io->u.iter.target->u.a.flat_length)
+				return name;
 	}
+	io->u.iter.name = NULL;
 	return NULL;
 }
 
@@ -314,20 +610,129 @@ void jsV_resizearray(js_State *J, js_Object *obj, int newlen)
 {
 	char buf[32];
 	const char *s;
-	int k;
+	int k, start;
 	if (newlen < obj->u.a.length) {
-		if (obj->u.a.length > obj->count * 2) {
-			js_Object *it = jsV_newiterator(J, obj, 1);
+		/* element properties in the tree all come after the flat prefix */
+		start = obj->u.a.flat_length;
+		if (newlen < obj->u.a.flat_length) {
+			obj->u.a.flat_length = newlen;
+			if (newlen == 0) {
+				jsG_shrink(J, obj->u.a.flat_capacity * (int)sizeof *obj->u.a.array);
+				js_free(J, obj->u.a.array);
+				obj->u.a.array = NULL;
+				obj->u.a.flat_capacity = 0;
+			}
+		}
+		if (start < newlen)
+			start = newlen;
+		if (obj->count > 0 && obj->u.a.length - start > obj->count * 2) {
+			/* only walk the tree, the flat prefix is already truncated */
+			js_Object *it = jsV_newobject(J, JS_CITERATOR, NULL);
+			it->u.iter.target = obj;
+			it->u.iter.head = itproperties(J, NULL, obj, obj, 1);
 			while ((s = jsV_nextiterator(J, it))) {
 				k = jsV_numbertointeger(jsV_stringtonumber(J, s));
 				if (k >= newlen && !strcmp(s, jsV_numbertostring(J, buf, k)))
 					jsV_delproperty(J, obj, s);
 			}
-		} else {
-			for (k = newlen; k < obj->u.a.length; ++k) {
-				jsV_delproperty(J, obj, js_itoa(buf, k));
+		} else if (obj->count > 0) {
+			for (k = start; k < obj->u.a.length; ++k) {
+				jsV_delproperty(J, obj, js_intern(J, js_itoa(buf, k)));
 			}
 		}
 	}
 	obj->u.a.length = newlen;
 }
+
+/*
+	Arrays keep the dense prefix of their elements in a flat vector of
+	values. Elements beyond the prefix, holes, and elements that have
+	attributes or accessors live in the property tree like any other
+	property. No element property in the tree is ever below flat_length.
+*/
+
+int jsV_growarray(js_State *J, js_Object *obj, int n)
+{
+	int cap = obj->u.a.flat_capacity;
+	if (n <= cap)
+		return 1;
+	if (!obj->u.a.dense || n > JS_ARRAYLIMIT)
+		return 0;
+	if (cap < 8)
+		cap = 8;
+	while (cap < n)
+		cap = cap > JS_ARRAYLIMIT / 2 ? JS_ARRAYLIMIT : cap * 2;
+	jsG_grow(J, (cap - obj->u.a.flat_capacity) * (int)sizeof *obj->u.a.array);
+	obj->u.a.array = js_realloc(J, obj->u.a.array, cap * (int)sizeof *obj->u.a.array);
+	obj->u.a.flat_capacity = cap;
+	return 1;
+}
+
+/* An index that has never been interned cannot be a property name. */
+static js_Property *findindex(js_State *J, js_Object *obj, int k)
+{
+	char buf[32];
+	const char *name = jsS_findatom(J, js_itoa(buf, k));
+	return name ? lookup(obj->properties, name) : NULL;
+}
+
+int jsV_appendarray(js_State *J, js_Object *obj, js_Value *value)
+{
+	js_Property *ref;
+	int k = obj->u.a.flat_length;
+
+	if (!obj->extensible)
+		return 0;
+
+	/* an element with attributes or accessors must stay in the tree */
+	if (obj->count > 0) {
+		ref = findindex(J, obj, k);
+		if (ref && (ref->atts || ref->getter || ref->setter))
+			return 0;
+		if (ref)
+			deleteproperty(J, obj, ref->name);
+	}
+
+	if (!jsV_growarray(J, obj, k + 1))
+		return 0;
+	obj->u.a.array[k] = *value;
+	jsG_barrierelement(J, obj, &obj->u.a.array[k]);
+	obj->u.a.flat_length = ++k;
+	if (k > obj->u.a.length)
+		obj->u.a.length = k;
+
+	/* pull in elements from the tree that now continue the prefix */
+	while (obj->count > 0 && k < obj->u.a.length) {
+		ref = findindex(J, obj, k);
+		if (!ref || ref->atts || ref->getter || ref->setter)
+			break;
+		if (!jsV_growarray(J, obj, k + 1))
+			break;
+		obj->u.a.array[k] = ref->value;
+		obj->u.a.flat_length = ++k;
+		deleteproperty(J, obj, ref->name);
+	}
+
+	return 1;
+}
+
+void jsV_unflattenarray(js_State *J, js_Object *obj, int start)
+{
+	char buf[32];
+	js_Property *ref;
+	int k, n = obj->u.a.flat_length;
+
+	if (start >= n)
+		return;
+
+	jsG_barrier(J, obj);
+	jsV_todictionary(J, obj);
+
+	/* insert in ascending order so the elements enumerate in order */
+	for (k = start; k < n; ++k) {
+		const char *name = js_intern(J, js_itoa(buf, k));
+		obj->properties = insert(J, obj, obj->properties, name, jsS_atomhash(name), &ref);
+		ref->value = obj->u.a.array[k];
+	}
+	obj->u.a.flat_length = start;
+}
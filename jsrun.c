@@ -5,7 +5,7 @@
 
 #include "utf.h"
 
-static void jsR_run(js_State *J, js_Function *F);
+static void jsR_run(js_State *J, js_Function *entry);
 
 /* Push values on stack */
 
@@ -15,24 +15,21 @@ static void jsR_run(js_State *J, js_Function *F);
 
 static void js_trystackoverflow(js_State *J)
 {
-	STACK[TOP].type = JS_TLITSTR;
-	STACK[TOP].u.litstr = "exception stack overflow";
+	JSV_SETLITSTR(&STACK[TOP], "exception stack overflow");
 	++TOP;
 	js_throw(J);
 }
 
 static void js_stackoverflow(js_State *J)
 {
-	STACK[TOP].type = JS_TLITSTR;
-	STACK[TOP].u.litstr = "stack overflow";
+	JSV_SETLITSTR(&STACK[TOP], "stack overflow");
 	++TOP;
 	js_throw(J);
 }
 
-static void js_outofmemory(js_State *J)
+void js_outofmemory(js_State *J)
 {
-	STACK[TOP].type = JS_TLITSTR;
-	STACK[TOP].u.litstr = "out of memory";
+	JSV_SETLITSTR(&STACK[TOP], "out of memory");
 	++TOP;
 	js_throw(J);
 }
@@ -66,19 +63,149 @@ void js_free(js_State *J, void *ptr)
 	J->alloc(J->actx, ptr, 0);
 }
 
+/*
+	Objects, properties, shapes, environments, iterators, short strings and
+	syntax tree nodes are cut from large chunks instead of being allocated
+	one by one. A freed cell goes on the free list of its size class, to be
+	handed out again by the next allocation of that size. The chunks are
+	only given back to the allocator when the state is freed.
+*/
+
+#define JS_POOLGRAIN 8
+#define JS_POOLCHUNK 16384
+
+void *js_malloccell(js_State *J, int size)
+{
+	int k = (size + JS_POOLGRAIN - 1) / JS_POOLGRAIN;
+	void **cell;
+	char *chunk;
+
+	if (size > JS_POOLMAX)
+		return js_malloc(J, size);
+
+	cell = J->poolfree[k];
+	if (cell) {
+		J->poolfree[k] = *cell;
+		return cell;
+	}
+
+	size = k * JS_POOLGRAIN;
+	if (J->poolend - J->poolnext < size) {
+		chunk = js_malloc(J, JS_POOLCHUNK);
+		*(void**)chunk = J->poolchunk;
+		J->poolchunk = chunk;
+		J->poolnext = chunk + JS_POOLGRAIN;
+		J->poolend = chunk + JS_POOLCHUNK;
+	}
+	cell = (void**)J->poolnext;
+	J->poolnext += size;
+	return cell;
+}
+
+/* Size must be the same as when the cell was allocated. */
+void js_freecell(js_State *J, void *ptr, int size)
+{
+	int k = (size + JS_POOLGRAIN - 1) / JS_POOLGRAIN;
+	if (size > JS_POOLMAX) {
+		js_free(J, ptr);
+		return;
+	}
+	*(void**)ptr = J->poolfree[k];
+	J->poolfree[k] = ptr;
+}
+
+void jsR_freepool(js_State *J)
+{
+	void *chunk, *next;
+	for (chunk = J->poolchunk; chunk; chunk = next) {
+		next = *(void**)chunk;
+		js_free(J, chunk);
+	}
+	J->poolchunk = NULL;
+}
+
 js_String *jsV_newmemstring(js_State *J, const char *s, int n)
 {
-	js_String *v = js_malloc(J, soffsetof(js_String, p) + n + 1);
-	memcpy(v->p, s, n);
+	js_String *v;
+	jsG_grow(J, soffsetof(js_String, p) + n + 1);
+	v = js_malloccell(J, soffsetof(js_String, p) + n + 1);
+	if (s)
+		memcpy(v->p, s, n);
 	v->p[n] = 0;
-	v->gcmark = 0;
+	v->left = v->right = NULL;
+	v->index = NULL;
+	v->length = n;
+	v->runes = -1;
+	v->ascii = 0;
+	v->depth = 0;
+	v->gcmark = JS_NEWMARK(J);
+	v->gcnext = J->gcstr;
+	J->gcstr = v;
+	return v;
+}
+
+js_String *jsV_newrope(js_State *J, js_String *left, js_String *right)
+{
+	js_String *v;
+	jsG_grow(J, soffsetof(js_String, p) + 1);
+	v = js_malloccell(J, soffsetof(js_String, p) + 1);
+	v->p[0] = 0;
+	v->left = left;
+	v->right = right;
+	v->index = NULL;
+	v->length = left->length + right->length;
+	if (left->runes >= 0 && right->runes >= 0) {
+		v->runes = left->runes + right->runes;
+		v->ascii = left->ascii && right->ascii;
+	} else {
+		v->runes = -1;
+		v->ascii = 0;
+	}
+	v->depth = right->depth + 1;
+	if (v->depth < left->depth)
+		v->depth = left->depth;
+	v->gcmark = JS_NEWMARK(J);
 	v->gcnext = J->gcstr;
 	J->gcstr = v;
-	++J->gccounter;
 	return v;
 }
 
-#define CHECKSTACK(n) if (TOP + n >= JS_STACKSIZE) js_stackoverflow(J)
+/* Move the value stack to an array with room for n more values and a spare slot */
+static void jsR_growstack(js_State *J, int n)
+{
+	js_Value *stack;
+	int size = J->stacksize;
+
+	if (TOP + n >= JS_STACKSIZE)
+		js_stackoverflow(J);
+	while (TOP + n >= size)
+		size = size > JS_STACKSIZE / 2 ? JS_STACKSIZE : size * 2;
+
+	jsG_grow(J, size * (int)sizeof *stack);
+	stack = J->alloc(J->actx, NULL, size * (int)sizeof *stack);
+	if (!stack) {
+		jsG_shrink(J, size * (int)sizeof *stack);
+		js_outofmemory(J);
+	}
+	memcpy(stack, STACK, TOP * sizeof *stack);
+
+	/* the old array still backs strings from js_tostring */
+	J->oldstack[J->oldstackcount++] = STACK;
+	J->oldstackbytes += J->stacksize * (int)sizeof *stack;
+	STACK = stack;
+	J->stacksize = size;
+}
+
+/* Free the arrays the value stack has outgrown, once no value is left on them */
+void jsR_freestacks(js_State *J)
+{
+	while (J->oldstackcount > 0)
+		J->alloc(J->actx, J->oldstack[--J->oldstackcount], 0);
+	jsG_shrink(J, J->oldstackbytes);
+	J->oldstackbytes = 0;
+}
+
+#define CHECKSTACK(n) if (TOP + n >= J->stacksize) jsR_growstack(J, n)
 
 void js_pushvalue(js_State *J, js_Value v)
 {
@@ -90,30 +217,44 @@ void js_pushvalue(js_State *J, js_Value v)
 void js_pushundefined(js_State *J)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TUNDEFINED;
+	JSV_SETUNDEFINED(&STACK[TOP]);
 	++TOP;
 }
 
 void js_pushnull(js_State *J)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TNULL;
+	JSV_SETNULL(&STACK[TOP]);
 	++TOP;
 }
 
 void js_pushboolean(js_State *J, int v)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TBOOLEAN;
-	STACK[TOP].u.boolean = !!v;
+	JSV_SETBOOLEAN(&STACK[TOP], !!v);
 	++TOP;
 }
 
+/* Store a number, tagged as an integer when it is one */
+static void jsR_setnumber(js_Value *v, double x)
+{
+	if (x >= INT_MIN && x <= INT_MAX && x == (int)x && (x != 0 || !signbit(x)))
+		JSV_SETINTEGER(v, (int)x);
+	else
+		JSV_SETNUMBER(v, x);
+}
+
 void js_pushnumber(js_State *J, double v)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TNUMBER;
-	STACK[TOP].u.number = v;
+	jsR_setnumber(&STACK[TOP], v);
+	++TOP;
+}
+
+static void js_pushinteger(js_State *J, int v)
+{
+	CHECKSTACK(1);
+	JSV_SETINTEGER(&STACK[TOP], v);
 	++TOP;
 }
 
@@ -123,14 +264,13 @@ void js_pushstring(js_State *J, const char *v)
 	if (n > JS_STRLIMIT)
 		js_rangeerror(J, "invalid string length");
 	CHECKSTACK(1);
-	if (n <= soffsetof(js_Value, type)) {
-		char *s = STACK[TOP].u.shrstr;
+	if (n <= JSV_SHRSTRLEN) {
+		char *s = JSV_SHRSTR(&STACK[TOP]);
 		while (n--) *s++ = *v++;
 		*s = 0;
-		STACK[TOP].type = JS_TSHRSTR;
+		JSV_SETSHRSTR(&STACK[TOP]);
 	} else {
-		STACK[TOP].type = JS_TMEMSTR;
-		STACK[TOP].u.memstr = jsV_newmemstring(J, v, n);
+		JSV_SETMEMSTR(&STACK[TOP], jsV_newmemstring(J, v, n));
 	}
 	++TOP;
 }
@@ -140,14 +280,13 @@ void js_pushlstring(js_State *J, const char *v, int n)
 	if (n > JS_STRLIMIT)
 		js_rangeerror(J, "invalid string length");
 	CHECKSTACK(1);
-	if (n <= soffsetof(js_Value, type)) {
-		char *s = STACK[TOP].u.shrstr;
+	if (n <= JSV_SHRSTRLEN) {
+		char *s = JSV_SHRSTR(&STACK[TOP]);
 		while (n--) *s++ = *v++;
 		*s = 0;
-		STACK[TOP].type = JS_TSHRSTR;
+		JSV_SETSHRSTR(&STACK[TOP]);
 	} else {
-		STACK[TOP].type = JS_TMEMSTR;
-		STACK[TOP].u.memstr = jsV_newmemstring(J, v, n);
+		JSV_SETMEMSTR(&STACK[TOP], jsV_newmemstring(J, v, n));
 	}
 	++TOP;
 }
@@ -155,16 +294,28 @@ void js_pushlstring(js_State *J, const char *v, int n)
 void js_pushliteral(js_State *J, const char *v)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TLITSTR;
-	STACK[TOP].u.litstr = v;
+	JSV_SETLITSTR(&STACK[TOP], v);
+	++TOP;
+}
+
+void js_pushatom(js_State *J, const char *atom)
+{
+	CHECKSTACK(1);
+	JSV_SETATOM(&STACK[TOP], atom);
+	++TOP;
+}
+
+void js_pushmemstring(js_State *J, js_String *v)
+{
+	CHECKSTACK(1);
+	JSV_SETMEMSTR(&STACK[TOP], v);
 	++TOP;
 }
 
 void js_pushobject(js_State *J, js_Object *v)
 {
 	CHECKSTACK(1);
-	STACK[TOP].type = JS_TOBJECT;
-	STACK[TOP].u.object = v;
+	JSV_SETOBJECT(&STACK[TOP], v);
 	++TOP;
 }
 
@@ -179,14 +330,14 @@ void js_currentfunction(js_State *J)
 	if (BOT > 0)
 		STACK[TOP] = STACK[BOT-1];
 	else
-		STACK[TOP].type = JS_TUNDEFINED;
+		JSV_SETUNDEFINED(&STACK[TOP]);
 	++TOP;
 }
 
 void *js_currentfunctiondata(js_State *J)
 {
 	if (BOT > 0)
-		return STACK[BOT-1].u.object->u.c.data;
+		return JSV_OBJECT(&STACK[BOT-1])->u.c.data;
 	return NULL;
 }
 
@@ -194,7 +345,7 @@ void *js_currentfunctiondata(js_State *J)
 
 static js_Value *stackidx(js_State *J, int idx)
 {
-	static js_Value undefined = { {0}, {0}, JS_TUNDEFINED };
+	static js_Value undefined = JSV_UNDEFINED;
 	idx = idx < 0 ? TOP + idx : BOT + idx;
 	if (idx < 0 || idx >= TOP)
 		return &undefined;
@@ -206,56 +357,56 @@ js_Value *js_tovalue(js_State *J, int idx)
 	return stackidx(J, idx);
 }
 
-int js_isdefined(js_State *J, int idx) { return stackidx(J, idx)->type != JS_TUNDEFINED; }
-int js_isundefined(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TUNDEFINED; }
-int js_isnull(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TNULL; }
-int js_isboolean(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TBOOLEAN; }
-int js_isnumber(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TNUMBER; }
-int js_isstring(js_State *J, int idx) { enum js_Type t = stackidx(J, idx)->type; return t == JS_TSHRSTR || t == JS_TLITSTR || t == JS_TMEMSTR; }
-int js_isprimitive(js_State *J, int idx) { return stackidx(J, idx)->type != JS_TOBJECT; }
-int js_isobject(js_State *J, int idx) { return stackidx(J, idx)->type == JS_TOBJECT; }
-int js_iscoercible(js_State *J, int idx) { js_Value *v = stackidx(J, idx); return v->type != JS_TUNDEFINED && v->type != JS_TNULL; }
+int js_isdefined(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) != JS_TUNDEFINED; }
+int js_isundefined(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) == JS_TUNDEFINED; }
+int js_isnull(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) == JS_TNULL; }
+int js_isboolean(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) == JS_TBOOLEAN; }
+int js_isnumber(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) == JS_TNUMBER; }
+int js_isstring(js_State *J, int idx) { enum js_Type t = JSV_TYPE(stackidx(J, idx)); return t == JS_TSHRSTR || t == JS_TLITSTR || t == JS_TMEMSTR; }
+int js_isprimitive(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) != JS_TOBJECT; }
+int js_isobject(js_State *J, int idx) { return JSV_TYPE(stackidx(J, idx)) == JS_TOBJECT; }
+int js_iscoercible(js_State *J, int idx) { js_Value *v = stackidx(J, idx); return JSV_TYPE(v) != JS_TUNDEFINED && JSV_TYPE(v) != JS_TNULL; }
 
 int js_iscallable(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	if (v->type == JS_TOBJECT)
-		return v->u.object->type == JS_CFUNCTION ||
-			v->u.object->type == JS_CSCRIPT ||
-			v->u.object->type == JS_CCFUNCTION;
+	if (JSV_TYPE(v) == JS_TOBJECT)
+		return JSV_OBJECT(v)->type == JS_CFUNCTION ||
+			JSV_OBJECT(v)->type == JS_CSCRIPT ||
+			JSV_OBJECT(v)->type == JS_CCFUNCTION;
 	return 0;
 }
 
 int js_isarray(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	return v->type == JS_TOBJECT && v->u.object->type == JS_CARRAY;
+	return JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CARRAY;
 }
 
 int js_isregexp(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	return v->type == JS_TOBJECT && v->u.object->type == JS_CREGEXP;
+	return JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CREGEXP;
 }
 
 int js_isuserdata(js_State *J, int idx, const char *tag)
 {
 	js_Value *v = stackidx(J, idx);
-	if (v->type == JS_TOBJECT && v->u.object->type == JS_CUSERDATA)
-		return !strcmp(tag, v->u.object->u.user.tag);
+	if (JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CUSERDATA)
+		return !strcmp(tag, JSV_OBJECT(v)->u.user.tag);
 	return 0;
 }
 
 int js_iserror(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	return v->type == JS_TOBJECT && v->u.object->type == JS_CERROR;
+	return JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CERROR;
 }
 
 const char *js_typeof(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
 	case JS_TSHRSTR: return "string";
 	case JS_TUNDEFINED: return "undefined";
@@ -265,7 +416,7 @@ const char *js_typeof(js_State *J, int idx)
 	case JS_TLITSTR: return "string";
 	case JS_TMEMSTR: return "string";
 	case JS_TOBJECT:
-		if (v->u.object->type == JS_CFUNCTION || v->u.object->type == JS_CCFUNCTION)
+		if (JSV_OBJECT(v)->type == JS_CFUNCTION || JSV_OBJECT(v)->type == JS_CCFUNCTION)
 			return "function";
 		return "object";
 	}
@@ -274,7 +425,7 @@ const char *js_typeof(js_State *J, int idx)
 int js_type(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
 	case JS_TSHRSTR: return JS_ISSTRING;
 	case JS_TUNDEFINED: return JS_ISUNDEFINED;
@@ -284,7 +435,7 @@ int js_type(js_State *J, int idx)
 	case JS_TLITSTR: return JS_ISSTRING;
 	case JS_TMEMSTR: return JS_ISSTRING;
 	case JS_TOBJECT:
-		if (v->u.object->type == JS_CFUNCTION || v->u.object->type == JS_CCFUNCTION)
+		if (JSV_OBJECT(v)->type == JS_CFUNCTION || JSV_OBJECT(v)->type == JS_CCFUNCTION)
 			return JS_ISFUNCTION;
 		return JS_ISOBJECT;
 	}
@@ -302,17 +453,26 @@ double js_tonumber(js_State *J, int idx)
 
 int js_tointeger(js_State *J, int idx)
 {
-	return jsV_numbertointeger(jsV_tonumber(J, stackidx(J, idx)));
+	js_Value *v = stackidx(J, idx);
+	if (JSV_ISINTEGER(v))
+		return JSV_INTEGER(v);
+	return jsV_numbertointeger(jsV_tonumber(J, v));
 }
 
 int js_toint32(js_State *J, int idx)
 {
-	return jsV_numbertoint32(jsV_tonumber(J, stackidx(J, idx)));
+	js_Value *v = stackidx(J, idx);
+	if (JSV_ISINTEGER(v))
+		return JSV_INTEGER(v);
+	return jsV_numbertoint32(jsV_tonumber(J, v));
 }
 
 unsigned int js_touint32(js_State *J, int idx)
 {
-	return jsV_numbertouint32(jsV_tonumber(J, stackidx(J, idx)));
+	js_Value *v = stackidx(J, idx);
+	if (JSV_ISINTEGER(v))
+		return JSV_INTEGER(v);
+	return jsV_numbertouint32(jsV_tonumber(J, v));
 }
 
 short js_toint16(js_State *J, int idx)
@@ -343,28 +503,28 @@ void js_toprimitive(js_State *J, int idx, int hint)
 js_Regexp *js_toregexp(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	if (v->type == JS_TOBJECT && v->u.object->type == JS_CREGEXP)
-		return &v->u.object->u.r;
+	if (JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CREGEXP)
+		return &JSV_OBJECT(v)->u.r;
 	js_typeerror(J, "not a regexp");
 }
 
 void *js_touserdata(js_State *J, int idx, const char *tag)
 {
 	js_Value *v = stackidx(J, idx);
-	if (v->type == JS_TOBJECT && v->u.object->type == JS_CUSERDATA)
-		if (!strcmp(tag, v->u.object->u.user.tag))
-			return v->u.object->u.user.data;
+	if (JSV_TYPE(v) == JS_TOBJECT && JSV_OBJECT(v)->type == JS_CUSERDATA)
+		if (!strcmp(tag, JSV_OBJECT(v)->u.user.tag))
+			return JSV_OBJECT(v)->u.user.data;
 	js_typeerror(J, "not a %s", tag);
 }
 
 static js_Object *jsR_tofunction(js_State *J, int idx)
 {
 	js_Value *v = stackidx(J, idx);
-	if (v->type == JS_TUNDEFINED || v->type == JS_TNULL)
+	if (JSV_TYPE(v) == JS_TUNDEFINED || JSV_TYPE(v) == JS_TNULL)
 		return NULL;
-	if (v->type == JS_TOBJECT)
-		if (v->u.object->type == JS_CFUNCTION || v->u.object->type == JS_CCFUNCTION)
-			return v->u.object;
+	if (JSV_TYPE(v) == JS_TOBJECT)
+		if (JSV_OBJECT(v)->type == JS_CFUNCTION || JSV_OBJECT(v)->type == JS_CCFUNCTION)
+			return JSV_OBJECT(v);
 	js_typeerror(J, "not a function");
 }
 
@@ -378,9 +538,13 @@ int js_gettop(js_State *J)
 void js_pop(js_State *J, int n)
 {
 	TOP -= n;
-	if (TOP < BOT) {
-		TOP = BOT;
-		js_error(J, "stack underflow!");
+	if (TOP <= BOT) {
+		if (TOP < BOT) {
+			TOP = BOT;
+			js_error(J, "stack underflow!");
+		}
+		if (TOP == 0 && J->oldstackcount > 0)
+			jsR_freestacks(J);
 	}
 }
 
@@ -520,46 +684,60 @@ static void js_pushrune(js_State *J, Rune rune)
 static int jsR_hasproperty(js_State *J, js_Object *obj, const char *name)
 {
 	js_Property *ref;
+	js_Shape *shape;
+	js_Object *holder;
 	int k;
 
 	if (obj->type == JS_CARRAY) {
-		if (!strcmp(name, "length")) {
+		if (name == JS_ATOM(J, length)) {
 			js_pushnumber(J, obj->u.a.length);
 			return 1;
 		}
+		if (obj->u.a.flat_length > 0 && js_isarrayindex(J, name, &k)) {
+			if (k < obj->u.a.flat_length) {
+				js_pushvalue(J, obj->u.a.array[k]);
+				return 1;
+			}
+		}
 	}
 
 	else if (obj->type == JS_CSTRING) {
-		if (!strcmp(name, "length")) {
+		if (name == JS_ATOM(J, length)) {
 			js_pushnumber(J, obj->u.s.length);
 			return 1;
 		}
 		if (js_isarrayindex(J, name, &k)) {
 			if (k >= 0 && k < obj->u.s.length) {
-				js_pushrune(J, js_runeat(J, obj->u.s.string, k));
+				if (obj->u.s.memstr) {
+					Rune rune;
+					chartorune(&rune, jsV_utfidxtoptr(J, obj->u.s.memstr, k));
+					js_pushrune(J, rune);
+				} else {
+					js_pushrune(J, js_runeat(J, obj->u.s.string, k));
+				}
 				return 1;
 			}
 		}
 	}
 
 	else if (obj->type == JS_CREGEXP) {
-		if (!strcmp(name, "source")) {
+		if (name == JS_ATOM(J, source)) {
 			js_pushstring(J, obj->u.r.source);
 			return 1;
 		}
-		if (!strcmp(name, "global")) {
+		if (name == JS_ATOM(J, global)) {
 			js_pushboolean(J, obj->u.r.flags & JS_REGEXP_G);
 			return 1;
 		}
-		if (!strcmp(name, "ignoreCase")) {
+		if (name == JS_ATOM(J, ignoreCase)) {
 			js_pushboolean(J, obj->u.r.flags & JS_REGEXP_I);
 			return 1;
 		}
-		if (!strcmp(name, "multiline")) {
+		if (name == JS_ATOM(J, multiline)) {
 			js_pushboolean(J, obj->u.r.flags & JS_REGEXP_M);
 			return 1;
 		}
-		if (!strcmp(name, "lastIndex")) {
+		if (name == JS_ATOM(J, lastIndex)) {
 			js_pushnumber(J, obj->u.r.last);
 			return 1;
 		}
@@ -570,7 +748,11 @@ static int jsR_hasproperty(js_State *J, js_Object *obj, const char *name)
 			return 1;
 	}
 
-	ref = jsV_getproperty(J, obj, name);
+	holder = jsV_getproperty(J, obj, name, &ref, &shape);
+	if (shape) {
+		js_pushvalue(J, holder->slots[shape->slot]);
+		return 1;
+	}
 	if (ref) {
 		if (ref->getter) {
 			js_pushobject(J, ref->getter);
@@ -595,11 +777,14 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name, int t
 {
 	js_Value *value = stackidx(J, -1);
 	js_Property *ref;
+	js_Shape *shape;
+	js_Value *slot;
 	int k;
 	int own;
+	int append = 0;
 
 	if (obj->type == JS_CARRAY) {
-		if (!strcmp(name, "length")) {
+		if (name == JS_ATOM(J, length)) {
 			double rawlen = jsV_tonumber(J, value);
 			int newlen = jsV_numbertointeger(rawlen);
 			if (newlen != rawlen || newlen < 0)
@@ -607,13 +792,20 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name, int t
 			jsV_resizearray(J, obj, newlen);
 			return;
 		}
-		if (js_isarrayindex(J, name, &k))
+		if (js_isarrayindex(J, name, &k)) {
+			if (k < obj->u.a.flat_length) {
+				obj->u.a.array[k] = *value;
+				jsG_barrierelement(J, obj, &obj->u.a.array[k]);
+				return;
+			}
 			if (k >= obj->u.a.length)
 				obj->u.a.length = k + 1;
+			append = (k == obj->u.a.flat_length);
+		}
 	}
 
 	else if (obj->type == JS_CSTRING) {
-		if (!strcmp(name, "length"))
+		if (name == JS_ATOM(J, length))
 			goto readonly;
 		if (js_isarrayindex(J, name, &k))
 			if (k >= 0 && k < obj->u.s.length)
@@ -621,11 +813,11 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name, int t
 	}
 
 	else if (obj->type == JS_CREGEXP) {
-		if (!strcmp(name, "source")) goto readonly;
-		if (!strcmp(name, "global")) goto readonly;
-		if (!strcmp(name, "ignoreCase")) goto readonly;
-		if (!strcmp(name, "multiline")) goto readonly;
-		if (!strcmp(name, "lastIndex")) {
+		if (name == JS_ATOM(J, source)) goto readonly;
+		if (name == JS_ATOM(J, global)) goto readonly;
+		if (name == JS_ATOM(J, ignoreCase)) goto readonly;
+		if (name == JS_ATOM(J, multiline)) goto readonly;
+		if (name == JS_ATOM(J, lastIndex)) {
 			obj->u.r.last = jsV_tointeger(J, value);
 			return;
 		}
@@ -637,7 +829,16 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name, int t
 	}
 
 	/* First try to find a setter in prototype chain */
-	ref = jsV_getpropertyx(J, obj, name, &own);
+	own = jsV_getproperty(J, obj, name, &ref, &shape) == obj;
+	if (shape) {
+		if (shape->atts & JS_READONLY)
+			goto readonly;
+		if (own) {
+			jsG_barrier(J, obj);
+			obj->slots[shape->slot] = *value;
+			return;
+		}
+	}
 	if (ref) {
 		if (ref->setter) {
 			js_pushobject(J, ref->setter);
@@ -662,13 +863,21 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name, int t
 				js_typeerror(J, "cannot create property '%s' on transient object", name);
 			return;
 		}
+		if (append && jsV_appendarray(J, obj, value))
+			return;
+		slot = jsV_addslot(J, obj, name, 0);
+		if (slot) {
+			*slot = *value;
+			return;
+		}
 		ref = jsV_setproperty(J, obj, name);
 	}
 
 	if (ref) {
-		if (!(ref->atts & JS_READONLY))
+		if (!(ref->atts & JS_READONLY)) {
+			jsG_barrier(J, obj);
 			ref->value = *value;
-		else
+		} else
 			goto readonly;
 	}
 
@@ -684,15 +893,30 @@ static void jsR_defproperty(js_State *J, js_Object *obj, const char *name,
 	int throw)
 {
 	js_Property *ref;
+	js_Shape *shape;
+	js_Value *slot;
 	int k;
 
 	if (obj->type == JS_CARRAY) {
-		if (!strcmp(name, "length"))
+		if (name == JS_ATOM(J, length))
 			goto readonly;
+		if (obj->u.a.flat_length > 0 && js_isarrayindex(J, name, &k)) {
+			if (k < obj->u.a.flat_length) {
+				if (!atts && !getter && !setter) {
+					if (value) {
+						obj->u.a.array[k] = *value;
+						jsG_barrierelement(J, obj, &obj->u.a.array[k]);
+					}
+					return;
+				}
+				/* attributes and accessors only live in the property tree */
+				jsV_unflattenarray(J, obj, k);
+			}
+		}
 	}
 
 	else if (obj->type == JS_CSTRING) {
-		if (!strcmp(name, "length"))
+		if (name == JS_ATOM(J, length))
 			goto readonly;
 		if (js_isarrayindex(J, name, &k))
 			if (k >= 0 && k < obj->u.s.length)
@@ -700,11 +924,11 @@ static void jsR_defproperty(js_State *J, js_Object *obj, const char *name,
 	}
 
 	else if (obj->type == JS_CREGEXP) {
-		if (!strcmp(name, "source")) goto readonly;
-		if (!strcmp(name, "global")) goto readonly;
-		if (!strcmp(name, "ignoreCase")) goto readonly;
-		if (!strcmp(name, "multiline")) goto readonly;
-		if (!strcmp(name, "lastIndex")) goto readonly;
+		if (name == JS_ATOM(J, source)) goto readonly;
+		if (name == JS_ATOM(J, global)) goto readonly;
+		if (name == JS_ATOM(J, ignoreCase)) goto readonly;
+		if (name == JS_ATOM(J, multiline)) goto readonly;
+		if (name == JS_ATOM(J, lastIndex)) goto readonly;
 	}
 
 	else if (obj->type == JS_CUSERDATA) {
@@ -712,6 +936,30 @@ static void jsR_defproperty(js_State *J, js_Object *obj, const char *name,
 			return;
 	}
 
+	/* Data properties with the same attributes can stay in shape mode */
+	if (obj->shape && !getter && !setter) {
+		shape = jsV_getownshape(obj, name);
+		if (shape) {
+			if ((shape->atts | atts) == shape->atts) {
+				if (!value)
+					return;
+				if (!(shape->atts & JS_READONLY)) {
+					jsG_barrier(J, obj);
+					obj->slots[shape->slot] = *value;
+				} else if (J->strict)
+					js_typeerror(J, "'%s' is read-only", name);
+				return;
+			}
+		} else {
+			slot = jsV_addslot(J, obj, name, atts);
+			if (slot) {
+				if (value)
+					*slot = *value;
+				return;
+			}
+		}
+	}
+
 	ref = jsV_setproperty(J, obj, name);
 	if (ref) {
 		if (value) {
@@ -745,15 +993,24 @@ readonly:
 static int jsR_delproperty(js_State *J, js_Object *obj, const char *name)
 {
 	js_Property *ref;
+	js_Shape *shape;
 	int k;
 
 	if (obj->type == JS_CARRAY) {
-		if (!strcmp(name, "length"))
+		if (name == JS_ATOM(J, length))
 			goto dontconf;
+		if (obj->u.a.flat_length > 0 && js_isarrayindex(J, name, &k)) {
+			if (k < obj->u.a.flat_length) {
+				/* leave a hole: the elements after it move to the tree */
+				jsV_unflattenarray(J, obj, k + 1);
+				obj->u.a.flat_length = k;
+				return 1;
+			}
+		}
 	}
 
 	else if (obj->type == JS_CSTRING) {
-		if (!strcmp(name, "length"))
+		if (name == JS_ATOM(J, length))
 			goto dontconf;
 		if (js_isarrayindex(J, name, &k))
 			if (k >= 0 && k < obj->u.s.length)
@@ -761,11 +1018,11 @@ static int jsR_delproperty(js_State *J, js_Object *obj, const char *name)
 	}
 
 	else if (obj->type == JS_CREGEXP) {
-		if (!strcmp(name, "source")) goto dontconf;
-		if (!strcmp(name, "global")) goto dontconf;
-		if (!strcmp(name, "ignoreCase")) goto dontconf;
-		if (!strcmp(name, "multiline")) goto dontconf;
-		if (!strcmp(name, "lastIndex")) goto dontconf;
+		if (name == JS_ATOM(J, source)) goto dontconf;
+		if (name == JS_ATOM(J, global)) goto dontconf;
+		if (name == JS_ATOM(J, ignoreCase)) goto dontconf;
+		if (name == JS_ATOM(J, multiline)) goto dontconf;
+		if (name == JS_ATOM(J, lastIndex)) goto dontconf;
 	}
 
 	else if (obj->type == JS_CUSERDATA) {
@@ -773,6 +1030,16 @@ static int jsR_delproperty(js_State *J, js_Object *obj, const char *name)
 			return 1;
 	}
 
+	if (obj->shape) {
+		shape = jsV_getownshape(obj, name);
+		if (shape) {
+			if (shape->atts & JS_DONTCONF)
+				goto dontconf;
+			jsV_delproperty(J, obj, name);
+		}
+		return 1;
+	}
+
 	ref = jsV_getownproperty(J, obj, name);
 	if (ref) {
 		if (ref->atts & JS_DONTCONF)
@@ -787,21 +1054,165 @@ dontconf:
 	return 0;
 }
 
-/* Registry, global and object property accessors */
+/* Integer keyed property access with fast paths for dense arrays */
+
+static int jsR_hasindex(js_State *J, js_Object *obj, int k)
+{
+	char buf[32];
+	if (obj->type == JS_CARRAY && k >= 0 && k < obj->u.a.flat_length) {
+		js_pushvalue(J, obj->u.a.array[k]);
+		return 1;
+	}
+	return jsR_hasproperty(J, obj, js_intern(J, js_itoa(buf, k)));
+}
+
+static void jsR_getindex(js_State *J, js_Object *obj, int k)
+{
+	if (!jsR_hasindex(J, obj, k))
+		js_pushundefined(J);
+}
+
+static void jsR_setindex(js_State *J, js_Object *obj, int k, int transient)
+{
+	char buf[32];
+	if (obj->type == JS_CARRAY && k >= 0 && k < obj->u.a.flat_length) {
+		obj->u.a.array[k] = *stackidx(J, -1);
+		jsG_barrierelement(J, obj, &obj->u.a.array[k]);
+	} else
+		jsR_setproperty(J, obj, js_intern(J, js_itoa(buf, k)), transient);
+}
+
+static int jsR_delindex(js_State *J, js_Object *obj, int k)
+{
+	char buf[32];
+	if (obj->type == JS_CARRAY && k >= 0 && k == obj->u.a.flat_length - 1) {
+		obj->u.a.flat_length = k;
+		return 1;
+	}
+	return jsR_delproperty(J, obj, js_intern(J, js_itoa(buf, k)));
+}
+
+/* Check if a number value can be used as an array index as is */
+static int jsR_isindexnumber(js_Value *v, int *k)
+{
+	if (JSV_ISINTEGER(v)) {
+		*k = JSV_INTEGER(v);
+		return *k >= 0 && *k < INT_MAX;
+	}
+	if (JSV_TYPE(v) == JS_TNUMBER && JSV_NUMBER(v) >= 0 && JSV_NUMBER(v) < INT_MAX) {
+		*k = (int)JSV_NUMBER(v);
+		return *k == JSV_NUMBER(v);
+	}
+	return 0;
+}
+
+/*
+	Property caches for OP_GETPROP_S and OP_SETPROP_S. Each access site
+	remembers the shapes of the last few objects it saw, and the slot of
+	the property on the object itself or on its direct prototype. Shapes
+	describe all own properties of an object, so a matching shape (and
+	prototype shape) means the property is still in the same place.
+	Deeper prototype chains are not cached, since a property added higher
+	up in the chain could then shadow the cached one unnoticed.
+*/
+
+/* Names that jsR_hasproperty resolves before looking at properties */
+static int jsR_isspecialname(js_State *J, js_Object *obj, const char *name)
+{
+	switch (obj->type) {
+	case JS_CARRAY:
+	case JS_CSTRING:
+		return name == JS_ATOM(J, length);
+	case JS_CREGEXP:
+	case JS_CUSERDATA:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void jsR_fillcache(js_State *J, js_PropCache *cache, js_Object *obj, js_Object *holder, js_Shape *shape)
+{
+	memmove(cache + 1, cache, (JS_PROPCACHE - 1) * sizeof *cache);
+	cache->shape = obj->shape;
+	cache->holder = holder == obj ? NULL : holder;
+	cache->holdershape = holder->shape;
+	cache->slot = shape->slot;
+	/* the function holding the cache may already be marked */
+	if (J->gcstate == JS_GCMARK)
+		jsG_markcache(J, cache);
+}
+
+static int jsR_getcached(js_State *J, js_PropCache *cache, js_Object *obj, const char *name)
+{
+	js_Property *ref;
+	js_Shape *shape;
+	js_Object *holder;
+	int i;
+
+	for (i = 0; i < JS_PROPCACHE && cache[i].shape; ++i) {
+		if (cache[i].shape == obj->shape) {
+			holder = cache[i].holder;
+			if (!holder) {
+				js_pushvalue(J, obj->slots[cache[i].slot]);
+				return 1;
+			}
+			if (holder == obj->prototype && holder->shape == cache[i].holdershape) {
+				js_pushvalue(J, holder->slots[cache[i].slot]);
+				return 1;
+			}
+		}
+	}
+
+	if (!obj->shape || jsR_isspecialname(J, obj, name))
+		return 0;
+	holder = jsV_getproperty(J, obj, name, &ref, &shape);
+	if (!shape)
+		return 0;
+	if (holder == obj || holder == obj->prototype)
+		jsR_fillcache(J, cache, obj, holder, shape);
+	js_pushvalue(J, holder->slots[shape->slot]);
+	return 1;
+}
+
+static int jsR_setcached(js_State *J, js_PropCache *cache, js_Object *obj)
+{
+	int i;
+	for (i = 0; i < JS_PROPCACHE && cache[i].shape; ++i) {
+		if (cache[i].shape == obj->shape && !cache[i].holder) {
+			jsG_barrier(J, obj);
+			obj->slots[cache[i].slot] = *stackidx(J, -1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void jsR_setcache(js_State *J, js_PropCache *cache, js_Object *obj, const char *name)
+{
+	js_Shape *shape;
+	if (obj->shape) {
+		shape = jsV_getownshape(obj, name);
+		if (shape && !(shape->atts & JS_READONLY))
+			jsR_fillcache(J, cache, obj, obj, shape);
+	}
+}
+
+/* Registry, global and object property accessors; names from the API are interned */
 
 const char *js_ref(js_State *J)
 {
 	js_Value *v = stackidx(J, -1);
 	const char *s;
 	char buf[32];
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	case JS_TUNDEFINED: s = "_Undefined"; break;
 	case JS_TNULL: s = "_Null"; break;
 	case JS_TBOOLEAN:
-		s = v->u.boolean ? "_True" : "_False";
+		s = JSV_BOOLEAN(v) ? "_True" : "_False";
 		break;
 	case JS_TOBJECT:
-		sprintf(buf, "%p", (void*)v->u.object);
+		sprintf(buf, "%p", (void*)JSV_OBJECT(v));
 		s = js_intern(J, buf);
 		break;
 	default:
@@ -820,73 +1231,94 @@ void js_unref(js_State *J, const char *ref)
 
 void js_getregistry(js_State *J, const char *name)
 {
-	jsR_getproperty(J, J->R, name);
+	jsR_getproperty(J, J->R, js_intern(J, name));
 }
 
 void js_setregistry(js_State *J, const char *name)
 {
-	jsR_setproperty(J, J->R, name, 0);
+	jsR_setproperty(J, J->R, js_intern(J, name), 0);
 	js_pop(J, 1);
 }
 
 void js_delregistry(js_State *J, const char *name)
 {
-	jsR_delproperty(J, J->R, name);
+	jsR_delproperty(J, J->R, js_intern(J, name));
 }
 
 void js_getglobal(js_State *J, const char *name)
 {
-	jsR_getproperty(J, J->G, name);
+	jsR_getproperty(J, J->G, js_intern(J, name));
 }
 
 void js_setglobal(js_State *J, const char *name)
 {
-	jsR_setproperty(J, J->G, name, 0);
+	jsR_setproperty(J, J->G, js_intern(J, name), 0);
 	js_pop(J, 1);
 }
 
 void js_defglobal(js_State *J, const char *name, int atts)
 {
-	jsR_defproperty(J, J->G, name, atts, stackidx(J, -1), NULL, NULL, 0);
+	jsR_defproperty(J, J->G, js_intern(J, name), atts, stackidx(J, -1), NULL, NULL, 0);
 	js_pop(J, 1);
 }
 
 void js_delglobal(js_State *J, const char *name)
 {
-	jsR_delproperty(J, J->G, name);
+	jsR_delproperty(J, J->G, js_intern(J, name));
 }
 
 void js_getproperty(js_State *J, int idx, const char *name)
 {
-	jsR_getproperty(J, js_toobject(J, idx), name);
+	jsR_getproperty(J, js_toobject(J, idx), js_intern(J, name));
 }
 
 void js_setproperty(js_State *J, int idx, const char *name)
 {
-	jsR_setproperty(J, js_toobject(J, idx), name, !js_isobject(J, idx));
+	jsR_setproperty(J, js_toobject(J, idx), js_intern(J, name), !js_isobject(J, idx));
 	js_pop(J, 1);
 }
 
 void js_defproperty(js_State *J, int idx, const char *name, int atts)
 {
-	jsR_defproperty(J, js_toobject(J, idx), name, atts, stackidx(J, -1), NULL, NULL, 1);
+	jsR_defproperty(J, js_toobject(J, idx), js_intern(J, name), atts, stackidx(J, -1), NULL, NULL, 1);
 	js_pop(J, 1);
 }
 
 void js_delproperty(js_State *J, int idx, const char *name)
 {
-	jsR_delproperty(J, js_toobject(J, idx), name);
+	jsR_delproperty(J, js_toobject(J, idx), js_intern(J, name));
 }
 
 void js_defaccessor(js_State *J, int idx, const char *name, int atts)
 {
-	jsR_defproperty(J, js_toobject(J, idx), name, atts, NULL, jsR_tofunction(J, -2), jsR_tofunction(J, -1), 1);
+	jsR_defproperty(J, js_toobject(J, idx), js_intern(J, name), atts, NULL, jsR_tofunction(J, -2), jsR_tofunction(J, -1), 1);
 	js_pop(J, 2);
 }
 
 int js_hasproperty(js_State *J, int idx, const char *name)
 {
-	return jsR_hasproperty(J, js_toobject(J, idx), name);
+	return jsR_hasproperty(J, js_toobject(J, idx), js_intern(J, name));
+}
+
+int js_hasindex(js_State *J, int idx, int i)
+{
+	return jsR_hasindex(J, js_toobject(J, idx), i);
+}
+
+void js_getindex(js_State *J, int idx, int i)
+{
+	jsR_getindex(J, js_toobject(J, idx), i);
+}
+
+void js_setindex(js_State *J, int idx, int i)
+{
+	jsR_setindex(J, js_toobject(J, idx), i, !js_isobject(J, idx));
+	js_pop(J, 1);
+}
+
+void js_delindex(js_State *J, int idx, int i)
+{
+	jsR_delindex(J, js_toobject(J, idx), i);
 }
 
 /* Iterator */
@@ -905,14 +1337,45 @@ const char *js_nextiterator(js_State *J, int idx)
 
 js_Environment *jsR_newenvironment(js_State *J, js_Object *vars, js_Environment *outer)
 {
-	js_Environment *E = js_malloc(J, sizeof *E);
-	E->gcmark = 0;
+	js_Environment *E;
+	jsG_grow(J, sizeof *E);
+	E = js_malloccell(J, sizeof *E);
+	E->gcmark = JS_NEWMARK(J);
 	E->gcnext = J->gcenv;
 	J->gcenv = E;
-	++J->gccounter;
 
 	E->outer = outer;
 	E->variables = vars;
+	E->slots = NULL;
+	E->count = 0;
+	return E;
+}
+
+js_Environment *jsR_newslotenvironment(js_State *J, int count, js_Environment *outer)
+{
+	js_Environment *E;
+	int i;
+	jsG_grow(J, sizeof *E + count * (int)sizeof *E->slots);
+	E = js_malloccell(J, sizeof *E + count * (int)sizeof *E->slots);
+	E->gcmark = JS_NEWMARK(J);
+	E->gcnext = J->gcenv;
+	J->gcenv = E;
+
+	E->outer = outer;
+	E->variables = NULL;
+	E->slots = (js_Value*)(E + 1);
+	E->count = count;
+	for (i = 0; i < count; ++i)
+		JSV_SETUNDEFINED(&E->slots[i]);
+	return E;
+}
+
+/* Slot environment of a function 'depth' levels out from the one running */
+static js_Environment *jsR_outerslots(js_State *J, int lightweight, int depth)
+{
+	js_Environment *E = lightweight ? J->E : J->E->outer;
+	while (--depth > 0)
+		E = E->outer;
 	return E;
 }
 
@@ -924,8 +1387,19 @@ static void js_initvar(js_State *J, const char *name, int idx)
 static int js_hasvar(js_State *J, const char *name)
 {
 	js_Environment *E = J->E;
+	js_Property *ref;
+	js_Shape *shape;
+	js_Object *holder;
 	do {
-		js_Property *ref = jsV_getproperty(J, E->variables, name);
+		if (!E->variables) {
+			E = E->outer;
+			continue;
+		}
+		holder = jsV_getproperty(J, E->variables, name, &ref, &shape);
+		if (shape) {
+			js_pushvalue(J, holder->slots[shape->slot]);
+			return 1;
+		}
 		if (ref) {
 			if (ref->getter) {
 				js_pushobject(J, ref->getter);
@@ -944,8 +1418,23 @@ static int js_hasvar(js_State *J, const char *name)
 static void js_setvar(js_State *J, const char *name)
 {
 	js_Environment *E = J->E;
+	js_Property *ref;
+	js_Shape *shape;
+	js_Object *holder;
 	do {
-		js_Property *ref = jsV_getproperty(J, E->variables, name);
+		if (!E->variables) {
+			E = E->outer;
+			continue;
+		}
+		holder = jsV_getproperty(J, E->variables, name, &ref, &shape);
+		if (shape) {
+			if (!(shape->atts & JS_READONLY)) {
+				jsG_barrier(J, holder);
+				holder->slots[shape->slot] = *stackidx(J, -1);
+			} else if (J->strict)
+				js_typeerror(J, "'%s' is read-only", name);
+			return;
+		}
 		if (ref) {
 			if (ref->setter) {
 				js_pushobject(J, ref->setter);
@@ -955,9 +1444,10 @@ static void js_setvar(js_State *J, const char *name)
 				js_pop(J, 1);
 				return;
 			}
-			if (!(ref->atts & JS_READONLY))
+			if (!(ref->atts & JS_READONLY)) {
+				jsG_barrier(J, holder);
 				ref->value = *stackidx(J, -1);
-			else if (J->strict)
+			} else if (J->strict)
 				js_typeerror(J, "'%s' is read-only", name);
 			return;
 		}
@@ -971,8 +1461,28 @@ static void js_setvar(js_State *J, const char *name)
 static int js_delvar(js_State *J, const char *name)
 {
 	js_Environment *E = J->E;
+	js_Property *ref;
+	js_Shape *shape;
 	do {
-		js_Property *ref = jsV_getownproperty(J, E->variables, name);
+		if (!E->variables) {
+			E = E->outer;
+			continue;
+		}
+		if (E->variables->shape) {
+			shape = jsV_getownshape(E->variables, name);
+			if (shape) {
+				if (shape->atts & JS_DONTCONF) {
+					if (J->strict)
+						js_typeerror(J, "'%s' is non-configurable", name);
+					return 0;
+				}
+				jsV_delproperty(J, E->variables, name);
+				return 1;
+			}
+			E = E->outer;
+			continue;
+		}
+		ref = jsV_getownproperty(J, E->variables, name);
 		if (ref) {
 			if (ref->atts & JS_DONTCONF) {
 				if (J->strict)
@@ -989,10 +1499,57 @@ static int js_delvar(js_State *J, const char *name)
 
 /* Function calls */
 
+/* Give the environment, trace and frame stacks room for cap entries, or return 0 if out of memory */
+int jsR_resizecalls(js_State *J, int cap)
+{
+	js_Environment **envstack = J->alloc(J->actx, NULL, cap * (int)sizeof *envstack);
+	js_StackTrace *trace = J->alloc(J->actx, NULL, cap * (int)sizeof *trace);
+	js_Frame *frames = J->alloc(J->actx, NULL, cap * (int)sizeof *frames);
+	char *lo = (char*)J->frames, *hi = (char*)(J->frames + J->frametop);
+	int i;
+
+	if (!envstack || !trace || !frames) {
+		J->alloc(J->actx, envstack, 0);
+		J->alloc(J->actx, trace, 0);
+		J->alloc(J->actx, frames, 0);
+		return 0;
+	}
+
+	if (J->callcap > 0) {
+		memcpy(envstack, J->envstack, J->envtop * sizeof *envstack);
+		memcpy(trace, J->trace, (J->tracetop + 1) * sizeof *trace);
+		memcpy(frames, J->frames, J->frametop * sizeof *frames);
+		/* the callers of inlined calls find their program counter in the frames */
+		for (i = 0; i <= J->tracetop; ++i)
+			if ((char*)trace[i].pc >= lo && (char*)trace[i].pc < hi)
+				trace[i].pc = &frames[((char*)trace[i].pc - lo) / sizeof *frames].pc;
+	}
+
+	J->alloc(J->actx, J->envstack, 0);
+	J->alloc(J->actx, J->trace, 0);
+	J->alloc(J->actx, J->frames, 0);
+	J->envstack = envstack;
+	J->trace = trace;
+	J->frames = frames;
+	J->callcap = cap;
+	return 1;
+}
+
+static void jsR_growcalls(js_State *J)
+{
+	int cap = J->callcap * 2;
+	if (cap > JS_ENVLIMIT)
+		cap = JS_ENVLIMIT;
+	if (!jsR_resizecalls(J, cap))
+		js_outofmemory(J);
+}
+
 static void jsR_savescope(js_State *J, js_Environment *newE)
 {
 	if (J->envtop + 1 >= JS_ENVLIMIT)
 		js_stackoverflow(J);
+	if (J->envtop + 1 >= J->callcap)
+		jsR_growcalls(J);
 	J->envstack[J->envtop++] = J->E;
 	J->E = newE;
 }
@@ -1002,13 +1559,50 @@ static void jsR_restorescope(js_State *J)
 	J->E = J->envstack[--J->envtop];
 }
 
-static void jsR_calllwfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
+/* Push an arguments object for the n values from stack index argv */
+static void jsR_newarguments(js_State *J, int argv, int n)
+{
+	int i;
+	js_newarguments(J);
+	if (!J->strict) {
+		js_currentfunction(J);
+		js_defproperty(J, -2, "callee", JS_DONTENUM);
+	}
+	js_pushnumber(J, n);
+	js_defproperty(J, -2, "length", JS_DONTENUM);
+	for (i = 0; i < n; ++i) {
+		js_copy(J, argv + i);
+		js_setindex(J, -2, i);
+	}
+}
+
+/* Move the n arguments up past the first count stack slots and store n
+ * before them, where OP_ARGC and OP_GETARG read them. */
+static void jsR_keeparguments(js_State *J, int n, int count)
+{
+	CHECKSTACK(count + 1);
+	memmove(STACK + BOT + count + 2, STACK + BOT + 1, n * sizeof *STACK);
+	JSV_SETINTEGER(&STACK[BOT + count + 1], n);
+	TOP += count + 1;
+}
+
+static void jsR_enterlwfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
 {
-	js_Value v;
 	int i;
 
 	jsR_savescope(J, scope);
 
+	if (F->varargs) {
+		jsR_keeparguments(J, n, F->varlen);
+		for (i = 0; i < F->varlen; ++i) {
+			if (i < n && i < F->numparams)
+				STACK[BOT + i + 1] = STACK[BOT + F->varlen + i + 2];
+			else
+				JSV_SETUNDEFINED(&STACK[BOT + i + 1]);
+		}
+		return;
+	}
+
 	if (n > F->numparams) {
 		js_pop(J, n - F->numparams);
 		n = F->numparams;
@@ -1016,37 +1610,46 @@ static void jsR_calllwfunction(js_State *J, int n, js_Function *F, js_Environmen
 
 	for (i = n; i < F->varlen; ++i)
 		js_pushundefined(J);
+}
 
-	jsR_run(J, F);
-	v = *stackidx(J, -1);
-	TOP = --BOT; /* clear stack */
-	js_pushvalue(J, v);
+static void jsR_enterslotfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
+{
+	int i;
 
-	jsR_restorescope(J);
+	scope = jsR_newslotenvironment(J, F->varlen, scope);
+
+	jsR_savescope(J, scope);
+
+	if (F->arguments) {
+		jsR_newarguments(J, 1, n);
+		scope->slots[F->arguments - 1] = *stackidx(J, -1);
+		js_pop(J, 1);
+	}
+
+	for (i = 0; i < n && i < F->numparams; ++i)
+		scope->slots[i] = *stackidx(J, i + 1);
+	if (F->varargs)
+		jsR_keeparguments(J, n, 0);
+	else
+		js_pop(J, n);
 }
 
-static void jsR_callfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
+static void jsR_enterfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
 {
-	js_Value v;
 	int i;
 
+	if (!F->dynamic) {
+		jsR_enterslotfunction(J, n, F, scope);
+		return;
+	}
+
 	scope = jsR_newenvironment(J, jsV_newobject(J, JS_COBJECT, NULL), scope);
 
 	jsR_savescope(J, scope);
 
 	if (F->arguments) {
-		js_newarguments(J);
-		if (!J->strict) {
-			js_currentfunction(J);
-			js_defproperty(J, -2, "callee", JS_DONTENUM);
-		}
-		js_pushnumber(J, n);
-		js_defproperty(J, -2, "length", JS_DONTENUM);
-		for (i = 0; i < n; ++i) {
-			js_copy(J, i + 1);
-			js_setindex(J, -2, i);
-		}
-		js_initvar(J, "arguments", -1);
+		jsR_newarguments(J, 1, n);
+		js_initvar(J, JS_ATOM(J, arguments), -1);
 		js_pop(J, 1);
 	}
 
@@ -1059,15 +1662,32 @@ static void jsR_callfunction(js_State *J, int n, js_Function *F, js_Environment
 		js_initvar(J, F->vartab[i], -1);
 		js_pop(J, 1);
 	}
+}
 
-	jsR_run(J, F);
-	v = *stackidx(J, -1);
+/* Leave the return value in place of the function and its arguments */
+static void jsR_leavefunction(js_State *J)
+{
+	js_Value v = *stackidx(J, -1);
 	TOP = --BOT; /* clear stack */
 	js_pushvalue(J, v);
 
 	jsR_restorescope(J);
 }
 
+static void jsR_calllwfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
+{
+	jsR_enterlwfunction(J, n, F, scope);
+	jsR_run(J, F);
+	jsR_leavefunction(J);
+}
+
+static void jsR_callfunction(js_State *J, int n, js_Function *F, js_Environment *scope)
+{
+	jsR_enterfunction(J, n, F, scope);
+	jsR_run(J, F);
+	jsR_leavefunction(J);
+}
+
 static void jsR_callscript(js_State *J, int n, js_Function *F, js_Environment *scope)
 {
 	js_Value v;
@@ -1115,10 +1735,14 @@ static void jsR_pushtrace(js_State *J, const char *name, const char *file, int l
 {
 	if (J->tracetop + 1 == JS_ENVLIMIT)
 		js_error(J, "call stack overflow");
+	if (J->tracetop + 1 == J->callcap)
+		jsR_growcalls(J);
 	++J->tracetop;
 	J->trace[J->tracetop].name = name;
 	J->trace[J->tracetop].file = file;
 	J->trace[J->tracetop].line = line;
+	J->trace[J->tracetop].function = NULL;
+	J->trace[J->tracetop].pc = NULL;
 }
 
 void js_call(js_State *J, int n)
@@ -1131,6 +1755,10 @@ void js_call(js_State *J, int n)
 
 	obj = js_toobject(J, -n-2);
 
+	if (J->calldepth == JS_CALLLIMIT)
+		js_stackoverflow(J);
+	++J->calldepth;
+
 	savebot = BOT;
 	BOT = TOP - n - 1;
 
@@ -1152,6 +1780,7 @@ void js_call(js_State *J, int n)
 	}
 
 	BOT = savebot;
+	--J->calldepth;
 }
 
 void js_construct(js_State *J, int n)
@@ -1252,6 +1881,8 @@ void *js_savetrypc(js_State *J, js_Instruction *pc)
 	J->trybuf[J->trytop].E = J->E;
 	J->trybuf[J->trytop].envtop = J->envtop;
 	J->trybuf[J->trytop].tracetop = J->tracetop;
+	J->trybuf[J->trytop].frametop = J->frametop;
+	J->trybuf[J->trytop].calldepth = J->calldepth;
 	J->trybuf[J->trytop].top = J->top;
 	J->trybuf[J->trytop].bot = J->bot;
 	J->trybuf[J->trytop].strict = J->strict;
@@ -1266,6 +1897,8 @@ void *js_savetry(js_State *J)
 	J->trybuf[J->trytop].E = J->E;
 	J->trybuf[J->trytop].envtop = J->envtop;
 	J->trybuf[J->trytop].tracetop = J->tracetop;
+	J->trybuf[J->trytop].frametop = J->frametop;
+	J->trybuf[J->trytop].calldepth = J->calldepth;
 	J->trybuf[J->trytop].top = J->top;
 	J->trybuf[J->trytop].bot = J->bot;
 	J->trybuf[J->trytop].strict = J->strict;
@@ -1288,6 +1921,8 @@ void js_throw(js_State *J)
 		J->E = J->trybuf[J->trytop].E;
 		J->envtop = J->trybuf[J->trytop].envtop;
 		J->tracetop = J->trybuf[J->trytop].tracetop;
+		J->frametop = J->trybuf[J->trytop].frametop;
+		J->calldepth = J->trybuf[J->trytop].calldepth;
 		J->top = J->trybuf[J->trytop].top;
 		J->bot = J->trybuf[J->trytop].bot;
 		J->strict = J->trybuf[J->trytop].strict;
@@ -1317,11 +1952,30 @@ static void jsR_dumpstack(js_State *J)
 static void jsR_dumpenvironment(js_State *J, js_Environment *E, int d)
 {
 	printf("scope %d ", d);
-	js_dumpobject(J, E->variables);
+	if (E->variables) {
+		js_dumpobject(J, E->variables);
+	} else {
+		int i;
+		printf("{\n");
+		for (i = 0; i < E->count; ++i) {
+			printf("\t%d: ", i + 1);
+			js_dumpvalue(J, E->slots[i]);
+			putchar('\n');
+		}
+		printf("}\n");
+	}
 	if (E->outer)
 		jsR_dumpenvironment(J, E->outer, d+1);
 }
 
+int js_traceline(js_State *J, int n)
+{
+	js_StackTrace *t = &J->trace[n];
+	if (t->pc)
+		return jsC_pctoline(t->function, (int)(*t->pc - t->function->code) - 1);
+	return t->line;
+}
+
 void js_stacktrace(js_State *J)
 {
 	int n;
@@ -1329,7 +1983,7 @@ void js_stacktrace(js_State *J)
 	for (n = J->tracetop; n >= 0; --n) {
 		const char *name = J->trace[n].name;
 		const char *file = J->trace[n].file;
-		int line = J->trace[n].line;
+		int line = js_traceline(J, n);
 		if (line > 0) {
 			if (name[0])
 				printf("\tat %s (%s:%d)\n", name, file, line);
@@ -1343,7 +1997,7 @@ void js_stacktrace(js_State *J)
 void js_trap(js_State *J, int pc)
 {
 	if (pc > 0) {
-		js_Function *F = STACK[BOT-1].u.object->u.f.function;
+		js_Function *F = JSV_OBJECT(&STACK[BOT-1])->u.f.function;
 		printf("trap at %d in function ", pc);
 		jsC_dumpfunction(J, F);
 	}
@@ -1352,77 +2006,362 @@ void js_trap(js_State *J, int pc)
 	js_stacktrace(J);
 }
 
-static void jsR_run(js_State *J, js_Function *F)
+/* Apply a binary operator to the two topmost values and replace them with the result */
+static void jsR_binary(js_State *J, int op)
+{
+	double x, y;
+	unsigned int ux, uy;
+	int ix, iy;
+
+	switch (op) {
+	case OP_ADD:
+		js_concat(J);
+		return;
+	case OP_SHL:
+	case OP_SHR:
+		ix = js_toint32(J, -2);
+		uy = js_touint32(J, -1);
+		js_pop(J, 2);
+		js_pushnumber(J, op == OP_SHL ? ix << (uy & 0x1F) : ix >> (uy & 0x1F));
+		return;
+	case OP_USHR:
+		ux = js_touint32(J, -2);
+		uy = js_touint32(J, -1);
+		js_pop(J, 2);
+		js_pushnumber(J, ux >> (uy & 0x1F));
+		return;
+	case OP_BITAND:
+	case OP_BITXOR:
+	case OP_BITOR:
+		ix = js_toint32(J, -2);
+		iy = js_toint32(J, -1);
+		js_pop(J, 2);
+		js_pushnumber(J, op == OP_BITAND ? ix & iy : op == OP_BITXOR ? ix ^ iy : ix | iy);
+		return;
+	}
+
+	x = js_tonumber(J, -2);
+	y = js_tonumber(J, -1);
+	js_pop(J, 2);
+	switch (op) {
+	case OP_MUL: js_pushnumber(J, x * y); break;
+	case OP_DIV: js_pushnumber(J, x / y); break;
+	case OP_MOD: js_pushnumber(J, fmod(x, y)); break;
+	case OP_SUB: js_pushnumber(J, x - y); break;
+	default: js_error(J, "bad binary operator: %d", op);
+	}
+}
+
+/* Integer form of jsR_binary; returns 0 if the result is not an integer */
+static int jsR_integerbinary(int op, int x, int y, int *z)
 {
+	double d;
+	switch (op) {
+	case OP_ADD: d = (double)x + y; break;
+	case OP_SUB: d = (double)x - y; break;
+	case OP_MUL:
+		d = (double)x * y;
+		if (d == 0 && (x < 0 || y < 0))
+			return 0; /* negative zero */
+		break;
+	case OP_MOD:
+		if (x < 0 || y <= 0)
+			return 0;
+		*z = x % y;
+		return 1;
+	case OP_SHL: *z = x << (y & 0x1F); return 1;
+	case OP_SHR: *z = x >> (y & 0x1F); return 1;
+	case OP_USHR:
+		if ((unsigned int)x >> (y & 0x1F) > INT_MAX)
+			return 0;
+		*z = (unsigned int)x >> (y & 0x1F);
+		return 1;
+	case OP_BITAND: *z = x & y; return 1;
+	case OP_BITXOR: *z = x ^ y; return 1;
+	case OP_BITOR: *z = x | y; return 1;
+	default: return 0;
+	}
+	if (d < INT_MIN || d > INT_MAX)
+		return 0;
+	*z = (int)d;
+	return 1;
+}
+
+/* Number form of jsR_binary for the arithmetic operators; returns 0 for the others */
+static int jsR_numberbinary(int op, double x, double y, double *z)
+{
+	switch (op) {
+	case OP_ADD: *z = x + y; return 1;
+	case OP_SUB: *z = x - y; return 1;
+	case OP_MUL: *z = x * y; return 1;
+	case OP_DIV: *z = x / y; return 1;
+	case OP_MOD: *z = fmod(x, y); return 1;
+	default: return 0;
+	}
+}
+
+/* Pop the two topmost values and return the result of comparing them */
+static int jsR_comparison(js_State *J, int op)
+{
+	int b, okay;
+	switch (op) {
+	case OP_LT: b = js_compare(J, &okay); b = okay && b < 0; break;
+	case OP_GT: b = js_compare(J, &okay); b = okay && b > 0; break;
+	case OP_LE: b = js_compare(J, &okay); b = okay && b <= 0; break;
+	case OP_GE: b = js_compare(J, &okay); b = okay && b >= 0; break;
+	case OP_EQ: b = js_equal(J); break;
+	case OP_NE: b = !js_equal(J); break;
+	case OP_STRICTEQ: b = js_strictequal(J); break;
+	case OP_STRICTNE: b = !js_strictequal(J); break;
+	default: js_error(J, "bad comparison operator: %d", op);
+	}
+	js_pop(J, 2);
+	return b;
+}
+
+static int jsR_integercomparison(int op, int x, int y)
+{
+	switch (op) {
+	case OP_LT: return x < y;
+	case OP_GT: return x > y;
+	case OP_LE: return x <= y;
+	case OP_GE: return x >= y;
+	case OP_EQ: case OP_STRICTEQ: return x == y;
+	default: return x != y;
+	}
+}
+
+static int jsR_numbercomparison(int op, double x, double y)
+{
+	switch (op) {
+	case OP_LT: return x < y;
+	case OP_GT: return x > y;
+	case OP_LE: return x <= y;
+	case OP_GE: return x >= y;
+	case OP_EQ: case OP_STRICTEQ: return x == y;
+	default: return x != y;
+	}
+}
+
+/*
+	With JS_COMPUTEDGOTO, every opcode handler jumps straight to the next
+	handler through a table of label addresses instead of going back to the
+	switch, which gives the branch predictor one indirect jump per opcode.
+	Labels as values are a GNU C extension.
+*/
+
+#ifdef JS_COMPUTEDGOTO
+#if !defined(__GNUC__)
+#error "JS_COMPUTEDGOTO needs GCC or Clang"
+#endif
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/* F and the values derived from it are set again from the frames when OP_TRY catches */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wclobbered"
+#endif
+
+/*
+	Calls from bytecode to bytecode functions do not recurse into jsR_run.
+	The caller's state is saved in a js_Frame and the loop carries on with
+	the code of the called function; OP_RETURN picks the caller back up.
+	Only the frames above 'base' belong to this activation of jsR_run.
+*/
+
+static void jsR_run(js_State *J, js_Function *entry)
+{
+	js_Function *F = entry;
 	js_Function **FT = F->funtab;
 	const char **VT = F->vartab-1;
+	js_PropCache *cache;
 	int lightweight = F->lightweight;
+	int dynamic = F->dynamic;
 	js_Instruction *pcstart = F->code;
 	js_Instruction *pc = F->code;
+#ifndef JS_COMPUTEDGOTO
 	enum js_OpCode opcode;
+#endif
 	int offset;
 	int savestrict;
+	int base = J->frametop;
+	js_Frame *frame;
+	js_Function *callee;
 
 	const char *str;
 	js_Object *obj;
-	double x, y;
-	unsigned int ux, uy;
-	int ix, iy, okay;
+	js_Environment *env;
+	double x;
+	unsigned int ux;
+	int ix, iy;
 	int b;
 	int transient;
+	int op, rd, ra, rb;
+
+#ifdef JS_COMPUTEDGOTO
+	static const void *dispatch[] = {
+#include "oplabels.h"
+	};
+#endif
 
 	savestrict = J->strict;
 	J->strict = F->strict;
 
+	/* let stack traces look up the current line from the program counter */
+	J->trace[J->tracetop].function = F;
+	J->trace[J->tracetop].pc = &pc;
+
+/* Continue with the code of another function, or of the caller after a return or catch */
+#define SETFUNCTION(fun) \
+	F = (fun); \
+	FT = F->funtab; \
+	VT = F->vartab-1; \
+	lightweight = F->lightweight; \
+	dynamic = F->dynamic; \
+	pcstart = F->code; \
+	J->trace[J->tracetop].function = F; \
+	J->trace[J->tracetop].pc = &pc
+
+#define CURRENTFUNCTION() \
+	(J->frametop > base ? J->frames[J->frametop-1].function : entry)
+
 #define READSTRING() \
 	memcpy(&str, pc, sizeof(str)); \
 	pc += sizeof(str) / sizeof(*pc)
 
+#define READCACHE() \
+	cache = F->cachetab + *pc++ * JS_PROPCACHE
+
+/* Integer fast paths operate on the topmost stack slots in place */
+#define SV2 (&STACK[TOP-2])
+#define SV1 (&STACK[TOP-1])
+#define INTEGERS() (JSV_ISINTEGER(SV2) && JSV_ISINTEGER(SV1))
+#define FITS(x) ((x) >= INT_MIN && (x) <= INT_MAX)
+#define INTEGEROP(op) \
+	if (INTEGERS()) { \
+		JSV_SETINTEGER(SV2, JSV_INTEGER(SV2) op JSV_INTEGER(SV1)); \
+		--TOP; \
+		NEXT; \
+	}
+#define INTEGERCMP(op) \
+	if (INTEGERS()) { \
+		b = JSV_INTEGER(SV2) op JSV_INTEGER(SV1); \
+		--TOP; \
+		JSV_SETBOOLEAN(SV1, b); \
+		NEXT; \
+	}
+#define NUMBERS() (JSV_TYPE(SV2) == JS_TNUMBER && JSV_TYPE(SV1) == JS_TNUMBER)
+#define NUMBEROP(op) \
+	if (NUMBERS()) { \
+		jsR_setnumber(SV2, JSV_NUMBER(SV2) op JSV_NUMBER(SV1)); \
+		--TOP; \
+		NEXT; \
+	}
+#define NUMBERCMP(op) \
+	if (NUMBERS()) { \
+		b = JSV_NUMBER(SV2) op JSV_NUMBER(SV1); \
+		--TOP; \
+		JSV_SETBOOLEAN(SV1, b); \
+		NEXT; \
+	}
+#define ISNUMBER(v) (JSV_TYPE(v) == JS_TNUMBER)
+
+/* Local variable slots of lightweight functions, used as registers */
+#define REG(n) (&STACK[BOT + (n)])
+
+/* Collect garbage on function entry, backward jumps, catch clauses and after allocating opcodes */
+#define GCCHECK() if (J->gccounter > J->gcthresh) jsG_collect(J)
+
+#define JUMPTO(offset) \
+	do { \
+		if (pcstart + (offset) < pc) \
+			GCCHECK(); \
+		pc = pcstart + (offset); \
+	} while (0)
+
+/* Compare the two topmost values and jump unless the comparison is true */
+#define CMPJFALSE(op, cmp) \
+	offset = *pc++; \
+	if (INTEGERS()) { \
+		b = JSV_INTEGER(SV2) op JSV_INTEGER(SV1); \
+		js_pop(J, 2); \
+	} else if (NUMBERS()) { \
+		b = JSV_NUMBER(SV2) op JSV_NUMBER(SV1); \
+		js_pop(J, 2); \
+	} else { \
+		b = jsR_comparison(J, cmp); \
+	} \
+	if (!b) \
+		JUMPTO(offset); \
+	NEXT
+
+#ifdef JS_COMPUTEDGOTO
+#define CASE(op) L_##op
+#define NEXT goto *dispatch[*pc++]
+#else
+#define CASE(op) case op
+#define NEXT break
+#endif
+
+	GCCHECK();
+
+#ifdef JS_COMPUTEDGOTO
+	NEXT;
+	{
+#else
 	while (1) {
-		if (J->gccounter > J->gcthresh)
-			js_gc(J, 0);
-
-		J->trace[J->tracetop].line = *pc++;
-
 		opcode = *pc++;
 
 		switch (opcode) {
-		case OP_POP: js_pop(J, 1); break;
-		case OP_DUP: js_dup(J); break;
-		case OP_DUP2: js_dup2(J); break;
-		case OP_ROT2: js_rot2(J); break;
-		case OP_ROT3: js_rot3(J); break;
-		case OP_ROT4: js_rot4(J); break;
-
-		case OP_INTEGER:
-			js_pushnumber(J, *pc++ - 32768);
-			break;
-
-		case OP_NUMBER:
+#endif
+		CASE(OP_POP): js_pop(J, 1); NEXT;
+		CASE(OP_DUP): js_dup(J); NEXT;
+		CASE(OP_DUP2): js_dup2(J); NEXT;
+		CASE(OP_ROT2): js_rot2(J); NEXT;
+		CASE(OP_ROT3): js_rot3(J); NEXT;
+		CASE(OP_ROT4): js_rot4(J); NEXT;
+
+		CASE(OP_INTEGER):
+			js_pushinteger(J, *pc++ - 32768);
+			NEXT;
+
+		CASE(OP_NUMBER):
 			memcpy(&x, pc, sizeof(x));
 			pc += sizeof(x) / sizeof(*pc);
 			js_pushnumber(J, x);
-			break;
+			NEXT;
 
-		case OP_STRING:
+		CASE(OP_STRING):
 			READSTRING();
-			js_pushliteral(J, str);
-			break;
+			js_pushatom(J, str);
+			NEXT;
+
+		CASE(OP_MEMSTRING):
+			{
+				js_String *mem;
+				memcpy(&mem, pc, sizeof(mem));
+				pc += sizeof(mem) / sizeof(*pc);
+				js_pushmemstring(J, mem);
+			}
+			NEXT;
 
-		case OP_CLOSURE: js_newfunction(J, FT[*pc++], J->E); break;
-		case OP_NEWOBJECT: js_newobject(J); break;
-		case OP_NEWARRAY: js_newarray(J); break;
-		case OP_NEWREGEXP:
+		CASE(OP_CLOSURE): js_newfunction(J, FT[*pc++], J->E); GCCHECK(); NEXT;
+		CASE(OP_NEWOBJECT): js_newobject(J); GCCHECK(); NEXT;
+		CASE(OP_NEWARRAY): js_newarray(J); GCCHECK(); NEXT;
+		CASE(OP_NEWREGEXP):
 			READSTRING();
 			js_newregexp(J, str, *pc++);
-			break;
+			GCCHECK();
+			NEXT;
 
-		case OP_UNDEF: js_pushundefined(J); break;
-		case OP_NULL: js_pushnull(J); break;
-		case OP_TRUE: js_pushboolean(J, 1); break;
-		case OP_FALSE: js_pushboolean(J, 0); break;
+		CASE(OP_UNDEF): js_pushundefined(J); NEXT;
+		CASE(OP_NULL): js_pushnull(J); NEXT;
+		CASE(OP_TRUE): js_pushboolean(J, 1); NEXT;
+		CASE(OP_FALSE): js_pushboolean(J, 0); NEXT;
 
-		case OP_THIS:
+		CASE(OP_THIS):
 			if (J->strict) {
 				js_copy(J, 0);
 			} else {
@@ -1431,158 +2370,218 @@ static void jsR_run(js_State *J, js_Function *F)
 				else
 					js_pushglobal(J);
 			}
-			break;
+			NEXT;
 
-		case OP_CURRENT:
+		CASE(OP_CURRENT):
 			js_currentfunction(J);
-			break;
+			NEXT;
+
+		CASE(OP_ARGC):
+			CHECKSTACK(1);
+			STACK[TOP++] = STACK[BOT + (lightweight ? F->varlen : 0) + 1];
+			NEXT;
+
+		CASE(OP_GETARG):
+			iy = lightweight ? F->varlen : 0;
+			b = JSV_INTEGER(&STACK[BOT + iy + 1]);
+			if (jsR_isindexnumber(stackidx(J, -1), &ix) && ix < b) {
+				STACK[TOP-1] = STACK[BOT + iy + ix + 2];
+			} else {
+				/* not an argument, so look it up on a real arguments object */
+				jsR_newarguments(J, iy + 2, b);
+				js_rot2(J);
+				str = js_intern(J, js_tostring(J, -1));
+				obj = js_toobject(J, -2);
+				jsR_getproperty(J, obj, str);
+				js_rot3pop2(J);
+			}
+			NEXT;
 
-		case OP_GETLOCAL:
+		CASE(OP_GETLOCAL):
 			if (lightweight) {
 				CHECKSTACK(1);
 				STACK[TOP++] = STACK[BOT + *pc++];
+			} else if (!dynamic) {
+				js_pushvalue(J, J->E->slots[*pc++ - 1]);
 			} else {
 				str = VT[*pc++];
 				if (!js_hasvar(J, str))
 					js_referenceerror(J, "'%s' is not defined", str);
 			}
-			break;
+			NEXT;
 
-		case OP_SETLOCAL:
+		CASE(OP_SETLOCAL):
 			if (lightweight) {
 				STACK[BOT + *pc++] = STACK[TOP-1];
+			} else if (!dynamic) {
+				J->E->slots[*pc++ - 1] = STACK[TOP-1];
+				jsR_barrierslot(J, J->E, &STACK[TOP-1]);
 			} else {
 				js_setvar(J, VT[*pc++]);
 			}
-			break;
-
-		case OP_DELLOCAL:
-			if (lightweight) {
+			NEXT;
+
+		CASE(OP_GETUPVAL):
+			ix = *pc++;
+			iy = *pc++;
+			js_pushvalue(J, jsR_outerslots(J, lightweight, ix)->slots[iy - 1]);
+			NEXT;
+
+		CASE(OP_SETUPVAL):
+			ix = *pc++;
+			iy = *pc++;
+			env = jsR_outerslots(J, lightweight, ix);
+			env->slots[iy - 1] = STACK[TOP-1];
+			jsR_barrierslot(J, env, &STACK[TOP-1]);
+			NEXT;
+
+		CASE(OP_DELLOCAL):
+			if (lightweight || !dynamic) {
 				++pc;
 				js_pushboolean(J, 0);
 			} else {
 				b = js_delvar(J, VT[*pc++]);
 				js_pushboolean(J, b);
 			}
-			break;
+			NEXT;
 
-		case OP_GETVAR:
+		CASE(OP_GETVAR):
 			READSTRING();
 			if (!js_hasvar(J, str))
 				js_referenceerror(J, "'%s' is not defined", str);
-			break;
+			NEXT;
 
-		case OP_HASVAR:
+		CASE(OP_HASVAR):
 			READSTRING();
 			if (!js_hasvar(J, str))
 				js_pushundefined(J);
-			break;
+			NEXT;
 
-		case OP_SETVAR:
+		CASE(OP_SETVAR):
 			READSTRING();
 			js_setvar(J, str);
-			break;
+			NEXT;
 
-		case OP_DELVAR:
+		CASE(OP_DELVAR):
 			READSTRING();
 			b = js_delvar(J, str);
 			js_pushboolean(J, b);
-			break;
+			NEXT;
 
-		case OP_IN:
+		CASE(OP_IN):
 			str = js_tostring(J, -2);
 			if (!js_isobject(J, -1))
 				js_typeerror(J, "operand to 'in' is not an object");
 			b = js_hasproperty(J, -1, str);
 			js_pop(J, 2 + b);
 			js_pushboolean(J, b);
-			break;
+			NEXT;
 
-		case OP_INITARRAY:
-			js_setindex(J, -2, js_getlength(J, -2));
-			break;
+		CASE(OP_INITARRAY):
+			obj = js_toobject(J, -2);
+			jsR_setindex(J, obj, obj->u.a.length, 0);
+			js_pop(J, 1);
+			NEXT;
 
-		case OP_INITPROP:
+		CASE(OP_INITPROP):
 			obj = js_toobject(J, -3);
-			str = js_tostring(J, -2);
+			str = js_intern(J, js_tostring(J, -2));
 			jsR_setproperty(J, obj, str, 0);
 			js_pop(J, 2);
-			break;
+			NEXT;
 
-		case OP_INITGETTER:
+		CASE(OP_INITGETTER):
 			obj = js_toobject(J, -3);
-			str = js_tostring(J, -2);
+			str = js_intern(J, js_tostring(J, -2));
 			jsR_defproperty(J, obj, str, 0, NULL, jsR_tofunction(J, -1), NULL, 0);
 			js_pop(J, 2);
-			break;
+			NEXT;
 
-		case OP_INITSETTER:
+		CASE(OP_INITSETTER):
 			obj = js_toobject(J, -3);
-			str = js_tostring(J, -2);
+			str = js_intern(J, js_tostring(J, -2));
 			jsR_defproperty(J, obj, str, 0, NULL, NULL, jsR_tofunction(J, -1), 0);
 			js_pop(J, 2);
-			break;
+			NEXT;
 
-		case OP_GETPROP:
-			str = js_tostring(J, -1);
-			obj = js_toobject(J, -2);
-			jsR_getproperty(J, obj, str);
+		CASE(OP_GETPROP):
+			if (jsR_isindexnumber(stackidx(J, -1), &ix)) {
+				obj = js_toobject(J, -2);
+				jsR_getindex(J, obj, ix);
+			} else {
+				str = js_intern(J, js_tostring(J, -1));
+				obj = js_toobject(J, -2);
+				jsR_getproperty(J, obj, str);
+			}
 			js_rot3pop2(J);
-			break;
+			NEXT;
 
-		case OP_GETPROP_S:
+		CASE(OP_GETPROP_S):
 			READSTRING();
+			READCACHE();
 			obj = js_toobject(J, -1);
-			jsR_getproperty(J, obj, str);
+			if (!jsR_getcached(J, cache, obj, str))
+				jsR_getproperty(J, obj, str);
 			js_rot2pop1(J);
-			break;
+			NEXT;
 
-		case OP_SETPROP:
-			str = js_tostring(J, -2);
-			obj = js_toobject(J, -3);
-			transient = !js_isobject(J, -3);
-			jsR_setproperty(J, obj, str, transient);
+		CASE(OP_SETPROP):
+			if (jsR_isindexnumber(stackidx(J, -2), &ix)) {
+				obj = js_toobject(J, -3);
+				transient = !js_isobject(J, -3);
+				jsR_setindex(J, obj, ix, transient);
+			} else {
+				str = js_intern(J, js_tostring(J, -2));
+				obj = js_toobject(J, -3);
+				transient = !js_isobject(J, -3);
+				jsR_setproperty(J, obj, str, transient);
+			}
 			js_rot3pop2(J);
-			break;
+			NEXT;
 
-		case OP_SETPROP_S:
+		CASE(OP_SETPROP_S):
 			READSTRING();
+			READCACHE();
 			obj = js_toobject(J, -2);
-			transient = !js_isobject(J, -2);
-			jsR_setproperty(J, obj, str, transient);
+			if (!jsR_setcached(J, cache, obj)) {
+				transient = !js_isobject(J, -2);
+				jsR_setproperty(J, obj, str, transient);
+				if (!transient)
+					jsR_setcache(J, cache, obj, str);
+			}
 			js_rot2pop1(J);
-			break;
+			NEXT;
 
-		case OP_DELPROP:
-			str = js_tostring(J, -1);
+		CASE(OP_DELPROP):
+			str = js_intern(J, js_tostring(J, -1));
 			obj = js_toobject(J, -2);
 			b = jsR_delproperty(J, obj, str);
 			js_pop(J, 2);
 			js_pushboolean(J, b);
-			break;
+			NEXT;
 
-		case OP_DELPROP_S:
+		CASE(OP_DELPROP_S):
 			READSTRING();
 			obj = js_toobject(J, -1);
 			b = jsR_delproperty(J, obj, str);
 			js_pop(J, 1);
 			js_pushboolean(J, b);
-			break;
+			NEXT;
 
-		case OP_ITERATOR:
+		CASE(OP_ITERATOR):
 			if (js_iscoercible(J, -1)) {
 				obj = jsV_newiterator(J, js_toobject(J, -1), 0);
 				js_pop(J, 1);
 				js_pushobject(J, obj);
 			}
-			break;
+			NEXT;
 
-		case OP_NEXTITER:
+		CASE(OP_NEXTITER):
 			if (js_isobject(J, -1)) {
 				obj = js_toobject(J, -1);
 				str = jsV_nextiterator(J, obj);
 				if (str) {
-					js_pushliteral(J, str);
+					js_pushatom(J, str);
 					js_pushboolean(J, 1);
 				} else {
 					js_pop(J, 1);
@@ -1592,160 +2591,315 @@ static void jsR_run(js_State *J, js_Function *F)
 				js_pop(J, 1);
 				js_pushboolean(J, 0);
 			}
-			break;
+			NEXT;
 
 		/* Function calls */
 
-		case OP_EVAL:
+		CASE(OP_EVAL):
 			js_eval(J);
-			break;
-
-		case OP_CALL:
-			js_call(J, *pc++);
-			break;
+			GCCHECK();
+			NEXT;
+
+		CASE(OP_TAILCALL):
+			/* reuse the frame and trace entry of the current function */
+			ix = *pc++;
+			obj = js_iscallable(J, -ix-2) ? js_toobject(J, -ix-2) : NULL;
+			if (obj && obj->type == JS_CFUNCTION && J->frametop > base) {
+				callee = obj->u.f.function;
+				J->frames[J->frametop-1].function = callee;
+				J->trace[J->tracetop].name = callee->name;
+				J->trace[J->tracetop].file = callee->filename;
+				J->trace[J->tracetop].line = callee->line;
+				jsR_restorescope(J);
+				memmove(STACK + BOT - 1, STACK + TOP - ix - 2, (ix + 2) * sizeof *STACK);
+				TOP = BOT + ix + 1;
+				if (callee->lightweight)
+					jsR_enterlwfunction(J, ix, callee, obj->u.f.scope);
+				else
+					jsR_enterfunction(J, ix, callee, obj->u.f.scope);
+				J->strict = callee->strict;
+				SETFUNCTION(callee);
+				pc = pcstart;
+				GCCHECK();
+				NEXT;
+			}
+			goto call;
+
+		CASE(OP_CALL):
+			ix = *pc++;
+			obj = js_iscallable(J, -ix-2) ? js_toobject(J, -ix-2) : NULL;
+		call:
+			if (obj && obj->type == JS_CFUNCTION) {
+				callee = obj->u.f.function;
+				jsR_pushtrace(J, callee->name, callee->filename, callee->line);
+				/* there are fewer frames than trace entries, so this one fits */
+				frame = &J->frames[J->frametop++];
+				frame->function = callee;
+				frame->pc = pc;
+				frame->bot = BOT;
+				frame->strict = J->strict;
+				J->trace[J->tracetop-1].pc = &frame->pc;
+				BOT = TOP - ix - 1;
+				if (callee->lightweight)
+					jsR_enterlwfunction(J, ix, callee, obj->u.f.scope);
+				else
+					jsR_enterfunction(J, ix, callee, obj->u.f.scope);
+				J->strict = callee->strict;
+				SETFUNCTION(callee);
+				pc = pcstart;
+				GCCHECK();
+				NEXT;
+			}
+			js_call(J, ix);
+			GCCHECK();
+			NEXT;
 
-		case OP_NEW:
+		CASE(OP_NEW):
 			js_construct(J, *pc++);
-			break;
+			GCCHECK();
+			NEXT;
 
 		/* Unary operators */
 
-		case OP_TYPEOF:
+		CASE(OP_TYPEOF):
 			str = js_typeof(J, -1);
 			js_pop(J, 1);
 			js_pushliteral(J, str);
-			break;
+			NEXT;
 
-		case OP_POS:
+		CASE(OP_POS):
+			if (JSV_ISINTEGER(SV1))
+				NEXT;
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x);
-			break;
+			NEXT;
 
-		case OP_NEG:
+		CASE(OP_NEG):
+			if (JSV_ISINTEGER(SV1) && JSV_INTEGER(SV1) != 0 && JSV_INTEGER(SV1) != INT_MIN) {
+				JSV_SETINTEGER(SV1, -JSV_INTEGER(SV1));
+				NEXT;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, -x);
-			break;
+			NEXT;
 
-		case OP_BITNOT:
+		CASE(OP_BITNOT):
+			if (JSV_ISINTEGER(SV1)) {
+				JSV_SETINTEGER(SV1, ~JSV_INTEGER(SV1));
+				NEXT;
+			}
 			ix = js_toint32(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, ~ix);
-			break;
+			NEXT;
 
-		case OP_LOGNOT:
+		CASE(OP_LOGNOT):
 			b = js_toboolean(J, -1);
 			js_pop(J, 1);
 			js_pushboolean(J, !b);
-			break;
+			NEXT;
 
-		case OP_INC:
+		CASE(OP_INC):
+			if (JSV_ISINTEGER(SV1) && JSV_INTEGER(SV1) != INT_MAX) {
+				JSV_SETINTEGER(SV1, JSV_INTEGER(SV1) + 1);
+				NEXT;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x + 1);
-			break;
+			NEXT;
 
-		case OP_DEC:
+		CASE(OP_DEC):
+			if (JSV_ISINTEGER(SV1) && JSV_INTEGER(SV1) != INT_MIN) {
+				JSV_SETINTEGER(SV1, JSV_INTEGER(SV1) - 1);
+				NEXT;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x - 1);
-			break;
-
-		case OP_POSTINC:
+			NEXT;
+
+		CASE(OP_POSTINC):
+			if (JSV_ISINTEGER(SV1) && JSV_INTEGER(SV1) != INT_MAX) {
+				ix = JSV_INTEGER(SV1);
+				JSV_SETINTEGER(SV1, ix + 1);
+				js_pushinteger(J, ix);
+				NEXT;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x + 1);
 			js_pushnumber(J, x);
-			break;
-
-		case OP_POSTDEC:
+			NEXT;
+
+		CASE(OP_POSTDEC):
+			if (JSV_ISINTEGER(SV1) && JSV_INTEGER(SV1) != INT_MIN) {
+				ix = JSV_INTEGER(SV1);
+				JSV_SETINTEGER(SV1, ix - 1);
+				js_pushinteger(J, ix);
+				NEXT;
+			}
 			x = js_tonumber(J, -1);
 			js_pop(J, 1);
 			js_pushnumber(J, x - 1);
 			js_pushnumber(J, x);
-			break;
+			NEXT;
 
 		/* Multiplicative operators */
 
-		case OP_MUL:
-			x = js_tonumber(J, -2);
-			y = js_tonumber(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, x * y);
-			break;
-
-		case OP_DIV:
-			x = js_tonumber(J, -2);
-			y = js_tonumber(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, x / y);
-			break;
-
-		case OP_MOD:
-			x = js_tonumber(J, -2);
-			y = js_tonumber(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, fmod(x, y));
-			break;
+		CASE(OP_MUL):
+			if (INTEGERS()) {
+				x = (double)JSV_INTEGER(SV2) * JSV_INTEGER(SV1);
+				if (FITS(x) && (x != 0 || (JSV_INTEGER(SV2) >= 0 && JSV_INTEGER(SV1) >= 0))) {
+					JSV_SETINTEGER(SV2, (int)x);
+					--TOP;
+					NEXT;
+				}
+			}
+			NUMBEROP(*)
+			jsR_binary(J, OP_MUL);
+			NEXT;
+
+		CASE(OP_DIV):
+			NUMBEROP(/)
+			jsR_binary(J, OP_DIV);
+			NEXT;
+
+		CASE(OP_MOD):
+			if (INTEGERS() && JSV_INTEGER(SV2) >= 0 && JSV_INTEGER(SV1) > 0) {
+				JSV_SETINTEGER(SV2, JSV_INTEGER(SV2) % JSV_INTEGER(SV1));
+				--TOP;
+				NEXT;
+			}
+			if (NUMBERS()) {
+				jsR_setnumber(SV2, fmod(JSV_NUMBER(SV2), JSV_NUMBER(SV1)));
+				--TOP;
+				NEXT;
+			}
+			jsR_binary(J, OP_MOD);
+			NEXT;
 
 		/* Additive operators */
 
-		case OP_ADD:
+		CASE(OP_ADD):
+			if (INTEGERS()) {
+				x = (double)JSV_INTEGER(SV2) + JSV_INTEGER(SV1);
+				if (FITS(x)) {
+					JSV_SETINTEGER(SV2, (int)x);
+					--TOP;
+					NEXT;
+				}
+			}
+			NUMBEROP(+)
 			js_concat(J);
-			break;
-
-		case OP_SUB:
-			x = js_tonumber(J, -2);
-			y = js_tonumber(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, x - y);
-			break;
+			NEXT;
+
+		CASE(OP_SUB):
+			if (INTEGERS()) {
+				x = (double)JSV_INTEGER(SV2) - JSV_INTEGER(SV1);
+				if (FITS(x)) {
+					JSV_SETINTEGER(SV2, (int)x);
+					--TOP;
+					NEXT;
+				}
+			}
+			NUMBEROP(-)
+			jsR_binary(J, OP_SUB);
+			NEXT;
 
 		/* Shift operators */
 
-		case OP_SHL:
-			ix = js_toint32(J, -2);
-			uy = js_touint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ix << (uy & 0x1F));
-			break;
-
-		case OP_SHR:
-			ix = js_toint32(J, -2);
-			uy = js_touint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ix >> (uy & 0x1F));
-			break;
-
-		case OP_USHR:
-			ux = js_touint32(J, -2);
-			uy = js_touint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ux >> (uy & 0x1F));
-			break;
+		CASE(OP_SHL):
+			if (INTEGERS()) {
+				JSV_SETINTEGER(SV2, JSV_INTEGER(SV2) << (JSV_INTEGER(SV1) & 0x1F));
+				--TOP;
+				NEXT;
+			}
+			jsR_binary(J, OP_SHL);
+			NEXT;
+
+		CASE(OP_SHR):
+			if (INTEGERS()) {
+				JSV_SETINTEGER(SV2, JSV_INTEGER(SV2) >> (JSV_INTEGER(SV1) & 0x1F));
+				--TOP;
+				NEXT;
+			}
+			jsR_binary(J, OP_SHR);
+			NEXT;
+
+		CASE(OP_USHR):
+			if (INTEGERS()) {
+				ux = (unsigned int)JSV_INTEGER(SV2) >> (JSV_INTEGER(SV1) & 0x1F);
+				if (ux <= INT_MAX) {
+					JSV_SETINTEGER(SV2, ux);
+					--TOP;
+					NEXT;
+				}
+			}
+			jsR_binary(J, OP_USHR);
+			NEXT;
 
 		/* Relational operators */
 
-		case OP_LT: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b < 0); break;
-		case OP_GT: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b > 0); break;
-		case OP_LE: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b <= 0); break;
-		case OP_GE: b = js_compare(J, &okay); js_pop(J, 2); js_pushboolean(J, okay && b >= 0); break;
-
-		case OP_INSTANCEOF:
+		CASE(OP_LT):
+			INTEGERCMP(<)
+			NUMBERCMP(<)
+			js_pushboolean(J, jsR_comparison(J, OP_LT));
+			NEXT;
+
+		CASE(OP_GT):
+			INTEGERCMP(>)
+			NUMBERCMP(>)
+			js_pushboolean(J, jsR_comparison(J, OP_GT));
+			NEXT;
+
+		CASE(OP_LE):
+			INTEGERCMP(<=)
+			NUMBERCMP(<=)
+			js_pushboolean(J, jsR_comparison(J, OP_LE));
+			NEXT;
+
+		CASE(OP_GE):
+			INTEGERCMP(>=)
+			NUMBERCMP(>=)
+			js_pushboolean(J, jsR_comparison(J, OP_GE));
+			NEXT;
+
+		CASE(OP_INSTANCEOF):
 			b = js_instanceof(J);
 			js_pop(J, 2);
 			js_pushboolean(J, b);
-			break;
+			NEXT;
 
 		/* Equality */
 
-		case OP_EQ: b = js_equal(J); js_pop(J, 2); js_pushboolean(J, b); break;
-		case OP_NE: b = js_equal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
-		case OP_STRICTEQ: b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, b); break;
-		case OP_STRICTNE: b = js_strictequal(J); js_pop(J, 2); js_pushboolean(J, !b); break;
-
-		case OP_JCASE:
+		CASE(OP_EQ):
+			INTEGERCMP(==)
+			NUMBERCMP(==)
+			js_pushboolean(J, jsR_comparison(J, OP_EQ));
+			NEXT;
+
+		CASE(OP_NE):
+			INTEGERCMP(!=)
+			NUMBERCMP(!=)
+			js_pushboolean(J, jsR_comparison(J, OP_NE));
+			NEXT;
+
+		CASE(OP_STRICTEQ):
+			INTEGERCMP(==)
+			NUMBERCMP(==)
+			js_pushboolean(J, jsR_comparison(J, OP_STRICTEQ));
+			NEXT;
+
+		CASE(OP_STRICTNE):
+			INTEGERCMP(!=)
+			NUMBERCMP(!=)
+			js_pushboolean(J, jsR_comparison(J, OP_STRICTNE));
+			NEXT;
+
+		CASE(OP_JCASE):
 			offset = *pc++;
 			b = js_strictequal(J);
 			if (b) {
@@ -1754,50 +2908,45 @@ static void jsR_run(js_State *J, js_Function *F)
 			} else {
 				js_pop(J, 1);
 			}
-			break;
+			NEXT;
 
 		/* Binary bitwise operators */
 
-		case OP_BITAND:
-			ix = js_toint32(J, -2);
-			iy = js_toint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ix & iy);
-			break;
+		CASE(OP_BITAND):
+			INTEGEROP(&)
+			jsR_binary(J, OP_BITAND);
+			NEXT;
 
-		case OP_BITXOR:
-			ix = js_toint32(J, -2);
-			iy = js_toint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ix ^ iy);
-			break;
+		CASE(OP_BITXOR):
+			INTEGEROP(^)
+			jsR_binary(J, OP_BITXOR);
+			NEXT;
 
-		case OP_BITOR:
-			ix = js_toint32(J, -2);
-			iy = js_toint32(J, -1);
-			js_pop(J, 2);
-			js_pushnumber(J, ix | iy);
-			break;
+		CASE(OP_BITOR):
+			INTEGEROP(|)
+			jsR_binary(J, OP_BITOR);
+			NEXT;
 
 		/* Try and Catch */
 
-		case OP_THROW:
+		CASE(OP_THROW):
 			js_throw(J);
 
-		case OP_TRY:
+		CASE(OP_TRY):
 			offset = *pc++;
 			if (js_trypc(J, pc)) {
 				pc = J->trybuf[J->trytop].pc;
+				SETFUNCTION(CURRENTFUNCTION());
 			} else {
 				pc = pcstart + offset;
 			}
-			break;
+			NEXT;
 
-		case OP_ENDTRY:
+		CASE(OP_ENDTRY):
 			js_endtry(J);
-			break;
+			NEXT;
 
-		case OP_CATCH:
+		CASE(OP_CATCH):
 			READSTRING();
 			obj = jsV_newobject(J, JS_COBJECT, NULL);
 			js_pushobject(J, obj);
@@ -1805,53 +2954,251 @@ static void jsR_run(js_State *J, js_Function *F)
 			js_setproperty(J, -2, str);
 			J->E = jsR_newenvironment(J, obj, J->E);
 			js_pop(J, 1);
-			break;
+			NEXT;
 
-		case OP_ENDCATCH:
+		CASE(OP_ENDCATCH):
 			J->E = J->E->outer;
-			break;
+			NEXT;
 
 		/* With */
 
-		case OP_WITH:
+		CASE(OP_WITH):
 			obj = js_toobject(J, -1);
 			J->E = jsR_newenvironment(J, obj, J->E);
 			js_pop(J, 1);
-			break;
+			NEXT;
 
-		case OP_ENDWITH:
+		CASE(OP_ENDWITH):
 			J->E = J->E->outer;
-			break;
+			NEXT;
 
 		/* Branching */
 
-		case OP_DEBUGGER:
+		CASE(OP_DEBUGGER):
 			js_trap(J, (int)(pc - pcstart) - 1);
-			break;
+			NEXT;
 
-		case OP_JUMP:
-			pc = pcstart + *pc;
-			break;
+		CASE(OP_JUMP):
+			offset = *pc;
+			JUMPTO(offset);
+			NEXT;
 
-		case OP_JTRUE:
+		CASE(OP_JTRUE):
 			offset = *pc++;
 			b = js_toboolean(J, -1);
 			js_pop(J, 1);
 			if (b)
-				pc = pcstart + offset;
-			break;
+				JUMPTO(offset);
+			NEXT;
 
-		case OP_JFALSE:
+		CASE(OP_JFALSE):
 			offset = *pc++;
 			b = js_toboolean(J, -1);
 			js_pop(J, 1);
 			if (!b)
-				pc = pcstart + offset;
-			break;
-
-		case OP_RETURN:
+				JUMPTO(offset);
+			NEXT;
+
+		CASE(OP_RETURN):
+			if (J->frametop > base) {
+				frame = &J->frames[--J->frametop];
+				jsR_leavefunction(J);
+				--J->tracetop;
+				BOT = frame->bot;
+				J->strict = frame->strict;
+				pc = frame->pc;
+				SETFUNCTION(CURRENTFUNCTION());
+				GCCHECK();
+				NEXT;
+			}
 			J->strict = savestrict;
 			return;
+
+		/* Superinstructions */
+
+		CASE(OP_GETLOCALPROP):
+			ix = *pc++;
+			READSTRING();
+			READCACHE();
+			obj = js_toobject(J, ix);
+			if (!jsR_getcached(J, cache, obj, str))
+				jsR_getproperty(J, obj, str);
+			NEXT;
+
+		CASE(OP_INCLOCAL):
+			ix = *pc++;
+			if (JSV_ISINTEGER(&STACK[BOT + ix]) && JSV_INTEGER(&STACK[BOT + ix]) != INT_MAX) {
+				JSV_SETINTEGER(&STACK[BOT + ix], JSV_INTEGER(&STACK[BOT + ix]) + 1);
+				NEXT;
+			}
+			js_copy(J, ix);
+			x = js_tonumber(J, -1);
+			js_pop(J, 1);
+			js_pushnumber(J, x + 1);
+			STACK[BOT + ix] = STACK[--TOP];
+			NEXT;
+
+		CASE(OP_DECLOCAL):
+			ix = *pc++;
+			if (JSV_ISINTEGER(&STACK[BOT + ix]) && JSV_INTEGER(&STACK[BOT + ix]) != INT_MIN) {
+				JSV_SETINTEGER(&STACK[BOT + ix], JSV_INTEGER(&STACK[BOT + ix]) - 1);
+				NEXT;
+			}
+			js_copy(J, ix);
+			x = js_tonumber(J, -1);
+			js_pop(J, 1);
+			js_pushnumber(J, x - 1);
+			STACK[BOT + ix] = STACK[--TOP];
+			NEXT;
+
+		CASE(OP_ADDINTEGER):
+			iy = *pc++ - 32768;
+			if (JSV_ISINTEGER(SV1)) {
+				x = (double)JSV_INTEGER(SV1) + iy;
+				if (FITS(x)) {
+					JSV_SETINTEGER(SV1, (int)x);
+					NEXT;
+				}
+			}
+			if (ISNUMBER(SV1)) {
+				jsR_setnumber(SV1, JSV_NUMBER(SV1) + iy);
+				NEXT;
+			}
+			js_pushinteger(J, iy);
+			js_concat(J);
+			NEXT;
+
+		CASE(OP_LTJFALSE): CMPJFALSE(<, OP_LT);
+		CASE(OP_GTJFALSE): CMPJFALSE(>, OP_GT);
+		CASE(OP_LEJFALSE): CMPJFALSE(<=, OP_LE);
+		CASE(OP_GEJFALSE): CMPJFALSE(>=, OP_GE);
+		CASE(OP_EQJFALSE): CMPJFALSE(==, OP_EQ);
+		CASE(OP_NEJFALSE): CMPJFALSE(!=, OP_NE);
+		CASE(OP_STRICTEQJFALSE): CMPJFALSE(==, OP_STRICTEQ);
+		CASE(OP_STRICTNEJFALSE): CMPJFALSE(!=, OP_STRICTNE);
+
+		/* Register instructions */
+
+		CASE(OP_MOVELOCAL):
+			rd = *pc++;
+			ra = *pc++;
+			*REG(rd) = *REG(ra);
+			NEXT;
+
+		CASE(OP_BINARYLOCAL):
+			op = *pc++;
+			ra = *pc++;
+			rb = *pc++;
+			if (JSV_ISINTEGER(REG(ra)) && JSV_ISINTEGER(REG(rb)) &&
+					jsR_integerbinary(op, JSV_INTEGER(REG(ra)), JSV_INTEGER(REG(rb)), &ix)) {
+				js_pushinteger(J, ix);
+				NEXT;
+			}
+			if (ISNUMBER(REG(ra)) && ISNUMBER(REG(rb)) &&
+					jsR_numberbinary(op, JSV_NUMBER(REG(ra)), JSV_NUMBER(REG(rb)), &x)) {
+				js_pushnumber(J, x);
+				NEXT;
+			}
+			js_copy(J, ra);
+			js_copy(J, rb);
+			jsR_binary(J, op);
+			NEXT;
+
+		CASE(OP_BINARYTOLOCAL):
+			op = *pc++;
+			rd = *pc++;
+			ra = *pc++;
+			rb = *pc++;
+			if (JSV_ISINTEGER(REG(ra)) && JSV_ISINTEGER(REG(rb)) &&
+					jsR_integerbinary(op, JSV_INTEGER(REG(ra)), JSV_INTEGER(REG(rb)), &ix)) {
+				JSV_SETINTEGER(REG(rd), ix);
+				NEXT;
+			}
+			if (ISNUMBER(REG(ra)) && ISNUMBER(REG(rb)) &&
+					jsR_numberbinary(op, JSV_NUMBER(REG(ra)), JSV_NUMBER(REG(rb)), &x)) {
+				jsR_setnumber(REG(rd), x);
+				NEXT;
+			}
+			js_copy(J, ra);
+			js_copy(J, rb);
+			jsR_binary(J, op);
+			*REG(rd) = STACK[--TOP];
+			NEXT;
+
+		CASE(OP_CMPLOCALJFALSE):
+			op = *pc++;
+			ra = *pc++;
+			rb = *pc++;
+			offset = *pc++;
+			if (JSV_ISINTEGER(REG(ra)) && JSV_ISINTEGER(REG(rb))) {
+				b = jsR_integercomparison(op, JSV_INTEGER(REG(ra)), JSV_INTEGER(REG(rb)));
+			} else if (ISNUMBER(REG(ra)) && ISNUMBER(REG(rb))) {
+				b = jsR_numbercomparison(op, JSV_NUMBER(REG(ra)), JSV_NUMBER(REG(rb)));
+			} else {
+				js_copy(J, ra);
+				js_copy(J, rb);
+				b = jsR_comparison(J, op);
+			}
+			if (!b)
+				JUMPTO(offset);
+			NEXT;
+
+		CASE(OP_CMPINTEGERJFALSE):
+			op = *pc++;
+			ra = *pc++;
+			iy = *pc++ - 32768;
+			offset = *pc++;
+			if (JSV_ISINTEGER(REG(ra))) {
+				b = jsR_integercomparison(op, JSV_INTEGER(REG(ra)), iy);
+			} else if (ISNUMBER(REG(ra))) {
+				b = jsR_numbercomparison(op, JSV_NUMBER(REG(ra)), iy);
+			} else {
+				js_copy(J, ra);
+				js_pushinteger(J, iy);
+				b = jsR_comparison(J, op);
+			}
+			if (!b)
+				JUMPTO(offset);
+			NEXT;
+
+		CASE(OP_GETPROPTOLOCAL):
+			rd = *pc++;
+			ra = *pc++;
+			READSTRING();
+			READCACHE();
+			obj = js_toobject(J, ra);
+			if (!jsR_getcached(J, cache, obj, str))
+				jsR_getproperty(J, obj, str);
+			*REG(rd) = STACK[--TOP];
+			NEXT;
+
+		CASE(OP_SETPROPFROMLOCAL):
+			ra = *pc++;
+			rb = *pc++;
+			READSTRING();
+			READCACHE();
+			obj = js_toobject(J, ra);
+			js_copy(J, rb);
+			if (!jsR_setcached(J, cache, obj)) {
+				transient = !js_isobject(J, ra);
+				jsR_setproperty(J, obj, str, transient);
+				if (!transient)
+					jsR_setcache(J, cache, obj, str);
+			}
+			js_pop(J, 1);
+			NEXT;
+#ifdef JS_COMPUTEDGOTO
+	}
+#else
 		}
 	}
+#endif
 }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef JS_COMPUTEDGOTO
+#pragma GCC diagnostic pop
+#endif
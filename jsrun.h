@@ -2,14 +2,34 @@
 #define js_run_h
 
 js_Environment *jsR_newenvironment(js_State *J, js_Object *variables, js_Environment *outer);
+js_Environment *jsR_newslotenvironment(js_State *J, int count, js_Environment *outer);
+void jsR_freepool(js_State *J);
+int jsR_resizecalls(js_State *J, int cap);
+void jsR_freestacks(js_State *J);
+
+/*
+	Functions without eval or with keep their locals in an array of slots
+	instead of a variables object. The compiler resolves references to them,
+	from the function and from functions nested in it, to slot numbers, so
+	lookups by name skip these environments.
+*/
 
 struct js_Environment
 {
 	js_Environment *outer;
-	js_Object *variables;
+	js_Object *variables; /* NULL for slot environments */
+	js_Value *slots;
+	int count;
 
 	js_Environment *gcnext;
 	int gcmark;
 };
 
+/* Write barrier: call after storing a value in the slots of an environment */
+static inline void jsR_barrierslot(js_State *J, js_Environment *E, js_Value *v)
+{
+	if (J->gcbarrier && E->gcmark == J->gcmark)
+		jsG_markvalue(J, v);
+}
+
 #endif
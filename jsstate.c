@@ -10,8 +10,7 @@
 
 static int js_ptry(js_State *J) {
 	if (J->trytop == JS_TRYLIMIT) {
-		STACK[TOP].type = JS_TLITSTR;
-		STACK[TOP].u.litstr = "exception stack overflow";
+		JSV_SETLITSTR(&STACK[TOP], "exception stack overflow");
 		++TOP;
 		return 1;
 	}
@@ -202,16 +201,20 @@ void js_loadfile(js_State *J, const char *filename)
 		js_throw(J);
 	}
 
-	/* skip first line if it starts with "#!" */
-	p = s;
-	if (p[0] == '#' && p[1] == '!') {
-		p += 2;
-		while (*p && *p != '\n')
-			++p;
+	if (js_isbytecode(s, n)) {
+		js_loadbytecode(J, filename, s, n);
+	} else {
+		/* skip first line if it starts with "#!" */
+		p = s;
+		if (p[0] == '#' && p[1] == '!') {
+			p += 2;
+			while (*p && *p != '\n')
+				++p;
+		}
+
+		js_loadstring(J, filename, p);
 	}
 
-	js_loadstring(J, filename, p);
-
 	js_free(J, s);
 	fclose(f);
 	js_endtry(J);
@@ -289,8 +292,12 @@ js_State *js_newstate(js_Alloc alloc, void *actx, int flags)
 {
 	js_State *J;
 
+#ifdef JS_NANBOX
+	assert(sizeof(js_Value) == 8);
+#else
 	assert(sizeof(js_Value) == 16);
 	assert(soffsetof(js_Value, type) == 15);
+#endif
 
 	if (!alloc)
 		alloc = js_defaultalloc;
@@ -305,23 +312,39 @@ js_State *js_newstate(js_Alloc alloc, void *actx, int flags)
 	if (flags & JS_STRICT)
 		J->strict = J->default_strict = 1;
 
+	if (!jsR_resizecalls(J, JS_ENVSTART)) {
+		alloc(actx, J, 0);
+		return NULL;
+	}
+
 	J->trace[0].name = "-top-";
 	J->trace[0].file = "native";
 	J->trace[0].line = 0;
+	J->trace[0].function = NULL;
+	J->trace[0].pc = NULL;
 
 	J->report = js_defaultreport;
 	J->panic = js_defaultpanic;
 
-	J->stack = alloc(actx, NULL, JS_STACKSIZE * sizeof *J->stack);
+	J->stack = alloc(actx, NULL, JS_STACKSTART * sizeof *J->stack);
 	if (!J->stack) {
-		alloc(actx, NULL, 0);
+		alloc(actx, J->envstack, 0);
+		alloc(actx, J->trace, 0);
+		alloc(actx, J->frames, 0);
+		alloc(actx, J, 0);
 		return NULL;
 	}
 
+	J->stacksize = JS_STACKSTART;
+	J->gccounter = JS_STACKSTART * sizeof *J->stack;
+
 	J->gcmark = 1;
 	J->nextref = 0;
 	J->gcthresh = 0; /* reaches stability within ~ 2-5 GC cycles */
 
+	jsS_initatoms(J);
+	J->rootshape = jsV_newshape(J, NULL, NULL, 0);
+
 	J->R = jsV_newobject(J, JS_COBJECT, NULL);
 	J->G = jsV_newobject(J, JS_COBJECT, NULL);
 	J->E = jsR_newenvironment(J, J->G, NULL);
@@ -63,6 +63,41 @@ int js_utfptrtoidx(const char *s, const char *p)
 	return i;
 }
 
+/*
+	Memstrs cache their length and an index, so the functions that take
+	character positions look for one behind the string from checkstring.
+*/
+
+static js_String *checkmemstring(js_State *J, int idx)
+{
+	js_Value *v = js_tovalue(J, idx);
+	return JSV_TYPE(v) == JS_TMEMSTR ? JSV_MEMSTR(v) : NULL;
+}
+
+static int stringlength(js_State *J, int idx, const char *s)
+{
+	js_String *mem = checkmemstring(J, idx);
+	return mem ? jsV_utflen(J, mem) : utflen(s);
+}
+
+static const char *stringindex(js_State *J, int idx, const char *s, int i)
+{
+	js_String *mem = checkmemstring(J, idx);
+	return mem ? jsV_utfidxtoptr(J, mem, i) : js_utfidxtoptr(s, i);
+}
+
+static int stringrune(js_State *J, int idx, const char *s, int i)
+{
+	js_String *mem = checkmemstring(J, idx);
+	Rune rune;
+	if (!mem)
+		return js_runeat(J, s, i);
+	if (i < 0 || i >= jsV_utflen(J, mem))
+		return EOF;
+	chartorune(&rune, jsV_utfidxtoptr(J, mem, i));
+	return rune;
+}
+
 static void jsB_new_String(js_State *J)
 {
 	js_newstring(J, js_gettop(J) > 1 ? js_tostring(J, 1) : "");
@@ -77,14 +112,20 @@ static void Sp_toString(js_State *J)
 {
 	js_Object *self = js_toobject(J, 0);
 	if (self->type != JS_CSTRING) js_typeerror(J, "not a string");
-	js_pushliteral(J, self->u.s.string);
+	if (self->u.s.memstr)
+		js_pushmemstring(J, self->u.s.memstr);
+	else
+		js_pushatom(J, self->u.s.string);
 }
 
 static void Sp_valueOf(js_State *J)
 {
 	js_Object *self = js_toobject(J, 0);
 	if (self->type != JS_CSTRING) js_typeerror(J, "not a string");
-	js_pushliteral(J, self->u.s.string);
+	if (self->u.s.memstr)
+		js_pushmemstring(J, self->u.s.memstr);
+	else
+		js_pushatom(J, self->u.s.string);
 }
 
 static void Sp_charAt(js_State *J)
@@ -92,7 +133,7 @@ static void Sp_charAt(js_State *J)
 	char buf[UTFmax + 1];
 	const char *s = checkstring(J, 0);
 	int pos = js_tointeger(J, 1);
-	Rune rune = js_runeat(J, s, pos);
+	Rune rune = stringrune(J, 0, s, pos);
 	if (rune >= 0) {
 		buf[runetochar(buf, &rune)] = 0;
 		js_pushstring(J, buf);
@@ -105,7 +146,7 @@ static void Sp_charCodeAt(js_State *J)
 {
 	const char *s = checkstring(J, 0);
 	int pos = js_tointeger(J, 1);
-	Rune rune = js_runeat(J, s, pos);
+	Rune rune = stringrune(J, 0, s, pos);
 	if (rune >= 0)
 		js_pushnumber(J, rune);
 	else
@@ -196,7 +237,7 @@ static void Sp_slice(js_State *J)
 {
 	const char *str = checkstring(J, 0);
 	const char *ss, *ee;
-	int len = utflen(str);
+	int len = stringlength(J, 0, str);
 	int s = js_tointeger(J, 1);
 	int e = js_isdefined(J, 2) ? js_tointeger(J, 2) : len;
 
@@ -207,11 +248,11 @@ static void Sp_slice(js_State *J)
 	e = e < 0 ? 0 : e > len ? len : e;
 
 	if (s < e) {
-		ss = js_utfidxtoptr(str, s);
-		ee = js_utfidxtoptr(ss, e - s);
+		ss = stringindex(J, 0, str, s);
+		ee = stringindex(J, 0, str, e);
 	} else {
-		ss = js_utfidxtoptr(str, e);
-		ee = js_utfidxtoptr(ss, s - e);
+		ss = stringindex(J, 0, str, e);
+		ee = stringindex(J, 0, str, s);
 	}
 
 	js_pushlstring(J, ss, ee - ss);
@@ -221,7 +262,7 @@ static void Sp_substring(js_State *J)
 {
 	const char *str = checkstring(J, 0);
 	const char *ss, *ee;
-	int len = utflen(str);
+	int len = stringlength(J, 0, str);
 	int s = js_tointeger(J, 1);
 	int e = js_isdefined(J, 2) ? js_tointeger(J, 2) : len;
 
@@ -229,11 +270,11 @@ static void Sp_substring(js_State *J)
 	e = e < 0 ? 0 : e > len ? len : e;
 
 	if (s < e) {
-		ss = js_utfidxtoptr(str, s);
-		ee = js_utfidxtoptr(ss, e - s);
+		ss = stringindex(J, 0, str, s);
+		ee = stringindex(J, 0, str, e);
 	} else {
-		ss = js_utfidxtoptr(str, e);
-		ee = js_utfidxtoptr(ss, s - e);
+		ss = stringindex(J, 0, str, e);
+		ee = stringindex(J, 0, str, s);
 	}
 
 	js_pushlstring(J, ss, ee - ss);
@@ -688,7 +729,7 @@ static void Sp_split(js_State *J)
 
 void jsB_initstring(js_State *J)
 {
-	J->String_prototype->u.s.string = "";
+	J->String_prototype->u.s.string = js_intern(J, "");
 	J->String_prototype->u.s.length = 0;
 
 	js_pushobject(J, J->String_prototype);
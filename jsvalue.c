@@ -4,8 +4,8 @@
 #include "jsvalue.h"
 #include "utf.h"
 
-#define JSV_ISSTRING(v) (v->type==JS_TSHRSTR || v->type==JS_TMEMSTR || v->type==JS_TLITSTR)
-#define JSV_TOSTRING(v) (v->type==JS_TSHRSTR ? v->u.shrstr : v->type==JS_TLITSTR ? v->u.litstr : v->type==JS_TMEMSTR ? v->u.memstr->p : "")
+#define JSV_ISSTRING(v) (JSV_TYPE(v)==JS_TSHRSTR || JSV_TYPE(v)==JS_TMEMSTR || JSV_TYPE(v)==JS_TLITSTR)
+#define JSV_TOSTRING(J, v) (JSV_TYPE(v)==JS_TSHRSTR ? JSV_SHRSTR(v) : JSV_TYPE(v)==JS_TLITSTR ? JSV_LITSTR(v) : JSV_TYPE(v)==JS_TMEMSTR ? jsV_flatten(J, JSV_MEMSTR(v)) : "")
 
 double js_strtol(const char *s, char **p, int base)
 {
@@ -116,53 +116,61 @@ static int jsV_valueOf(js_State *J, js_Object *obj)
 	return 0;
 }
 
-/* ToPrimitive() on a value */
-void jsV_toprimitive(js_State *J, js_Value *v, int preferred)
+/* ToPrimitive() on a value; valueOf and toString may move the stack, so use the returned pointer */
+js_Value *jsV_toprimitive(js_State *J, js_Value *v, int preferred)
 {
 	js_Object *obj;
+	int idx = -1;
 
-	if (v->type != JS_TOBJECT)
-		return;
+	if (JSV_TYPE(v) != JS_TOBJECT)
+		return v;
 
-	obj = v->u.object;
+	obj = JSV_OBJECT(v);
+	if (v >= J->stack && v < J->stack + J->top)
+		idx = v - J->stack;
 
 	if (preferred == JS_HNONE)
 		preferred = obj->type == JS_CDATE ? JS_HSTRING : JS_HNUMBER;
 
 	if (preferred == JS_HSTRING) {
 		if (jsV_toString(J, obj) || jsV_valueOf(J, obj)) {
+			if (idx >= 0)
+				v = J->stack + idx;
 			*v = *js_tovalue(J, -1);
 			js_pop(J, 1);
-			return;
+			return v;
 		}
 	} else {
 		if (jsV_valueOf(J, obj) || jsV_toString(J, obj)) {
+			if (idx >= 0)
+				v = J->stack + idx;
 			*v = *js_tovalue(J, -1);
 			js_pop(J, 1);
-			return;
+			return v;
 		}
 	}
 
 	if (J->strict)
 		js_typeerror(J, "cannot convert object to primitive");
 
-	v->type = JS_TLITSTR;
-	v->u.litstr = "[object]";
-	return;
+	if (idx >= 0)
+		v = J->stack + idx;
+	JSV_SETLITSTR(v, "[object]");
+	return v;
 }
 
 /* ToBoolean() on a value */
 int jsV_toboolean(js_State *J, js_Value *v)
 {
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
-	case JS_TSHRSTR: return v->u.shrstr[0] != 0;
+	case JS_TSHRSTR: return JSV_SHRSTR(v)[0] != 0;
 	case JS_TUNDEFINED: return 0;
 	case JS_TNULL: return 0;
-	case JS_TBOOLEAN: return v->u.boolean;
-	case JS_TNUMBER: return v->u.number != 0 && !isnan(v->u.number);
-	case JS_TLITSTR: return v->u.litstr[0] != 0;
-	case JS_TMEMSTR: return v->u.memstr->p[0] != 0;
+	case JS_TBOOLEAN: return JSV_BOOLEAN(v);
+	case JS_TNUMBER: return JSV_NUMBER(v) != 0 && !isnan(JSV_NUMBER(v));
+	case JS_TLITSTR: return JSV_LITSTR(v)[0] != 0;
+	case JS_TMEMSTR: return JSV_MEMSTR(v)->length != 0;
 	case JS_TOBJECT: return 1;
 	}
 }
@@ -242,18 +250,17 @@ double jsV_stringtonumber(js_State *J, const char *s)
 /* ToNumber() on a value */
 double jsV_tonumber(js_State *J, js_Value *v)
 {
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
-	case JS_TSHRSTR: return jsV_stringtonumber(J, v->u.shrstr);
+	case JS_TSHRSTR: return jsV_stringtonumber(J, JSV_SHRSTR(v));
 	case JS_TUNDEFINED: return NAN;
 	case JS_TNULL: return 0;
-	case JS_TBOOLEAN: return v->u.boolean;
-	case JS_TNUMBER: return v->u.number;
-	case JS_TLITSTR: return jsV_stringtonumber(J, v->u.litstr);
-	case JS_TMEMSTR: return jsV_stringtonumber(J, v->u.memstr->p);
+	case JS_TBOOLEAN: return JSV_BOOLEAN(v);
+	case JS_TNUMBER: return JSV_NUMBER(v);
+	case JS_TLITSTR: return jsV_stringtonumber(J, JSV_LITSTR(v));
+	case JS_TMEMSTR: return jsV_stringtonumber(J, jsV_flatten(J, JSV_MEMSTR(v)));
 	case JS_TOBJECT:
-		jsV_toprimitive(J, v, JS_HNUMBER);
-		return jsV_tonumber(J, v);
+		return jsV_tonumber(J, jsV_toprimitive(J, v, JS_HNUMBER));
 	}
 }
 
@@ -327,37 +334,134 @@ const char *jsV_tostring(js_State *J, js_Value *v)
 {
 	char buf[32];
 	const char *p;
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
-	case JS_TSHRSTR: return v->u.shrstr;
+	case JS_TSHRSTR: return JSV_SHRSTR(v);
 	case JS_TUNDEFINED: return "undefined";
 	case JS_TNULL: return "null";
-	case JS_TBOOLEAN: return v->u.boolean ? "true" : "false";
-	case JS_TLITSTR: return v->u.litstr;
-	case JS_TMEMSTR: return v->u.memstr->p;
+	case JS_TBOOLEAN: return JSV_BOOLEAN(v) ? "true" : "false";
+	case JS_TLITSTR: return JSV_LITSTR(v);
+	case JS_TMEMSTR: return jsV_flatten(J, JSV_MEMSTR(v));
 	case JS_TNUMBER:
-		p = jsV_numbertostring(J, buf, v->u.number);
+		p = jsV_numbertostring(J, buf, JSV_NUMBER(v));
 		if (p == buf) {
 			int n = strlen(p);
-			if (n <= soffsetof(js_Value, type)) {
-				char *s = v->u.shrstr;
+			if (n <= JSV_SHRSTRLEN) {
+				char *s = JSV_SHRSTR(v);
 				while (n--) *s++ = *p++;
 				*s = 0;
-				v->type = JS_TSHRSTR;
-				return v->u.shrstr;
+				JSV_SETSHRSTR(v);
+				return JSV_SHRSTR(v);
 			} else {
-				v->u.memstr = jsV_newmemstring(J, p, n);
-				v->type = JS_TMEMSTR;
-				return v->u.memstr->p;
+				JSV_SETMEMSTR(v, jsV_newmemstring(J, p, n));
+				return JSV_MEMSTR(v)->p;
 			}
 		}
 		return p;
 	case JS_TOBJECT:
-		jsV_toprimitive(J, v, JS_HSTRING);
-		return jsV_tostring(J, v);
+		return jsV_tostring(J, jsV_toprimitive(J, v, JS_HSTRING));
 	}
 }
 
+/* Ropes */
+
+static void jsV_copyrope(char *dst, js_String *s)
+{
+	/* only recurse on the right halves, whose nesting js_concat bounds */
+	while (s->right) {
+		jsV_copyrope(dst + s->left->length, s->right);
+		s = s->left;
+	}
+	if (s->left)
+		s = s->left;
+	memcpy(dst, s->p, s->length);
+}
+
+/* Get the bytes of a memstr, flattening it first if it is a rope */
+const char *jsV_flatten(js_State *J, js_String *s)
+{
+	if (s->right) {
+		js_String *flat = jsV_newmemstring(J, NULL, s->length);
+		jsV_copyrope(flat->p, s);
+		flat->runes = s->runes;
+		flat->ascii = s->ascii;
+		/* write barrier: the rope may already be marked */
+		if (J->gcbarrier && s->gcmark == J->gcmark)
+			flat->gcmark = s->gcmark;
+		s->left = flat;
+		s->right = NULL;
+		s->depth = 0;
+	}
+	return s->left ? s->left->p : s->p;
+}
+
+/* Count the characters of a memstr, once */
+int jsV_utflen(js_State *J, js_String *s)
+{
+	if (s->runes < 0) {
+		const char *p = jsV_flatten(J, s);
+		int n = 0, ascii = 1;
+		Rune rune;
+		while (*p) {
+			if (*(unsigned char*)p < Runeself)
+				++p;
+			else {
+				p += chartorune(&rune, p);
+				ascii = 0;
+			}
+			++n;
+		}
+		s->runes = n;
+		s->ascii = ascii;
+	}
+	return s->runes;
+}
+
+/* Get a pointer to character i of a memstr, or NULL if out of range */
+const char *jsV_utfidxtoptr(js_State *J, js_String *s, int i)
+{
+	const char *p = jsV_flatten(J, s);
+	int n = jsV_utflen(J, s);
+	if (i < 0 || i > n)
+		return NULL;
+	if (s->ascii)
+		return p + i;
+	if (!s->index) {
+		const char *q = p;
+		int k;
+		s->index = js_malloc(J, (n / JS_UTFSTEP + 1) * (int)sizeof *s->index);
+		for (k = 0; k <= n / JS_UTFSTEP; ++k) {
+			s->index[k] = q - p;
+			q = js_utfidxtoptr(q, JS_UTFSTEP);
+			if (!q)
+				break;
+		}
+	}
+	return js_utfidxtoptr(p + s->index[i / JS_UTFSTEP], i % JS_UTFSTEP);
+}
+
+/* Convert a string value to a memstr in place */
+static js_String *jsV_tomemstring(js_State *J, js_Value *v)
+{
+	js_String *s;
+	const char *p;
+	if (JSV_TYPE(v) == JS_TMEMSTR)
+		return JSV_MEMSTR(v);
+	p = jsV_tostring(J, v);
+	if (JSV_TYPE(v) == JS_TMEMSTR)
+		return JSV_MEMSTR(v);
+	s = jsV_newmemstring(J, p, strlen(p));
+	JSV_SETMEMSTR(v, s);
+	return s;
+}
+
+static int jsV_stringlength(js_State *J, js_Value *v)
+{
+	if (JSV_TYPE(v) == JS_TMEMSTR)
+		return JSV_MEMSTR(v)->length;
+	return strlen(jsV_tostring(J, v));
+}
+
 /* Objects */
 
 static js_Object *jsV_newboolean(js_State *J, int v)
@@ -377,24 +481,33 @@ static js_Object *jsV_newnumber(js_State *J, double v)
 static js_Object *jsV_newstring(js_State *J, const char *v)
 {
 	js_Object *obj = jsV_newobject(J, JS_CSTRING, J->String_prototype);
-	obj->u.s.string = js_intern(J, v); /* TODO: js_String */
+	obj->u.s.string = js_intern(J, v);
 	obj->u.s.length = utflen(v);
 	return obj;
 }
 
+static js_Object *jsV_newmemstringobject(js_State *J, js_String *v)
+{
+	js_Object *obj = jsV_newobject(J, JS_CSTRING, J->String_prototype);
+	obj->u.s.string = jsV_flatten(J, v);
+	obj->u.s.length = jsV_utflen(J, v);
+	obj->u.s.memstr = v;
+	return obj;
+}
+
 /* ToObject() on a value */
 js_Object *jsV_toobject(js_State *J, js_Value *v)
 {
-	switch (v->type) {
+	switch (JSV_TYPE(v)) {
 	default:
-	case JS_TSHRSTR: return jsV_newstring(J, v->u.shrstr);
+	case JS_TSHRSTR: return jsV_newstring(J, JSV_SHRSTR(v));
 	case JS_TUNDEFINED: js_typeerror(J, "cannot convert undefined to object");
 	case JS_TNULL: js_typeerror(J, "cannot convert null to object");
-	case JS_TBOOLEAN: return jsV_newboolean(J, v->u.boolean);
-	case JS_TNUMBER: return jsV_newnumber(J, v->u.number);
-	case JS_TLITSTR: return jsV_newstring(J, v->u.litstr);
-	case JS_TMEMSTR: return jsV_newstring(J, v->u.memstr->p);
-	case JS_TOBJECT: return v->u.object;
+	case JS_TBOOLEAN: return jsV_newboolean(J, JSV_BOOLEAN(v));
+	case JS_TNUMBER: return jsV_newnumber(J, JSV_NUMBER(v));
+	case JS_TLITSTR: return jsV_newstring(J, JSV_LITSTR(v));
+	case JS_TMEMSTR: return jsV_newmemstringobject(J, JSV_MEMSTR(v));
+	case JS_TOBJECT: return JSV_OBJECT(v);
 	}
 }
 
@@ -567,21 +680,29 @@ void js_concat(js_State *J)
 	js_toprimitive(J, -1, JS_HNONE);
 
 	if (js_isstring(J, -2) || js_isstring(J, -1)) {
-		const char *sa = js_tostring(J, -2);
-		const char *sb = js_tostring(J, -1);
-		char * volatile sab = NULL;
-		/* TODO: create js_String directly */
-		if (js_try(J)) {
-			js_free(J, sab);
-			js_throw(J);
+		js_Value *va = js_tovalue(J, -2);
+		js_Value *vb = js_tovalue(J, -1);
+		int na = jsV_stringlength(J, va);
+		int nb = jsV_stringlength(J, vb);
+		if (na + nb > JS_STRLIMIT)
+			js_rangeerror(J, "invalid string length");
+		if (na + nb < JS_ROPEMIN) {
+			char buf[JS_ROPEMIN];
+			memcpy(buf, jsV_tostring(J, va), na);
+			memcpy(buf + na, jsV_tostring(J, vb), nb);
+			js_pop(J, 2);
+			js_pushlstring(J, buf, na + nb);
+		} else {
+			/* keep ropes shallow on the right so walking them needs little C stack */
+			js_String *sa = jsV_tomemstring(J, va);
+			js_String *sb = jsV_tomemstring(J, vb);
+			if (sb->depth >= JS_ROPEDEPTH) {
+				jsV_flatten(J, sb);
+				sb = sb->left;
+			}
+			JSV_SETMEMSTR(va, jsV_newrope(J, sa, sb));
+			js_pop(J, 1);
 		}
-		sab = js_malloc(J, strlen(sa) + strlen(sb) + 1);
-		strcpy(sab, sa);
-		strcat(sab, sb);
-		js_pop(J, 2);
-		js_pushstring(J, sab);
-		js_endtry(J);
-		js_free(J, sab);
 	} else {
 		double x = js_tonumber(J, -2);
 		double y = js_tonumber(J, -1);
@@ -614,40 +735,40 @@ int js_equal(js_State *J)
 
 retry:
 	if (JSV_ISSTRING(x) && JSV_ISSTRING(y))
-		return !strcmp(JSV_TOSTRING(x), JSV_TOSTRING(y));
-	if (x->type == y->type) {
-		if (x->type == JS_TUNDEFINED) return 1;
-		if (x->type == JS_TNULL) return 1;
-		if (x->type == JS_TNUMBER) return x->u.number == y->u.number;
-		if (x->type == JS_TBOOLEAN) return x->u.boolean == y->u.boolean;
-		if (x->type == JS_TOBJECT) return x->u.object == y->u.object;
+		return !strcmp(JSV_TOSTRING(J, x), JSV_TOSTRING(J, y));
+	if (JSV_TYPE(x) == JSV_TYPE(y)) {
+		if (JSV_TYPE(x) == JS_TUNDEFINED) return 1;
+		if (JSV_TYPE(x) == JS_TNULL) return 1;
+		if (JSV_TYPE(x) == JS_TNUMBER) return JSV_NUMBER(x) == JSV_NUMBER(y);
+		if (JSV_TYPE(x) == JS_TBOOLEAN) return JSV_BOOLEAN(x) == JSV_BOOLEAN(y);
+		if (JSV_TYPE(x) == JS_TOBJECT) return JSV_OBJECT(x) == JSV_OBJECT(y);
 		return 0;
 	}
 
-	if (x->type == JS_TNULL && y->type == JS_TUNDEFINED) return 1;
-	if (x->type == JS_TUNDEFINED && y->type == JS_TNULL) return 1;
+	if (JSV_TYPE(x) == JS_TNULL && JSV_TYPE(y) == JS_TUNDEFINED) return 1;
+	if (JSV_TYPE(x) == JS_TUNDEFINED && JSV_TYPE(y) == JS_TNULL) return 1;
 
-	if (x->type == JS_TNUMBER && JSV_ISSTRING(y))
-		return x->u.number == jsV_tonumber(J, y);
-	if (JSV_ISSTRING(x) && y->type == JS_TNUMBER)
-		return jsV_tonumber(J, x) == y->u.number;
+	if (JSV_TYPE(x) == JS_TNUMBER && JSV_ISSTRING(y))
+		return JSV_NUMBER(x) == jsV_tonumber(J, y);
+	if (JSV_ISSTRING(x) && JSV_TYPE(y) == JS_TNUMBER)
+		return jsV_tonumber(J, x) == JSV_NUMBER(y);
 
-	if (x->type == JS_TBOOLEAN) {
-		x->type = JS_TNUMBER;
-		x->u.number = x->u.boolean ? 1 : 0;
+	if (JSV_TYPE(x) == JS_TBOOLEAN) {
+		JSV_SETNUMBER(x, JSV_BOOLEAN(x) ? 1 : 0);
 		goto retry;
 	}
-	if (y->type == JS_TBOOLEAN) {
-		y->type = JS_TNUMBER;
-		y->u.number = y->u.boolean ? 1 : 0;
+	if (JSV_TYPE(y) == JS_TBOOLEAN) {
+		JSV_SETNUMBER(y, JSV_BOOLEAN(y) ? 1 : 0);
 		goto retry;
 	}
-	if ((JSV_ISSTRING(x) || x->type == JS_TNUMBER) && y->type == JS_TOBJECT) {
-		jsV_toprimitive(J, y, JS_HNONE);
+	if ((JSV_ISSTRING(x) || JSV_TYPE(x) == JS_TNUMBER) && JSV_TYPE(y) == JS_TOBJECT) {
+		y = jsV_toprimitive(J, y, JS_HNONE);
+		x = js_tovalue(J, -2);
 		goto retry;
 	}
-	if (x->type == JS_TOBJECT && (JSV_ISSTRING(y) || y->type == JS_TNUMBER)) {
-		jsV_toprimitive(J, x, JS_HNONE);
+	if (JSV_TYPE(x) == JS_TOBJECT && (JSV_ISSTRING(y) || JSV_TYPE(y) == JS_TNUMBER)) {
+		x = jsV_toprimitive(J, x, JS_HNONE);
+		y = js_tovalue(J, -1);
 		goto retry;
 	}
 
@@ -660,13 +781,13 @@ int js_strictequal(js_State *J)
 	js_Value *y = js_tovalue(J, -1);
 
 	if (JSV_ISSTRING(x) && JSV_ISSTRING(y))
-		return !strcmp(JSV_TOSTRING(x), JSV_TOSTRING(y));
-
-	if (x->type != y->type) return 0;
-	if (x->type == JS_TUNDEFINED) return 1;
-	if (x->type == JS_TNULL) return 1;
-	if (x->type == JS_TNUMBER) return x->u.number == y->u.number;
-	if (x->type == JS_TBOOLEAN) return x->u.boolean == y->u.boolean;
-	if (x->type == JS_TOBJECT) return x->u.object == y->u.object;
+		return !strcmp(JSV_TOSTRING(J, x), JSV_TOSTRING(J, y));
+
+	if (JSV_TYPE(x) != JSV_TYPE(y)) return 0;
+	if (JSV_TYPE(x) == JS_TUNDEFINED) return 1;
+	if (JSV_TYPE(x) == JS_TNULL) return 1;
+	if (JSV_TYPE(x) == JS_TNUMBER) return JSV_NUMBER(x) == JSV_NUMBER(y);
+	if (JSV_TYPE(x) == JS_TBOOLEAN) return JSV_BOOLEAN(x) == JSV_BOOLEAN(y);
+	if (JSV_TYPE(x) == JS_TOBJECT) return JSV_OBJECT(x) == JSV_OBJECT(y);
 	return 0;
 }
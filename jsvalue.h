@@ -41,6 +41,115 @@ enum js_Class {
 	JS_CUSERDATA,
 };
 
+/*
+	Values are only accessed through the JSV_ macros below, so that the
+	representation can be chosen at compile time.
+
+	JSV_SHRSTR is the storage of a short string of at most JSV_SHRSTRLEN
+	bytes. Write the bytes and the zero terminator, then use JSV_SETSHRSTR
+	to set the type.
+
+	A JS_TLITSTR value points either at a C string that outlives the state
+	(js_pushliteral) or at an atom (js_pushatom). JSV_ISATOM tells them
+	apart, so the garbage collector marks atoms through their header
+	without looking them up.
+
+	Numbers have two internal forms: a double, and a small integer for
+	values that fit in an int (except -0). Both have type JS_TNUMBER and
+	JSV_NUMBER reads either; JSV_ISINTEGER and JSV_INTEGER let the
+	interpreter take integer fast paths.
+*/
+
+#ifdef JS_NANBOX
+
+/*
+	NaN-boxing packs every value into 64 bits. Numbers are stored as plain
+	doubles, with all NaNs folded into the single positive quiet NaN. Other
+	values live in the negative quiet NaN space: the top 13 bits are set,
+	the next 3 bits hold the type tag and the low 48 bits hold a pointer,
+	a boolean, an integer or the bytes of a short string. Doubles never
+	use the JS_TNUMBER tag, so it marks the small integer form. Literal
+	strings that are atoms use the JS_TLITSTR tag in the positive quiet
+	NaN space instead. This relies on user space pointers fitting in 48
+	bits and on little-endian byte order, so that the short string bytes
+	come first in memory.
+*/
+
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#error "JS_NANBOX needs a 64-bit little-endian target with 48-bit pointers"
+#endif
+
+#include <stdint.h>
+
+struct js_Value
+{
+	union {
+		uint64_t bits;
+		double number;
+		char shrstr[8];
+	} u;
+};
+
+#define JSV_BOXMASK 0xFFF8000000000000ULL
+#define JSV_PAYLOAD 0x0000FFFFFFFFFFFFULL
+#define JSV_BOXNAN 0x7FF8000000000000ULL
+#define JSV_BOX(t) (JSV_BOXMASK | ((uint64_t)(t) << 48))
+#define JSV_UNBOX(v) ((uintptr_t)((v)->u.bits & JSV_PAYLOAD))
+
+#define JSV_ATOMTAG ((JSV_BOXNAN >> 48) | JS_TLITSTR)
+
+static inline int jsV_type(const js_Value *v)
+{
+	if ((v->u.bits & JSV_BOXMASK) == JSV_BOXMASK)
+		return (v->u.bits >> 48) & 7;
+	if ((v->u.bits >> 48) == JSV_ATOMTAG)
+		return JS_TLITSTR;
+	return JS_TNUMBER;
+}
+
+static inline uint64_t jsV_boxnumber(double x)
+{
+	uint64_t bits;
+	if (isnan(x))
+		return JSV_BOXNAN;
+	memcpy(&bits, &x, sizeof bits);
+	return bits;
+}
+
+#define JSV_INTTAG (JSV_BOX(JS_TNUMBER) >> 48)
+#define JSV_ISINTEGER(v) (((v)->u.bits >> 48) == JSV_INTTAG)
+#define JSV_INTEGER(v) ((int)(uint32_t)(v)->u.bits)
+#define JSV_ISATOM(v) (((v)->u.bits >> 48) == JSV_ATOMTAG)
+
+static inline double jsV_number(const js_Value *v)
+{
+	return JSV_ISINTEGER(v) ? JSV_INTEGER(v) : v->u.number;
+}
+
+#define JSV_TYPE(v) jsV_type(v)
+#define JSV_BOOLEAN(v) ((int)((v)->u.bits & 1))
+#define JSV_NUMBER(v) jsV_number(v)
+#define JSV_SHRSTR(v) ((v)->u.shrstr)
+#define JSV_LITSTR(v) ((const char*)JSV_UNBOX(v))
+#define JSV_MEMSTR(v) ((js_String*)JSV_UNBOX(v))
+#define JSV_OBJECT(v) ((js_Object*)JSV_UNBOX(v))
+
+#define JSV_SETUNDEFINED(v) ((v)->u.bits = JSV_BOX(JS_TUNDEFINED))
+#define JSV_SETNULL(v) ((v)->u.bits = JSV_BOX(JS_TNULL))
+#define JSV_SETBOOLEAN(v, x) ((v)->u.bits = JSV_BOX(JS_TBOOLEAN) | !!(x))
+#define JSV_SETNUMBER(v, x) ((v)->u.bits = jsV_boxnumber(x))
+#define JSV_SETINTEGER(v, x) ((v)->u.bits = JSV_BOX(JS_TNUMBER) | (uint32_t)(x))
+#define JSV_SETSHRSTR(v) ((v)->u.bits = ((v)->u.bits & JSV_PAYLOAD) | JSV_BOX(JS_TSHRSTR))
+#define JSV_SETLITSTR(v, x) ((v)->u.bits = JSV_BOX(JS_TLITSTR) | (uintptr_t)(x))
+#define JSV_SETATOM(v, x) ((v)->u.bits = (uint64_t)JSV_ATOMTAG << 48 | (uintptr_t)(x))
+#define JSV_SETMEMSTR(v, x) ((v)->u.bits = JSV_BOX(JS_TMEMSTR) | (uintptr_t)(x))
+#define JSV_SETOBJECT(v, x) ((v)->u.bits = JSV_BOX(JS_TOBJECT) | (uintptr_t)(x))
+
+#define JSV_SHRSTRLEN 5
+#define JSV_UNDEFINED { { JSV_BOX(JS_TUNDEFINED) } }
+
+#else
+
 /*
 	Short strings abuse the js_Value struct. By putting the type tag in the
 	last byte, and using 0 as the tag for short strings, we can use the
@@ -52,19 +161,71 @@ struct js_Value
 {
 	union {
 		int boolean;
+		int integer;
 		double number;
 		char shrstr[8];
 		const char *litstr;
 		js_String *memstr;
 		js_Object *object;
 	} u;
-	char pad[7]; /* extra storage for shrstr */
+	char pad[7]; /* extra storage for shrstr; pad[0] flags integer numbers and atoms */
 	char type; /* type tag and zero terminator for shrstr */
 };
 
+#define JSV_ISINTEGER(v) ((v)->type == JS_TNUMBER && (v)->pad[0])
+#define JSV_INTEGER(v) ((v)->u.integer)
+#define JSV_ISATOM(v) ((v)->type == JS_TLITSTR && (v)->pad[0])
+
+static inline double jsV_number(const js_Value *v)
+{
+	return v->pad[0] ? v->u.integer : v->u.number;
+}
+
+#define JSV_TYPE(v) ((v)->type)
+#define JSV_BOOLEAN(v) ((v)->u.boolean)
+#define JSV_NUMBER(v) jsV_number(v)
+#define JSV_SHRSTR(v) ((v)->u.shrstr)
+#define JSV_LITSTR(v) ((v)->u.litstr)
+#define JSV_MEMSTR(v) ((v)->u.memstr)
+#define JSV_OBJECT(v) ((v)->u.object)
+
+#define JSV_SETUNDEFINED(v) ((v)->type = JS_TUNDEFINED)
+#define JSV_SETNULL(v) ((v)->type = JS_TNULL)
+#define JSV_SETBOOLEAN(v, x) ((v)->type = JS_TBOOLEAN, (v)->u.boolean = !!(x))
+#define JSV_SETNUMBER(v, x) ((v)->type = JS_TNUMBER, (v)->pad[0] = 0, (v)->u.number = (x))
+#define JSV_SETINTEGER(v, x) ((v)->type = JS_TNUMBER, (v)->pad[0] = 1, (v)->u.integer = (x))
+#define JSV_SETSHRSTR(v) ((v)->type = JS_TSHRSTR)
+#define JSV_SETLITSTR(v, x) ((v)->type = JS_TLITSTR, (v)->pad[0] = 0, (v)->u.litstr = (x))
+#define JSV_SETATOM(v, x) ((v)->type = JS_TLITSTR, (v)->pad[0] = 1, (v)->u.litstr = (x))
+#define JSV_SETMEMSTR(v, x) ((v)->type = JS_TMEMSTR, (v)->u.memstr = (x))
+#define JSV_SETOBJECT(v, x) ((v)->type = JS_TOBJECT, (v)->u.object = (x))
+
+#define JSV_SHRSTRLEN soffsetof(js_Value, type)
+#define JSV_UNDEFINED { {0}, {0}, JS_TUNDEFINED }
+
+#endif
+
+/*
+	A memstr is either flat, with its bytes in p, or a rope made by js_concat
+	that holds its two halves until the bytes are needed. Flattening a rope
+	stores the flat copy in left and clears right. Use jsV_flatten to get at
+	the bytes of any memstr.
+
+	The number of characters is counted once and cached in runes. Strings
+	that are all ASCII are indexed directly; others get a table with the
+	byte offset of every JS_UTFSTEP'th character, built on first use. Use
+	jsV_utflen and jsV_utfidxtoptr to get at them.
+*/
+
 struct js_String
 {
 	js_String *gcnext;
+	js_String *left, *right; /* rope halves */
+	int *index; /* byte offsets of every JS_UTFSTEP'th character, or NULL */
+	int length; /* in bytes */
+	int runes; /* in characters, or -1 if not yet counted */
+	char ascii; /* all characters are ASCII, valid once runes is counted */
+	char depth; /* rope nesting on the right side */
 	char gcmark;
 	char p[1];
 };
@@ -81,18 +242,27 @@ struct js_Object
 {
 	enum js_Class type;
 	int extensible;
-	js_Property *properties;
+	js_Property *properties; /* dictionary mode */
+	js_Shape *shape; /* shape mode: property layout, NULL in dictionary mode */
+	js_Value *slots; /* shape mode: property values */
 	int count; /* number of properties, for array sparseness check */
+	int nextorder; /* dictionary mode: insertion number of the next property */
 	js_Object *prototype;
 	union {
 		int boolean;
+		int integer;
 		double number;
 		struct {
 			const char *string;
 			int length;
+			js_String *memstr; /* cached length and index, or NULL */
 		} s;
 		struct {
 			int length;
+			int dense; /* may keep a flat prefix of elements in 'array' */
+			int flat_length;
+			int flat_capacity;
+			js_Value *array;
 		} a;
 		struct {
 			js_Function *function;
@@ -110,6 +280,7 @@ struct js_Object
 		struct {
 			js_Object *target;
 			js_Iterator *head;
+			const char *name; /* last name returned, kept alive for the caller */
 		} iter;
 		struct {
 			const char *tag;
@@ -127,13 +298,35 @@ struct js_Object
 
 struct js_Property
 {
-	const char *name;
+	const char *name; /* atom */
 	js_Property *left, *right;
 	int level;
 	int atts;
 	js_Value value;
 	js_Object *getter;
 	js_Object *setter;
+	unsigned int hash; /* hash of name; the tree is ordered by hash */
+	int order; /* insertion number, enumeration sorts by it */
+};
+
+/*
+	Objects start out in shape mode, where the property names and attributes
+	are described by a shape shared with other objects that had the same
+	properties added in the same order, and only the values are stored in
+	the object itself. Objects that get accessors, attribute changes,
+	deleted properties or too many properties switch to dictionary mode
+	and keep their properties in a tree.
+*/
+
+struct js_Shape
+{
+	const char *name;
+	int atts;
+	int slot;
+	js_Shape *parent;
+	js_Shape *kids; /* transitions to shapes with one more property */
+	js_Shape *sibling;
+	int gcmark;
 };
 
 struct js_Iterator
@@ -144,19 +337,25 @@ struct js_Iterator
 
 /* jsrun.c */
 js_String *jsV_newmemstring(js_State *J, const char *s, int n);
+js_String *jsV_newrope(js_State *J, js_String *left, js_String *right);
 js_Value *js_tovalue(js_State *J, int idx);
 void js_toprimitive(js_State *J, int idx, int hint);
 js_Object *js_toobject(js_State *J, int idx);
 void js_pushvalue(js_State *J, js_Value v);
 void js_pushobject(js_State *J, js_Object *v);
+void js_pushmemstring(js_State *J, js_String *v);
+void js_pushatom(js_State *J, const char *atom);
 
 /* jsvalue.c */
 int jsV_toboolean(js_State *J, js_Value *v);
 double jsV_tonumber(js_State *J, js_Value *v);
 double jsV_tointeger(js_State *J, js_Value *v);
 const char *jsV_tostring(js_State *J, js_Value *v);
+const char *jsV_flatten(js_State *J, js_String *s);
+int jsV_utflen(js_State *J, js_String *s);
+const char *jsV_utfidxtoptr(js_State *J, js_String *s, int i);
 js_Object *jsV_toobject(js_State *J, js_Value *v);
-void jsV_toprimitive(js_State *J, js_Value *v, int preferred);
+js_Value *jsV_toprimitive(js_State *J, js_Value *v, int preferred);
 
 const char *js_itoa(char buf[32], int a);
 double js_stringtofloat(const char *s, char **ep);
@@ -171,16 +370,47 @@ double jsV_stringtonumber(js_State *J, const char *string);
 /* jsproperty.c */
 js_Object *jsV_newobject(js_State *J, enum js_Class type, js_Object *prototype);
 js_Property *jsV_getownproperty(js_State *J, js_Object *obj, const char *name);
-js_Property *jsV_getpropertyx(js_State *J, js_Object *obj, const char *name, int *own);
-js_Property *jsV_getproperty(js_State *J, js_Object *obj, const char *name);
+js_Object *jsV_getproperty(js_State *J, js_Object *obj, const char *name, js_Property **ref, js_Shape **shape);
 js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name);
 js_Property *jsV_nextproperty(js_State *J, js_Object *obj, const char *name);
 void jsV_delproperty(js_State *J, js_Object *obj, const char *name);
 
+js_Shape *jsV_newshape(js_State *J, js_Shape *parent, const char *name, int atts);
+js_Shape *jsV_getownshape(js_Object *obj, const char *name);
+js_Value *jsV_addslot(js_State *J, js_Object *obj, const char *name, int atts);
+int jsV_slotcapacity(int n);
+void jsV_todictionary(js_State *J, js_Object *obj);
+
 js_Object *jsV_newiterator(js_State *J, js_Object *obj, int own);
+js_Object *jsV_newowniterator(js_State *J, js_Object *obj, int hidden);
 const char *jsV_nextiterator(js_State *J, js_Object *iter);
 
 void jsV_resizearray(js_State *J, js_Object *obj, int newlen);
+int jsV_growarray(js_State *J, js_Object *obj, int n);
+int jsV_appendarray(js_State *J, js_Object *obj, js_Value *value);
+void jsV_unflattenarray(js_State *J, js_Object *obj, int start);
+
+/* jsgc.c */
+void jsG_growfunction(js_State *J, js_Function *F);
+void jsG_finish(js_State *J);
+void jsG_collect(js_State *J);
+void jsG_regray(js_State *J, js_Object *obj);
+void jsG_markvalue(js_State *J, js_Value *v);
+void jsG_markcache(js_State *J, js_PropCache *cache);
+
+/* Write barrier: call before storing a value or property in an object */
+static inline void jsG_barrier(js_State *J, js_Object *obj)
+{
+	if (J->gcbarrier && obj->gcmark == J->gcmark)
+		jsG_regray(J, obj);
+}
+
+/* Write barrier: call after storing a value in the flat part of an array */
+static inline void jsG_barrierelement(js_State *J, js_Object *obj, js_Value *v)
+{
+	if (J->gcbarrier && obj->gcmark == J->gcmark)
+		jsG_markvalue(J, v);
+}
 
 /* jsdump.c */
 void js_dumpobject(js_State *J, js_Object *obj);
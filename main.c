@@ -280,10 +280,44 @@ static char *read_stdin(void)
 	return s;
 }
 
+static void writefile(void *data, const char *buf, int size)
+{
+	fwrite(buf, 1, size, data);
+}
+
+static int compilefile(js_State *J, const char *input, const char *output)
+{
+	FILE *f = NULL;
+	if (js_try(J)) {
+		js_report(J, js_trystring(J, -1, "Error"));
+		js_pop(J, 1);
+		if (f)
+			fclose(f);
+		return 1;
+	}
+	js_loadfile(J, input);
+	f = fopen(output, "wb");
+	if (!f)
+		js_error(J, "cannot open file '%s': %s", output, strerror(errno));
+	js_dumpbytecode(J, -1, writefile, f);
+	if (fclose(f)) {
+		f = NULL;
+		js_error(J, "cannot write file '%s': %s", output, strerror(errno));
+	}
+	js_pop(J, 1);
+	js_endtry(J);
+	return 0;
+}
+
 static void usage(void)
 {
 	fprintf(stderr, "Usage: mujs [options] [script [scriptArgs*]]\n");
+	fprintf(stderr, "       mujs -c [-s] script output\n");
+	fprintf(stderr, "\t-c: Compile script to a bytecode file instead of running it.\n");
+	fprintf(stderr, "\t-g n: Collect garbage incrementally, n bytes of heap at a time.\n");
 	fprintf(stderr, "\t-i: Enter interactive prompt after running code.\n");
+	fprintf(stderr, "\t-m n: Limit the heap to n bytes.\n");
+	fprintf(stderr, "\t-n n: Collect new garbage on its own every n bytes of allocation.\n");
 	fprintf(stderr, "\t-s: Check strictness.\n");
 	exit(1);
 }
@@ -296,17 +330,36 @@ main(int argc, char **argv)
 	int status = 0;
 	int strict = 0;
 	int interactive = 0;
+	int compile = 0;
+	int gcbudget = 0;
+	int gcnursery = 0;
+	size_t heaplimit = 0;
 	int i, c;
 
-	while ((c = xgetopt(argc, argv, "is")) != -1) {
+	while ((c = xgetopt(argc, argv, "cg:im:n:s")) != -1) {
 		switch (c) {
 		default: usage(); break;
+		case 'c': compile = 1; break;
+		case 'g': gcbudget = atoi(xoptarg); break;
 		case 'i': interactive = 1; break;
+		case 'm': heaplimit = strtoul(xoptarg, NULL, 10); break;
+		case 'n': gcnursery = atoi(xoptarg); break;
 		case 's': strict = 1; break;
 		}
 	}
 
 	J = js_newstate(NULL, NULL, strict ? JS_STRICT : 0);
+	js_setgcbudget(J, gcbudget);
+	js_setgcnursery(J, gcnursery);
+	js_setheaplimit(J, heaplimit);
+
+	if (compile) {
+		if (argc - xoptind != 2)
+			usage();
+		status = compilefile(J, argv[xoptind], argv[xoptind + 1]);
+		js_freestate(J);
+		return status;
+	}
 
 	js_newcfunction(J, jsB_gc, "gc", 0);
 	js_setglobal(J, "gc");
@@ -2,6 +2,7 @@
 #define mujs_h
 
 #include <setjmp.h> /* required for setjmp in fz_try macro */
+#include <stddef.h> /* for size_t */
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,15 +41,20 @@ typedef int (*js_HasProperty)(js_State *J, void *p, const char *name);
 typedef int (*js_Put)(js_State *J, void *p, const char *name);
 typedef int (*js_Delete)(js_State *J, void *p, const char *name);
 typedef void (*js_Report)(js_State *J, const char *message);
+typedef void (*js_Writer)(void *data, const char *buf, int size);
 
 /* Basic functions */
 js_State *js_newstate(js_Alloc alloc, void *actx, int flags);
+js_State *js_clonestate(js_State *J);
 void js_setcontext(js_State *J, void *uctx);
 void *js_getcontext(js_State *J);
 void js_setreport(js_State *J, js_Report report);
 js_Panic js_atpanic(js_State *J, js_Panic panic);
 void js_freestate(js_State *J);
 void js_gc(js_State *J, int report);
+void js_setgcbudget(js_State *J, int budget);
+void js_setgcnursery(js_State *J, int size);
+void js_setheaplimit(js_State *J, size_t limit);
 
 int js_dostring(js_State *J, const char *source);
 int js_dofile(js_State *J, const char *filename);
@@ -117,6 +123,8 @@ JS_NORETURN void js_throw(js_State *J);
 
 void js_loadstring(js_State *J, const char *filename, const char *source);
 void js_loadfile(js_State *J, const char *filename);
+void js_loadbytecode(js_State *J, const char *filename, const char *buf, int size);
+void js_dumpbytecode(js_State *J, int idx, js_Writer write, void *data);
 
 void js_eval(js_State *J);
 void js_call(js_State *J, int n);
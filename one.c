@@ -1,6 +1,8 @@
 #include "jsarray.c"
 #include "jsboolean.c"
 #include "jsbuiltin.c"
+#include "jsbytecode.c"
+#include "jsclone.c"
 #include "jscompile.c"
 #include "jsdate.c"
 #include "jsdtoa.c"
@@ -14,6 +16,7 @@
 #include "jsnumber.c"
 #include "jsobject.c"
 #include "json.c"
+#include "jsoptimize.c"
 #include "jsparse.c"
 #include "jsproperty.c"
 #include "jsregexp.c"
@@ -7,6 +7,7 @@
 "integer",
 "number",
 "string",
+"memstring",
 "closure",
 "newarray",
 "newobject",
@@ -17,9 +18,13 @@
 "false",
 "this",
 "current",
+"argc",
+"getarg",
 "getlocal",
 "setlocal",
 "dellocal",
+"getupval",
+"setupval",
 "hasvar",
 "getvar",
 "setvar",
@@ -39,6 +44,7 @@
 "nextiter",
 "eval",
 "call",
+"tailcall",
 "new",
 "typeof",
 "pos",
@@ -82,3 +88,22 @@
 "jtrue",
 "jfalse",
 "return",
+"getlocalprop",
+"inclocal",
+"declocal",
+"addinteger",
+"ltjfalse",
+"gtjfalse",
+"lejfalse",
+"gejfalse",
+"eqjfalse",
+"nejfalse",
+"stricteqjfalse",
+"strictnejfalse",
+"movelocal",
+"binarylocal",
+"binarytolocal",
+"cmplocaljfalse",
+"cmpintegerjfalse",
+"getproptolocal",
+"setpropfromlocal",
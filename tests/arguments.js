@@ -0,0 +1,79 @@
+// arguments.length and arguments[i] read the arguments from the stack, and
+// the arguments object is only made when it is used in any other way. Both
+// must give the same answers, whatever the number of arguments passed.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// direct reads
+function count() { return arguments.length; }
+check("length", [count(), count(1), count(1, 2, 3)].join(), "0,1,3");
+function at(i) { return arguments[i]; }
+check("index", [at(0, "a"), at(1, "a"), at(2, "a", "b"), at(3, "a")].join(), "0,a,b,");
+check("index missing", at(5), undefined);
+check("index string", at("1", "s"), "s");
+check("index float", at(1.5, "f"), undefined);
+check("index negative", at(-1, "n"), undefined);
+check("index length", at("length", 1, 2), 3);
+function sum() {
+	var s = 0;
+	for (var i = 0; i < arguments.length; ++i)
+		s += arguments[i];
+	return s;
+}
+check("sum", sum(1, 2, 3, 4, 5, 6, 7, 8, 9, 10), 55);
+check("sum none", sum(), 0);
+
+// more or fewer arguments than parameters
+function params(a, b) { return [a, b, arguments.length, arguments[0], arguments[2]].join(); }
+check("fewer", params(1), "1,,1,1,");
+check("more", params(1, 2, 3), "1,2,3,1,3");
+function locals(a) { var x = 5, y = a; return x + y + arguments.length + (arguments[1] || 0); }
+check("locals", locals(1, 2, 3), 11);
+
+// the object, when it escapes
+function escape() { return arguments; }
+var args = escape(1, "two", 3);
+check("escape", Object.prototype.toString.call(args), "[object Arguments]");
+check("escape length", args.length, 3);
+check("escape index", args[1], "two");
+function pass() { return Array.prototype.slice.call(arguments, 1).join(); }
+check("slice", pass(1, 2, 3), "2,3");
+function apply() { return Math.max.apply(null, arguments); }
+check("apply", apply(3, 9, 4), 9);
+function callee() { return arguments.callee; }
+check("callee", callee(), callee);
+function keys() { var k = []; for (var i in arguments) k.push(i); return k.join(); }
+check("keys", keys("a", "b"), "0,1");
+
+// writes, then reads
+function write() { arguments[0] = "w"; arguments[3] = "x"; return [arguments[0], arguments[3], arguments.length].join(); }
+check("write", write("r"), "w,x,1");
+
+// inner functions have their own arguments
+function outer() {
+	var inner = function () { return arguments.length; };
+	return arguments.length + ":" + inner(1, 2, 3, 4);
+}
+check("inner", outer(1), "1:4");
+function capture() {
+	var a = arguments;
+	return function () { return a[0] + a.length; };
+}
+check("capture", capture("c", 1)(), "c2");
+
+// many calls through the direct path
+function fmt(f) {
+	var out = "", k = 1;
+	for (var i = 0; i < f.length; ++i)
+		out += f[i] == "%" ? arguments[k++] : f[i];
+	return out;
+}
+var s = "";
+for (var i = 0; i < 1000; ++i)
+	s = fmt("%-%", i, i + 1);
+check("fmt", s, "999-1000");
+
+print("arguments ok");
@@ -0,0 +1,76 @@
+// Arrays keep their elements in a dense vector while they can, and must
+// still behave like objects with index properties once they have holes.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var a = [];
+for (var i = 0; i < 100; ++i)
+	a.push(i * 2);
+check("push", a.length, 100);
+check("index", a[99], 198);
+check("pop", a.pop(), 198);
+check("pop length", a.length, 99);
+
+// holes
+var h = [1, 2, 3];
+delete h[1];
+check("hole length", h.length, 3);
+check("hole in", 1 in h, false);
+check("hole value", h[1], undefined);
+h[6] = 7;
+check("grow length", h.length, 7);
+check("keys", Object.keys(h).join(), "0,2,6");
+delete h[0];
+check("delete", Object.keys(h).join(), "2,6");
+var n = 0;
+h.forEach(function () { ++n; });
+check("forEach skips holes", n, 2);
+
+// truncating and extending the length
+var t = [0, 1, 2, 3, 4, 5];
+t.length = 2;
+check("truncate", t.join(), "0,1");
+check("truncated in", 3 in t, false);
+t.length = 4;
+check("extend", t.length, 4);
+check("extend hole", 2 in t, false);
+t[3] = "x";
+check("extend set", t.join(), "0,1,,x");
+
+// far indices make the array sparse
+var s = [1, 2];
+s[100000] = 3;
+check("sparse length", s.length, 100001);
+check("sparse value", s[100000], 3);
+check("sparse keys", Object.keys(s).join(), "0,1,100000");
+s.length = 1;
+check("sparse truncate", Object.keys(s).join(), "0");
+
+// names that are not array indices are plain properties
+var p = [1, 2, 3];
+p.foo = "bar";
+p["01"] = "x";
+p[-1] = "y";
+check("named length", p.length, 3);
+check("named keys", Object.keys(p).join(), "0,1,2,foo,01,-1");
+
+// methods that move elements around
+var m = [3, 1, 0, 2];
+delete m[2];
+m.sort();
+check("sort", m.join(), "1,2,3,");
+check("sort hole", 3 in m, false);
+var r = [1, 2, 3, 4, 5];
+check("splice", r.splice(1, 2, "a", "b", "c").join(), "2,3");
+check("splice rest", r.join(), "1,a,b,c,4,5");
+r.unshift(0);
+check("unshift", r.join(), "0,1,a,b,c,4,5");
+check("shift", r.shift(), 0);
+check("reverse", r.reverse().join(), "5,4,c,b,a,1");
+check("constructor length", new Array(5).length, 5);
+check("constructor holes", 0 in new Array(5), false);
+
+print("array ok");
@@ -0,0 +1,53 @@
+// Atoms that are no longer used are collected. Strings that are only held
+// by values on the stack, in arrays or in properties must survive, and new
+// atoms for the same text must still name the same properties.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+function names(prefix, n) {
+	var o = {};
+	for (var i = 0; i < n; ++i)
+		o[prefix + i] = i;
+	return o;
+}
+
+// names held only by the results of Object.keys and for-in
+var keys = Object.keys(names("key", 500));
+var seen = [];
+for (var k in names("forin", 500))
+	seen.push(k);
+gc();
+names("junk", 2000);
+gc();
+check("keys", keys[123], "key123");
+check("keys join", keys.slice(0, 3).join(), "key0,key1,key2");
+check("forin", seen[499], "forin499");
+
+// a name that was collected and interned again is still the same name
+var o = names("again", 100);
+var saved = Object.keys(o);
+o = null;
+gc();
+o = names("again", 100);
+check("reinterned", o[saved[42]], 42);
+check("reinterned in", saved[99] in o, true);
+
+// constant strings of a function outlive their uses
+function f() { return "constant string of f"; }
+var c = f();
+gc();
+check("constant", c + "!", "constant string of f!");
+check("constant again", f(), c);
+
+// names pushed by the interpreter as values
+var t = [];
+for (k in { alpha: 1, beta: 2 })
+	t.push(k, typeof k);
+gc();
+check("values", t.join(), "alpha,string,beta,string");
+check("string object", new String("abc" + "def").toString(), "abcdef");
+
+print("atomgc ok");
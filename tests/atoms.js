@@ -0,0 +1,53 @@
+// Property names are atoms and are compared by identity, so every way of
+// making a name must end up with the same atom for the same string.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var o = { abc: 1, 12: 2, "": 3 };
+var part = "a";
+check("concat", o[part + "bc"], 1);
+check("slice", o["xabcx".slice(1, 4)], 1);
+check("char codes", o[String.fromCharCode(97, 98, 99)], 1);
+check("number", o[12], 2);
+check("number string", o["1" + "2"], 2);
+check("float", o[12.0], 2);
+check("empty", o[""], 3);
+check("json", JSON.parse('{"abc":4}').abc, 4);
+check("in", ("a" + "b" + "c") in o, true);
+check("own", o.hasOwnProperty(["ab", "c"].join("")), true);
+
+// names built at run time are the same properties as the literal ones
+var d = {};
+for (var i = 0; i < 200; ++i)
+	d["k" + i] = i;
+check("dictionary", d.k150, 150);
+check("dictionary count", Object.keys(d).length, 200);
+for (i = 0; i < 200; i += 2)
+	delete d["k" + i];
+check("deleted", d.k150, undefined);
+check("kept", d.k151, 151);
+check("kept count", Object.keys(d).length, 100);
+check("kept order", Object.keys(d).slice(0, 3).join(), "k1,k3,k5");
+
+// names that look like numbers but are not array indices
+var n = {};
+n["1.5"] = "a";
+n[1.5] = "b";
+n["-0"] = "c";
+n[-0] = "d";
+check("float name", n["1.5"], "b");
+check("minus zero name", n["-0"], "c");
+check("zero name", n["0"], "d");
+
+// defineProperties and create take the names in enumeration order
+var props = { b: { get: function () { return 0; } }, a: { value: 1 } };
+props[1] = { value: 2 };
+Object.defineProperties({}, props);
+var x = Object.create(null, props);
+check("create", Object.getOwnPropertyNames(x).join(), "1,b,a");
+check("create value", x.a, 1);
+
+print("atoms ok");
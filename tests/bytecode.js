@@ -0,0 +1,79 @@
+// Run both as source and as precompiled bytecode (mujs -c), so that the
+// loader must accept everything the compiler makes and run it the same.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// lightweight functions with register instructions
+function sum(n) { var s = 0; for (var i = 0; i < n; ++i) s += i * 2; return s; }
+check("sum", sum(100), 9900);
+function dist(p) { var dx = p.x - 1, dy = p.y - 2; return dx * dx + dy * dy; }
+check("dist", dist({ x: 4, y: 6 }), 25);
+function fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+check("fib", fib(20), 6765);
+
+// closures reading and writing upvalues several levels out
+function counter() {
+	var n = 0;
+	return function () { return function (k) { n += k; return n; }; };
+}
+var inc = counter()();
+inc(3);
+check("upvalue", inc(4), 7);
+
+// arguments, varargs and a separate arguments object
+function count() { return arguments.length + (arguments[1] || 0); }
+check("varargs", count(1, 10, 100), 13);
+function args(a) { var o = arguments; return o.length + a; }
+check("arguments", args(1, 2), 3);
+
+// try, catch and finally with every way of leaving them
+function leave(how) {
+	var log = "";
+	for (var i = 0; i < 3; ++i) {
+		try {
+			try {
+				if (how == "return") return log + "r";
+				if (how == "break") break;
+				if (how == "continue") continue;
+				if (how == "throw") throw "t";
+			} finally {
+				log += "f";
+			}
+		} catch (e) {
+			log += e;
+		}
+		log += i;
+	}
+	return log;
+}
+check("return", leave("return"), "r");
+check("break", leave("break"), "f");
+check("continue", leave("continue"), "fff");
+check("throw", leave("throw"), "ft0ft1ft2");
+check("none", leave(""), "f0f1f2");
+
+// for-in loops left early, switch, with and eval
+function keys(o, stop) {
+	var s = "";
+	for (var k in o) {
+		if (k == stop) break;
+		switch (k) {
+		case "a": s += "A"; continue;
+		case "b": s += "B"; break;
+		default: s += k;
+		}
+	}
+	return s;
+}
+check("forin", keys({ a: 1, b: 2, c: 3, d: 4 }, "d"), "ABc");
+function within(o) { with (o) { return x + eval("y"); } }
+check("with", within({ x: 1, y: 2 }), 3);
+
+var total = 0;
+for (var k in { p: 1, q: 2 }) total += k.length;
+check("script forin", total, 2);
+
+print("bytecode ok");
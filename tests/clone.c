@@ -0,0 +1,135 @@
+/*
+	A state made by js_clonestate shares nothing with the state it was
+	cloned from: changes made to either after cloning are not seen by the
+	other, and either can be freed first. Run it in a sanitize build to
+	catch memory shared by mistake.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mujs.h"
+
+static int failures = 0;
+
+/* Run code and compare the string value of its last expression */
+static void expect(js_State *J, const char *name, const char *code, const char *want)
+{
+	const char *got;
+	if (js_ploadstring(J, name, code)) {
+		fprintf(stderr, "%s: %s\n", name, js_trystring(J, -1, "error"));
+		js_pop(J, 1);
+		++failures;
+		return;
+	}
+	js_pushundefined(J);
+	if (js_pcall(J, 0))
+		got = js_trystring(J, -1, "error");
+	else
+		got = js_tostring(J, -1);
+	if (strcmp(got, want)) {
+		fprintf(stderr, "%s: got %s, want %s\n", name, got, want);
+		++failures;
+	}
+	js_pop(J, 1);
+}
+
+static void finalize(js_State *J, void *data)
+{
+}
+
+static const char *prelude =
+	"var counter = (function () { var n = 0; return function () { return ++n; }; })();\n"
+	"var table = { a: 1, list: [1, 2, 3], nested: { deep: 'x' } };\n"
+	"function Point(x) { this.x = x; }\n"
+	"Point.prototype.twice = function () { return this.x * 2; };\n"
+	"var text = ''; for (var i = 0; i < 100; ++i) text += i;\n"
+	"counter(); counter();\n";
+
+int main(void)
+{
+	js_State *J, *K, *L;
+	int i;
+
+	J = js_newstate(NULL, NULL, 0);
+	if (js_dostring(J, prelude))
+		return 1;
+	js_pushstring(J, "registry");
+	js_setregistry(J, "key");
+	js_pushstring(J, "on the stack");
+	js_gc(J, 0);
+
+	K = js_clonestate(J);
+	if (!K) {
+		fprintf(stderr, "clone failed\n");
+		return 1;
+	}
+
+	/* the clone starts as a copy */
+	expect(K, "copy", "[counter(), table.list.join(), table.nested.deep, new Point(4).twice(), text.length].join()", "3,1,2,3,x,8,190");
+	expect(J, "closure in original", "counter()", "3");
+
+	/* and then goes its own way */
+	js_dostring(K, "table.a = 'K'; table.list.push(4); table.nested.deep = 'K'; Point.prototype.twice = null;"
+		"Array.prototype.extra = 'K'; Object.prototype.polluted = true; var fresh = 1; delete table.nested; text += 'K';");
+	expect(J, "original unchanged", "[table.a, table.list.length, table.nested.deep, typeof fresh, [].extra, ({}).polluted, text.length].join()", "1,3,x,undefined,,,190");
+	expect(J, "original prototype", "new Point(5).twice()", "10");
+	js_dostring(J, "table.a = 'J'; String.prototype.shout = function () { return this + '!'; };");
+	expect(K, "clone unchanged", "[table.a, typeof ''.shout, table.list.join(), 'nested' in table].join()", "K,undefined,1,2,3,4,false");
+
+	/* the registry and the stack are copied too */
+	js_getregistry(K, "key");
+	if (strcmp(js_tostring(K, -1), "registry")) {
+		fprintf(stderr, "registry: got %s\n", js_tostring(K, -1));
+		++failures;
+	}
+	js_pop(K, 1);
+	if (js_gettop(K) != 1 || strcmp(js_tostring(K, 0), "on the stack")) {
+		fprintf(stderr, "stack: not copied\n");
+		++failures;
+	}
+
+	/* errors and collections in one do not touch the other */
+	expect(K, "error", "try { null.x; } catch (e) { e.name }", "TypeError");
+	js_dostring(K, "table = null; Point = null; counter = null;");
+	js_gc(K, 0);
+	expect(J, "after collection in clone", "[table.list.join(), counter(), new Point(1).twice()].join()", "1,2,3,4,2");
+
+	/* either can be freed first */
+	L = js_clonestate(J);
+	js_freestate(J);
+	expect(K, "clone after freeing original", "table", "null");
+	expect(L, "second clone", "[table.a, counter(), ''.shout()].join()", "J,5,!");
+	js_freestate(K);
+
+	/* many clones, with collections running while they are made */
+	js_setgcbudget(L, 512);
+	js_setgcnursery(L, 4096);
+	for (i = 0; i < 50; ++i) {
+		js_dostring(L, "var junk = []; for (var j = 0; j < 200; ++j) junk.push({ j: j, s: 's' + j });");
+		K = js_clonestate(L);
+		if (!K) {
+			fprintf(stderr, "clone in a loop: clone failed\n");
+			++failures;
+			break;
+		}
+		js_dostring(K, "junk.length = 0; table.list = null;");
+		expect(L, "clone in a loop", "junk.length + ',' + table.list.length", "200,3");
+		js_freestate(K);
+	}
+
+	/* finalizers cannot run twice, so their states are not cloned */
+	js_newobject(L);
+	js_newuserdata(L, "data", NULL, finalize);
+	js_setglobal(L, "data");
+	if (js_clonestate(L) != NULL) {
+		fprintf(stderr, "finalizer: state was cloned\n");
+		++failures;
+	}
+	js_freestate(L);
+
+	if (failures)
+		return 1;
+	printf("clone ok\n");
+	return 0;
+}
@@ -0,0 +1,117 @@
+// Locals of functions without eval or with live in slot environments, and
+// the compiler resolves references from nested functions to a depth and a
+// slot. Each closure must see the variables of the call that created it,
+// and names the compiler cannot resolve must still be looked up by name.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// shared and separate environments
+function counter() {
+	var n = 0;
+	return { inc: function () { return ++n; }, get: function () { return n; } };
+}
+var c1 = counter(), c2 = counter();
+c1.inc(); c1.inc(); c2.inc();
+check("shared", c1.get() + "," + c2.get(), "2,1");
+
+// parameters, and variables declared after the closure
+function capture(a) {
+	var f = function () { return a + b; };
+	var b = 10;
+	a = a * 2;
+	return f;
+}
+check("parameter", capture(1)(), 12);
+
+// several levels out, and shadowing in between
+function outer(x) {
+	var y = "y";
+	return function middle(z) {
+		var y = "shadow";
+		return function inner() { return [x, y, z].join(); };
+	};
+}
+check("depth", outer("x")("z")(), "x,shadow,z");
+function levels(a) {
+	return function (b) {
+		return function (c) {
+			return function (d) { a += 1; return a + b + c + d; };
+		};
+	};
+}
+var l = levels(1000)(100)(10);
+check("levels", l(1) + l(1), 1112 + 1113);
+
+// one environment per call, also in recursion
+function make(n, list) {
+	list.push(function () { return n; });
+	if (n > 0) make(n - 1, list);
+	return list;
+}
+var fs = make(3, []);
+check("recursion", fs.map(function (f) { return f(); }).join(), "3,2,1,0");
+
+// var in a loop belongs to the function, so every closure sees the last value
+function loop() {
+	var list = [];
+	for (var i = 0; i < 3; ++i)
+		list.push(function () { return i; });
+	return list.map(function (f) { return f(); }).join();
+}
+check("loop", loop(), "3,3,3");
+function perCall() {
+	var list = [];
+	for (var i = 0; i < 3; ++i)
+		list.push((function (j) { return function () { return j; }; })(i));
+	return list.map(function (f) { return f(); }).join();
+}
+check("per call", perCall(), "0,1,2");
+
+// function declarations and named function expressions
+function hoisted() { return later(); function later() { return typeof hoisted; } }
+check("hoisted", hoisted(), "function");
+var fact = function self(n) { return n <= 1 ? 1 : n * self(n - 1); };
+check("named", fact(10), 3628800);
+
+// catch variables and globals
+function caught() {
+	var list = [];
+	try { throw "e"; } catch (e) { list.push(function () { return e; }); }
+	return list[0]();
+}
+check("catch", caught(), "e");
+var global = 1;
+function globals() { return function () { global += 1; return global; }; }
+check("global", globals()(), 2);
+check("global set", global, 2);
+
+// eval and with keep the names dynamic, also for the closures inside
+function dynamic(code) {
+	var a = "a";
+	eval(code);
+	return function () { return a + (typeof b === "undefined" ? "" : b); };
+}
+check("eval", dynamic("var b = 'b'; a = 'A';")(), "Ab");
+function within(o) {
+	var a = "local";
+	with (o) return function () { return a; };
+}
+check("with", within({ a: "object" })(), "object");
+check("with missing", within({})(), "local");
+function evalInner() {
+	var a = 1;
+	return function () { return eval("a + 1"); };
+}
+check("eval inner", evalInner()(), 2);
+
+// arguments next to captured parameters
+function args(a) {
+	var f = function () { return a; };
+	return [arguments.length, arguments[0], f()].join();
+}
+check("arguments", args(5, 6), "2,5,5");
+
+print("closures ok");
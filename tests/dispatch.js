@@ -0,0 +1,77 @@
+// Touch as many instructions as possible, so that each dispatch method runs
+// them all (build with XCFLAGS=-DJS_COMPUTEDGOTO for threaded dispatch).
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// operators
+var a = 7, b = 3, s = "x";
+check("arith", [a + b, a - b, a * b, a / 2, a % b, -a, +s].join(), "10,4,21,3.5,1,-7,NaN");
+check("bits", [a & b, a | b, a ^ b, ~a, a << 2, -a >> 1, -a >>> 28].join(), "3,7,4,-8,28,-4,15");
+check("compare", [a < b, a <= 7, a > b, a >= 8, a == "7", a === "7", a != 7, a !== 7].join(),
+	"false,true,true,false,true,false,false,false");
+check("logic", [!a, a && b, 0 || b, a ? 1 : 2].join(), "false,3,3,1");
+check("unary", [typeof a, typeof q, void 0, delete a.x].join(), "number,undefined,,true");
+var c = 1;
+c += 2; c -= 1; c *= 6; c /= 4; c %= 2; c <<= 3; c >>= 1; c >>>= 1; c |= 8; c &= 12; c ^= 5;
+check("assign", c, 13);
+check("incdec", [c++, c, c--, --c, ++c].join(), "13,14,14,12,13");
+
+// objects, arrays and properties
+var o = { p: 1, "q r": 2, 3: 4, get g() { return this.p + 10; }, set g(v) { this.p = v; } };
+o.g = 5;
+check("accessor", o.g, 15);
+check("computed", o["q" + " r"] + o[3], 6);
+check("in", ["p" in o, "z" in o].join(), "true,false");
+check("instanceof", [[] instanceof Array, o instanceof Array].join(), "true,false");
+delete o.p;
+check("delete", o.p, undefined);
+var arr = [1, [2, 3], , 4];
+check("array", arr.length + ":" + arr[1][1], "4:3");
+check("regexp", /b+/g.exec("abbc")[0], "bb");
+check("new", new Date(0).getTime(), 0);
+
+// control flow
+var log = [];
+outer: for (var i = 0; i < 4; ++i) {
+	for (var j = 0; j < 4; ++j) {
+		if (j == 2) continue outer;
+		if (i == 3) break outer;
+		log.push(i + "" + j);
+	}
+}
+check("labels", log.join(), "00,01,10,11,20,21");
+var k = 0;
+do { k += 2; } while (k < 7);
+while (k > 5) k--;
+check("loops", k, 5);
+function sw(v) {
+	switch (v) {
+	case 1: return "one";
+	case "1": return "string";
+	case 2:
+	case 3: return "two or three";
+	default: return "other";
+	}
+}
+check("switch", [sw(1), sw("1"), sw(3), sw(null)].join(), "one,string,two or three,other");
+var keys = [];
+for (var key in { x: 1, y: 2 }) keys.push(key);
+check("forin", keys.join(), "x,y");
+
+// functions, closures, exceptions and scopes
+function outerf(n) { return function (m) { return n * m + arguments.length; }; }
+check("closure", outerf(3)(4, 5), 14);
+check("call apply", [Math.max.call(null, 1, 5), Math.max.apply(null, [7, 2])].join(), "5,7");
+function thrower() { throw { code: 42 }; }
+var caught;
+try { thrower(); } catch (e) { caught = e.code; } finally { caught += 1; }
+check("try", caught, 43);
+check("with", (function () { with ({ w: 9 }) return w; })(), 9);
+check("eval", eval("a * 2"), 14);
+check("this", (function () { return this; }).call(o), o);
+check("comma", (1, 2, 3), 3);
+
+print("dispatch ok");
@@ -0,0 +1,117 @@
+// Run with small collection slices and nursery sizes too:
+//   mujs -g 4096 tests/gc.js
+//   mujs -n 16384 tests/gc.js
+// Old objects, arrays and closures keep getting pointers to new things while
+// a collection is in progress or between minor collections. The write
+// barriers must keep all of them alive, which every pass checks by reading
+// everything back.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// a tree whose nodes know what they should contain
+function tree(d, tag) {
+	if (d == 0)
+		return { tag: tag, leaf: "leaf" + tag };
+	return { tag: tag, l: tree(d - 1, tag * 2), r: tree(d - 1, tag * 2 + 1), list: [tag, "t" + tag] };
+}
+function verify(t, tag) {
+	check("tag", t.tag, tag);
+	if (t.leaf !== undefined)
+		return check("leaf", t.leaf, "leaf" + tag), 1;
+	check("list", t.list.join(), tag + ",t" + tag);
+	return 1 + verify(t.l, tag * 2) + verify(t.r, tag * 2 + 1);
+}
+
+var root = tree(7, 1);
+var old = [];
+for (var i = 0; i < 64; ++i)
+	old.push({ slot: null });
+var dict = {};
+var held = (function () {
+	var often = null, seldom = null;
+	return {
+		set: function (v) { often = v; if (v.it % 7 == 0) seldom = v; },
+		get: function () { return [often, seldom]; }
+	};
+})();
+
+var N = 300;
+for (var it = 0; it < N; ++it) {
+	// replace a subtree of the old tree with a new one
+	var t = root, tag = 1;
+	for (var d = 0; d < 4; ++d) {
+		var left = (it >> d) & 1;
+		t = left ? t.l : t.r;
+		tag = tag * 2 + (left ? 0 : 1);
+	}
+	t.l = tree(2, tag * 2);
+	t.r = tree(2, tag * 2 + 1);
+	check("tree", verify(root, 1), 255);
+
+	// new values in old objects and arrays
+	old[it % 64].slot = { it: it, text: "v" + it };
+	old[(it * 7) % 64] = { slot: [it, { deep: "d" + it }] };
+	for (var i = 0; i < 64; ++i) {
+		var s = old[i].slot;
+		if (s !== null && !(s instanceof Array))
+			check("slot", s.text, "v" + s.it);
+		else if (s !== null)
+			check("array slot", s[1].deep, "d" + s[0]);
+	}
+
+	// new values in the environment of an old closure
+	if (it > 0) {
+		var h = held.get();
+		check("upvalue", h[0].list[0], "h" + (it - 1));
+		check("upvalue seldom", h[1].list[0], "h" + (it - 1 - (it - 1) % 7));
+	}
+	held.set({ it: it, list: ["h" + it] });
+
+	// dictionary properties that come and go
+	dict["k" + it] = { w: "w" + it };
+	if (it >= 16)
+		delete dict["k" + (it - 16)];
+	var n = 0;
+	for (var k in dict) {
+		check("dict", dict[k].w, "w" + k.slice(1));
+		++n;
+	}
+	check("dict size", n, it < 16 ? it + 1 : 16);
+
+	// strings built from pieces
+	var rope = "";
+	for (var j = 0; j < 30; ++j)
+		rope += "piece" + j + ";";
+	root.rope = rope;
+	check("rope", root.rope.split(";")[29], "piece29");
+
+	// a comparator that allocates while the array is sorted
+	var items = [];
+	for (var j = 0; j < 40; ++j)
+		items.push({ n: (j * 7919 + it) % 97 });
+	items.sort(function (a, b) { var pair = [a, b]; return pair[0].n - pair[1].n; });
+	for (var j = 1; j < items.length; ++j)
+		if (items[j - 1].n > items[j].n)
+			throw new Error("sort: out of order at " + j);
+
+	// a full collection in the middle of everything
+	if (it % 50 == 25)
+		gc();
+}
+
+// property caches of long lived functions see short lived shapes
+function getp(o) { return o.p; }
+function setp(o, v) { o.p = v; }
+var sum = 0;
+for (var it = 0; it < 5000; ++it) {
+	var o = {};
+	o["n" + it] = it;
+	setp(o, it);
+	sum += getp(o) + getp(Object.create(o));
+}
+check("caches", sum, 4999 * 5000);
+
+print("gc ok");
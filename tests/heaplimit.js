@@ -0,0 +1,31 @@
+// Run with a heap limit: mujs -m 4000000 tests/heaplimit.js
+// Running out of heap must throw an error that scripts can catch, even while
+// everything allocated so far is still reachable.
+
+function check(name, fill) {
+	var caught = null;
+	try {
+		fill();
+	} catch (e) {
+		caught = String(e);
+	}
+	if (caught !== "out of memory")
+		throw new Error(name + ": expected out of memory, got " + caught);
+	print(name, "caught", caught);
+}
+
+var a, o;
+
+check("array", function () { var i = 0; a = []; for (;;) a.push({x:i++}); });
+check("array again", function () { var i = 0; for (;;) a.push({x:i++}); });
+a = null;
+
+check("object", function () { var i = 0; o = {}; for (;;) { o["p"+i] = i; i++; } });
+o = null;
+
+check("string", function () { var i = 0, l = []; for (;;) l.push("item " + i++); });
+
+// the heap is usable again once the data is gone
+var t = 0;
+for (var i = 0; i < 100000; ++i) t += [i, i, i].length;
+print("garbage", t);
@@ -0,0 +1,53 @@
+// Small integers have their own number form with fast paths for arithmetic.
+// Results that leave the int range, negative zero and fractions must give
+// the same numbers as plain double arithmetic.
+
+function check(name, got, want) {
+	if (got !== want || 1 / got !== 1 / want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var max = 2147483647, min = -2147483648;
+
+check("add overflow", max + 1, 2147483648);
+check("sub overflow", min - 1, -2147483649);
+check("mul overflow", 65536 * 65536, 4294967296);
+check("mul big", max * max, 4611686014132420609);
+check("neg min", -min, 2147483648);
+check("inc", (function () { var i = max; ++i; return i; })(), 2147483648);
+check("dec", (function () { var i = min; i--; return i; })(), -2147483649);
+check("add assign", (function () { var i = max; i += max; return i; })(), 4294967294);
+
+// negative zero cannot be an integer
+check("mul zero", -1 * 0, -0);
+check("mul zero 2", 0 * -5, -0);
+check("neg zero", -(0), -0);
+check("mod zero", -4 % 2, -0);
+check("sub zero", 0 - 0, 0);
+check("div zero", 0 / -3, -0);
+
+// division and remainder
+check("div exact", 12 / 4, 3);
+check("div fraction", 7 / 2, 3.5);
+check("div min", min / -1, 2147483648);
+check("mod", 7 % 3, 1);
+check("mod negative", -7 % 3, -1);
+check("mod by zero", isNaN(5 % 0), true);
+check("mod min", min % -1, -0);
+
+// bitwise operators wrap to 32 bits
+check("or", max | 0, max);
+check("shift", 1 << 31, min);
+check("ushift", -1 >>> 0, 4294967295);
+check("sar", min >> 31, -1);
+check("not", ~max, min);
+check("xor", (max + 1) ^ 0, min);
+
+// comparisons mix the two forms
+check("lt", max < max + 1, true);
+check("eq", max + 1 - 1 === max, true);
+check("mixed eq", 0.5 + 0.5 === 1, true);
+check("loop", (function () { var s = 0; for (var i = 0; i < 100000; ++i) s += i; return s; })(), 4999950000);
+check("loop neg", (function () { var s = 0; for (var i = min + 10; i > min; --i) s -= 1; return s; })(), -10);
+
+print("integer ok");
@@ -0,0 +1,76 @@
+// Line numbers come from a table on the side of the bytecode. Errors must be
+// reported at the line of the instruction that failed, in every kind of
+// function and after the compiler has rewritten the instructions.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// the line numbers in a stack trace, innermost first
+function lines(e) {
+	var list = [], re = /:(\d+)\)?$/, parts = e.stackTrace.split("\n\tat ");
+	for (var i = 1; i < parts.length; ++i)
+		list.push(+re.exec(parts[i])[1]);
+	return list;
+}
+
+// the line this is called from
+function here() {
+	try { throw new Error(); } catch (e) { return lines(e)[1]; }
+}
+
+function fails(f) {
+	try { f(); } catch (e) { return lines(e); }
+	throw new Error("did not fail");
+}
+
+var line = here();
+check("here", fails(function () { null.x; })[0], line + 1);
+
+line = here();
+check("multi-line", fails(function () {
+	var o = {};
+	return o.
+		a.
+		b;
+})[0], line + 4);
+
+// inside a loop with integer arithmetic and property access
+line = here();
+check("loop", fails(function () {
+	var t = 0;
+	for (var i = 0; i < 100; ++i) {
+		t += i * 2;
+		if (i == 50)
+			t.missing.x;
+	}
+})[0], line + 6);
+
+// a lightweight function with register instructions
+function light(p) { var dx = p.x - 1; return dx.y.z; }
+line = here();
+check("lightweight", fails(function () { light({ x: 2 }); })[0], line - 1);
+check("lightweight caller", fails(function () { light({ x: 2 }); })[1], line + 2);
+
+// a call site many lines away from its callee
+line = here();
+check("nested", fails(function () {
+	function inner() {
+		throw new Error("inner");
+	}
+	var a = 1;
+	var b = 2;
+	var c = 3;
+	return inner(a, b, c);
+}).slice(0, 2).join(), [line + 3, line + 8].join());
+
+// code that is run by eval starts at line 1
+check("eval", fails(function () { eval("1;\n2;\nnull.x;"); })[0], 3);
+
+// an error records where it was made, not where it is thrown
+line = here();
+var early = new Error("early");
+check("created", lines(early)[0], line + 1);
+
+print("lines ok");
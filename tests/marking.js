@@ -0,0 +1,93 @@
+// The collector marks from an explicit stack instead of recursing in C, so
+// it must cope with heaps that are nested far deeper than the C stack could
+// follow: long chains of objects, arrays, closures and prototypes.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var DEEP = 300000;
+
+// a linked list, built newest first
+var list = null;
+for (var i = 0; i < DEEP; ++i)
+	list = { next: list, n: i };
+gc();
+var n = 0;
+for (var p = list; p; p = p.next)
+	++n;
+check("list", n, DEEP);
+list = null;
+
+// arrays nested in arrays
+var nest = [];
+for (var i = 0; i < DEEP; ++i)
+	nest = [nest, i];
+gc();
+check("arrays", nest[1] + nest[0][1], 2 * DEEP - 3);
+nest = null;
+
+// closures, each holding the one before in its environment
+var f = function () { return 0; };
+for (var i = 0; i < 100000; ++i)
+	f = (function (g, k) { return function () { return k; }; })(f, i);
+gc();
+check("closures", f(), 99999);
+f = null;
+
+// a long prototype chain
+var proto = { base: "base" };
+for (var i = 0; i < 100000; ++i)
+	proto = Object.create(proto);
+gc();
+check("prototypes", proto.base, "base");
+proto = null;
+
+// a dictionary with many properties, which live in a balanced tree
+var dict = {};
+for (var i = 0; i < 20000; ++i)
+	dict["p" + i] = { v: i };
+for (var i = 0; i < 20000; i += 2)
+	delete dict["p" + i];
+gc();
+var sum = 0;
+for (var k in dict)
+	sum += dict[k].v;
+check("dictionary", sum, 100000000);
+dict = null;
+
+// nested function tables, deep and wide, reached only from the outermost
+// function made from the source
+var src = "", tail = "";
+for (var i = 0; i < 40; ++i) {
+	src += "return function () { var v" + i + " = " + i + "; ";
+	tail += "};";
+}
+var deep = new Function(src + "return 'innermost';" + tail);
+src = "var list = [];";
+for (var i = 0; i < 5000; ++i)
+	src += "list.push(function () { return " + i + "; });";
+var wide = new Function(src + "return list;");
+src = tail = null;
+gc();
+for (var i = 0; i < 41; ++i)
+	deep = deep();
+check("deep functions", deep, "innermost");
+check("wide functions", wide()[4999](), 4999);
+deep = wide = null;
+
+// a chain that the program keeps extending
+var chain = null;
+for (var i = 0; i < 200000; ++i) {
+	chain = { next: chain, s: "s" + (i % 100) };
+	if (i % 1000 == 0)
+		chain = { next: chain, alias: chain };
+}
+gc();
+n = 0;
+for (var p = chain; p; p = p.next)
+	++n;
+check("chain", n, 200200);
+
+print("marking ok");
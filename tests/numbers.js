@@ -0,0 +1,89 @@
+// Arithmetic and comparison instructions compute on two numbers in place and
+// only take the generic path for other operands. Fractions, infinities, NaN
+// and negative zero must come out as the generic path would give them, for
+// operands on the stack and in the locals of lightweight functions.
+
+// the same value, telling 0 from -0 and NaN from other numbers
+function check(name, got, want) {
+	var same = got === want ? got !== 0 || 1 / got === 1 / want : got !== got && want !== want;
+	if (!same)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var inf = Infinity, nan = NaN, half = 0.5, big = 9007199254740992;
+
+// operands on the stack
+check("add", half + 0.25, 0.75);
+check("add int", half + half, 1);
+check("add inf", inf + -inf, NaN);
+check("add big", big + 1, big);
+check("add big 2", big + 2, 9007199254740994);
+check("sub", 0.75 - half, 0.25);
+check("sub zero", -0 - 0, -0);
+check("mul", 1.5 * -2, -3);
+check("mul zero", -half * 0, -0);
+check("mul inf", inf * 0, NaN);
+check("div", 1 / 3, 0.3333333333333333);
+check("div zero", -half / inf, -0);
+check("div by zero", -1.5 / 0, -inf);
+check("mod", 5.5 % 2, 1.5);
+check("mod negative", -5.5 % 2, -1.5);
+check("mod zero", -0.5 % 0.5, -0);
+check("mod inf", 5.5 % inf, 5.5);
+check("mod of inf", inf % 2, NaN);
+check("mod nan", nan % 1, NaN);
+
+// comparisons, with NaN false in every direction
+function compare(a, b) { return [a < b, a <= b, a > b, a >= b, a == b, a === b, a != b, a !== b].join(); }
+check("cmp", compare(0.5, 1.5), "true,true,false,false,false,false,true,true");
+check("cmp equal", compare(2.5, 2.5), "false,true,false,true,true,true,false,false");
+check("cmp nan", compare(nan, nan), "false,false,false,false,false,false,true,true");
+check("cmp nan int", compare(nan, 1), "false,false,false,false,false,false,true,true");
+check("cmp zero", compare(-0, 0), "false,true,false,true,true,true,false,false");
+check("cmp inf", compare(-inf, inf), "true,true,false,false,false,false,true,true");
+check("cmp mixed", compare(1, 1.0000000000000002), "true,true,false,false,false,false,true,true");
+
+// the same in locals, where the register instructions run
+function locals(a, b) {
+	var r = [], t;
+	t = a + b; r.push(t);
+	t = a - b; r.push(t);
+	t = a * b; r.push(t);
+	t = a / b; r.push(t);
+	t = a % b; r.push(t);
+	if (a < b) r.push("lt");
+	if (a <= b) r.push("le");
+	if (a > b) r.push("gt");
+	if (a >= b) r.push("ge");
+	return r.join();
+}
+check("locals", locals(7.5, 2), "9.5,5.5,15,3.75,1.5,gt,ge");
+check("locals nan", locals(nan, 2), "NaN,NaN,NaN,NaN,NaN");
+check("locals inf", locals(inf, -inf), "NaN,Infinity,-Infinity,NaN,NaN,gt,ge");
+check("locals zero", 1 / locals(-0, 0).split(",")[2], inf);
+
+// other operands still convert
+check("string add", half + "1", "0.51");
+check("string sub", "2.5" - half, 2);
+check("string cmp", "10" < "9", true);
+check("string number cmp", "10" < 9, false);
+check("bool", true + 0.5, 1.5);
+check("null", null * 1.5, 0);
+check("undefined", undefined < 1.5, false);
+var order = [];
+var a = { valueOf: function () { order.push("a"); return 1.5; } };
+var b = { valueOf: function () { order.push("b"); return 2; } };
+check("valueOf", a * b, 3);
+check("valueOf cmp", a > b, false);
+check("valueOf order", order.join(), "a,b,a,b");
+check("date", new Date(1.5) - 0, 1);
+
+// long loops mixing the forms
+function sum(n) { var s = 0; for (var i = 0; i < n; ++i) s += i * 0.5; return s; }
+check("sum", sum(10000), 24997500);
+function harmonic(n) { var s = 0; for (var i = 1; i <= n; ++i) s = s + 1 / i; return s; }
+check("harmonic", harmonic(1000) > 7.48 && harmonic(1000) < 7.49, true);
+function countdown(x) { var n = 0; while (x > 0.1) { x = x / 2; ++n; } return n; }
+check("countdown", countdown(1000.5), 14);
+
+print("numbers ok");
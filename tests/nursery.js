@@ -0,0 +1,69 @@
+// Run with a nursery and a heap limit: mujs -n 16384 -m 4000000 tests/nursery.js
+// Minor collections free the young things that died and make the survivors
+// old. Short lived garbage must not pile up until a full collection, and
+// young things that old ones point to must survive.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// garbage of every kind, much more than the heap limit in total
+function churn(n) {
+	var t = 0;
+	for (var i = 0; i < n; ++i) {
+		var o = { i: i, s: "str" + i, a: [i, i + 1] };
+		var f = function () { return arguments.length + o.i; };
+		for (var k in o) t += k.length;
+		t += f(1, 2) + o.s.length + o.a[1];
+	}
+	return t;
+}
+check("churn", churn(50000) > 0, true);
+
+// a list that grows at both ends: new nodes point to old ones, and old
+// nodes are given new ones
+var head = { n: 0, next: null }, tail = head;
+for (var i = 1; i <= 10000; ++i) {
+	if (i % 2) {
+		head = { n: i, next: head };
+	} else {
+		tail.next = { n: i, next: null };
+		tail = tail.next;
+	}
+	churn(3);
+}
+var count = 0, sum = 0;
+for (var node = head; node; node = node.next)
+	++count, sum += node.n;
+check("list count", count, 10001);
+check("list sum", sum, 10000 * 10001 / 2);
+
+// young strings as names and values of old dictionaries
+var names = {};
+for (var i = 0; i < 2000; ++i) {
+	names["name" + i] = "value" + i;
+	if (i >= 1000)
+		delete names["name" + (i - 1000)];
+	churn(2);
+}
+var n = 0;
+for (var k in names) {
+	check("name", names[k], "value" + k.slice(4));
+	++n;
+}
+check("names", n, 1000);
+
+// survivors that are stored into long after they became old
+var keep = [];
+for (var i = 0; i < 200; ++i)
+	keep.push({ id: i, child: null });
+for (var round = 0; round < 50; ++round) {
+	for (var i = 0; i < keep.length; ++i)
+		keep[i].child = { id: i, round: round, text: "r" + round };
+	churn(100);
+	for (var i = 0; i < keep.length; ++i)
+		check("child", keep[i].child.text, "r" + round);
+}
+
+print("nursery ok");
@@ -0,0 +1,81 @@
+// Property names are enumerated in one order whatever the object looks
+// like inside: array indices first in ascending order, then the other names
+// in insertion order. Objects with few properties use shapes, large ones and
+// ones with deleted properties use a dictionary, and the order must not
+// depend on which.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+function forin(o) {
+	var list = [];
+	for (var k in o)
+		list.push(k);
+	return list.join();
+}
+
+function same(name, o, want) {
+	check(name + " for-in", forin(o), want);
+	check(name + " keys", Object.keys(o).join(), want);
+	check(name + " json", JSON.stringify(o).replace(/"|:\d+/g, "").slice(1, -1), want);
+}
+
+same("literal", { b: 1, a: 2, 10: 3, 2: 4, c: 5 }, "2,10,b,a,c");
+
+// past the shape limit
+var big = {}, want = [];
+for (var i = 0; i < 100; ++i) {
+	big["p" + (99 - i)] = i;
+	want.push("p" + (99 - i));
+}
+big[7] = 0;
+big[3] = 0;
+same("dictionary", big, "3,7," + want.join());
+
+// deleting turns an object into a dictionary, the order stays
+var d = { x: 1, y: 2, z: 3, 1: 4 };
+delete d.y;
+d.y = 5;
+d[0] = 6;
+same("delete", d, "0,1,x,z,y");
+var d2 = { x: 1, y: 2 };
+delete d2.y;
+d2.w = 3;
+same("delete last", d2, "x,w");
+
+// redefining a property keeps its place
+var r = { a: 1, b: 2, c: 3 };
+r.a = 4;
+Object.defineProperty(r, "b", { value: 5, enumerable: true });
+same("redefine", r, "a,b,c");
+
+// arrays mix their element vector with sparse index properties
+var a = [1, 2];
+a[10] = 3;
+a.name = "n";
+a[5] = 4;
+check("array for-in", forin(a), "0,1,5,10,name");
+check("array keys", Object.keys(a).join(), "0,1,5,10,name");
+check("array names", Object.getOwnPropertyNames(a).join(), "0,1,5,10,length,name");
+
+// string objects list their characters first
+var s = new String("ab");
+s.x = 1;
+s[5] = 2;
+check("string for-in", forin(s), "0,1,5,x");
+check("string names", Object.getOwnPropertyNames(s).join(), "0,1,5,length,x");
+
+// own names come first, and shadowed names are listed once
+function P() {}
+P.prototype.z = 1;
+P.prototype.a = 2;
+P.prototype.h = 3;
+var x = new P();
+x.a = 3;
+x.q = 4;
+Object.defineProperty(x, "h", { value: 5, enumerable: false });
+check("chain", forin(x), "a,q,z");
+
+print("order ok");
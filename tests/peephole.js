@@ -0,0 +1,91 @@
+// The peephole pass threads jumps, drops dead code and fuses instruction
+// sequences. Each case here compiles to one of those patterns, and must
+// behave as the plain instructions would, including for values that are
+// not small integers.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// GETLOCAL a; GETLOCAL b; ADD; SETLOCAL d; POP and friends
+function binary(a, b) { var d; d = a + b; return d; }
+check("add ints", binary(2, 3), 5);
+check("add strings", binary("2", 3), "23");
+check("add objects", binary([1], { toString: function () { return "o"; } }), "1o");
+function local(a, b) { return a * b; }
+check("binary local", local(6, 7), 42);
+check("binary local float", local(0.5, 3), 1.5);
+function move(a) { var d; d = a; return d; }
+check("move", move("m"), "m");
+
+// GETLOCAL a; GETLOCAL b; LT; JFALSE and GETLOCAL a; INTEGER k; LT; JFALSE
+function less(a, b) { if (a < b) return "yes"; return "no"; }
+check("lt", less(1, 2), "yes");
+check("lt nan", less(NaN, 2), "no");
+check("lt strings", less("10", "9"), "yes");
+function under(a) { if (a <= 10) return 1; return 0; }
+check("le int", under(10) + under(11) + under(-1e9) + under(NaN), 2);
+function notless(a, b) { if (!(a < b)) return "not"; return "less"; }
+check("not lt nan", notless(NaN, 1), "not");
+
+// INCLOCAL and DECLOCAL from ++ and -- on locals
+function inc(a) { a++; ++a; return a; }
+check("inc", inc(1), 3);
+check("inc string", inc("1"), 3);
+check("inc max", inc(2147483646), 2147483648);
+function dec(a) { var b = a--; --a; return [a, b].join(); }
+check("dec", dec(5), "3,5");
+check("dec undefined", dec(), "NaN,NaN");
+
+// INTEGER k; ADD
+function plus(a) { return a + 1; }
+check("add integer", plus(1), 2);
+check("add integer string", plus("1"), "11");
+check("add integer float", plus(0.5), 1.5);
+
+// properties through locals
+function getp(o) { var x; x = o.p; return x; }
+check("get to local", getp({ p: "v" }), "v");
+check("get to local proto", getp(Object.create({ p: "proto" })), "proto");
+function setp(o, v) { o.p = v; return o.p; }
+check("set from local", setp({}, 9), 9);
+var setter = { set p(v) { this.q = v * 2; }, get p() { return this.q; } };
+check("set from local setter", setp(setter, 4), 8);
+
+// jumps into the middle of a fusable sequence must keep it apart
+function cond(c, a, b) { var d; d = c ? a : b; return d; }
+check("cond", cond(true, 1, 2) + cond(false, 1, 2), 3);
+function loop(n) {
+	var s = 0, i = 0;
+	while (i < n) {
+		if (i % 2) { ++i; continue; }
+		s = s + i;
+		++i;
+	}
+	return s;
+}
+check("loop continue", loop(10), 20);
+
+// jumps to jumps, jumps to the next instruction and dead code
+function threads(a) {
+	var r = "";
+	for (;;) {
+		if (a) {
+			if (a > 1) { r += "big"; break; }
+		} else {
+			r += "zero";
+		}
+		break;
+	}
+	return r;
+	r = "dead";
+	function hoisted() { return "hoisted"; }
+}
+check("threads", threads(0) + threads(1) + threads(2), "zerobig");
+function deadfun() { return inner(); function inner() { return "inner"; } }
+check("dead hoisted", deadfun(), "inner");
+function swap(a, b) { var t; if (a > b) { t = a; a = b; b = t; } return a + "," + b; }
+check("jtrue", swap(2, 1) + ";" + swap(1, 2), "1,2;1,2");
+
+print("peephole ok");
@@ -0,0 +1,106 @@
+/*
+	Small objects are cut from chunks and their cells reused once they are
+	swept, so a script that keeps making short lived objects should call
+	the allocator far less often than it makes objects. Its memory should
+	stay level from one collection to the next, and all of it should be
+	given back when the state is freed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mujs.h"
+
+struct stats
+{
+	long calls, live;
+	size_t bytes;
+};
+
+/* Keep the size in front of each block, so that frees can be counted */
+static void *countalloc(void *actx, void *ptr, int size)
+{
+	struct stats *st = actx;
+	size_t *p = ptr ? (size_t*)ptr - 2 : NULL;
+	if (size == 0) {
+		if (p) {
+			st->bytes -= p[0];
+			st->live--;
+			free(p);
+		}
+		return NULL;
+	}
+	st->calls++;
+	if (p) {
+		st->bytes -= p[0];
+		st->live--;
+	}
+	p = realloc(p, size + 2 * sizeof *p);
+	if (!p)
+		return NULL;
+	p[0] = size;
+	st->bytes += size;
+	st->live++;
+	return p + 2;
+}
+
+static const char *churn =
+	"var keep = [];\n"
+	"for (var i = 0; i < 20000; ++i) {\n"
+	"	var o = { i: i, s: 'text' + i, list: [i, i + 1], f: function () { return i; } };\n"
+	"	for (var k in o) o[k + '2'] = k;\n"
+	"	if (i % 100 == 0) keep.push(o); else if (keep.length > 50) keep.shift();\n"
+	"}\n";
+
+static int failures = 0;
+
+static void fail(const char *what, long got, long want)
+{
+	fprintf(stderr, "%s: got %ld, want %ld\n", what, got, want);
+	++failures;
+}
+
+int main(void)
+{
+	struct stats st = { 0, 0, 0 };
+	js_State *J;
+	long calls;
+	size_t level;
+	int i;
+
+	J = js_newstate(countalloc, &st, 0);
+	if (!J)
+		return 1;
+	for (i = 0; i < 2; ++i) {
+		if (js_dostring(J, churn))
+			return 1;
+		js_gc(J, 0);
+	}
+	level = st.bytes;
+
+	for (i = 0; i < 5; ++i) {
+		calls = st.calls;
+		if (js_dostring(J, churn))
+			return 1;
+		js_gc(J, 0);
+#if !defined(JS_POOLMAX) || JS_POOLMAX > 0
+		/* without pooling, a round calls the allocator about 280000 times */
+		if (st.calls - calls > 120000)
+			fail("allocator calls in a round", st.calls - calls, 120000);
+#endif
+		if (st.bytes > level + level / 8)
+			fail("bytes after a round", (long)st.bytes, (long)level);
+	}
+
+	js_freestate(J);
+	if (st.live != 0)
+		fail("blocks left after js_freestate", st.live, 0);
+	if (st.bytes != 0)
+		fail("bytes left after js_freestate", (long)st.bytes, 0);
+
+	if (failures)
+		return 1;
+	printf("pool ok\n");
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Property reads and writes with constant names remember where they found
+// the property last time. Each case runs the same access site over objects
+// and prototypes that change under it, and must see the change.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+function getx(o) { return o.x; }
+function setx(o, v) { o.x = v; }
+
+function A() {}
+A.prototype.x = "proto";
+var a = new A();
+for (var i = 0; i < 3; ++i) check("proto", getx(a), "proto");
+
+// changing the value on the prototype
+A.prototype.x = "changed";
+check("proto value", getx(a), "changed");
+
+// shadowing with an own property, then removing it again
+a.x = "own";
+check("shadow", getx(a), "own");
+delete a.x;
+check("unshadow", getx(a), "changed");
+
+// deleting from the prototype
+delete A.prototype.x;
+check("proto delete", getx(a), undefined);
+
+// adding to a prototype further up the chain
+Object.prototype.x = "object";
+check("grand proto", getx(a), "object");
+A.prototype.x = "back";
+check("closer proto", getx(a), "back");
+delete Object.prototype.x;
+
+// a getter put on the prototype in place of a value
+Object.defineProperty(A.prototype, "x", { get: function () { return "getter"; }, configurable: true });
+check("getter", getx(a), "getter");
+
+// objects with the same properties but different prototypes
+function B() {}
+B.prototype.x = "B";
+function C() {}
+C.prototype.x = "C";
+var list = [new B(), new C(), new B(), new C()];
+var got = [];
+for (var k = 0; k < list.length; ++k)
+	got.push(getx(list[k]));
+check("same shape", got.join(), "B,C,B,C");
+
+// writes must respect setters and read-only properties on the prototype
+var log = [];
+function D() {}
+Object.defineProperty(D.prototype, "x", { set: function (v) { log.push(v); }, configurable: true });
+var d = new D();
+setx(d, 1);
+setx(d, 2);
+check("setter", log.join(), "1,2");
+check("setter own", d.hasOwnProperty("x"), false);
+delete D.prototype.x;
+setx(d, 3);
+check("setter gone", d.hasOwnProperty("x"), true);
+
+function E() {}
+Object.defineProperty(E.prototype, "x", { value: "ro", writable: false });
+var e = new E();
+setx(e, "w");
+check("read-only", getx(e), "ro");
+
+// writes after the object has turned into a dictionary
+var f = {};
+for (var j = 0; j < 100; ++j) f["p" + j] = j;
+setx(f, "dict");
+check("dictionary", getx(f), "dict");
+delete f.p0;
+setx(f, "again");
+check("dictionary delete", getx(f), "again");
+
+print("propcache ok");
@@ -0,0 +1,22 @@
+// Deep recursion must work without recompiling with larger limits, and
+// running out of stack must throw an error that scripts can catch.
+
+function rec(n) { return n == 0 ? 0 : 1 + rec(n - 1); }
+if (rec(10000) !== 10000)
+	throw new Error("rec(10000) failed");
+
+function overflows(name, f) {
+	try {
+		f();
+	} catch (e) {
+		print(name, "caught", String(e).split("\n")[0]);
+		return;
+	}
+	throw new Error(name + ": no stack overflow");
+}
+
+overflows("bytecode", function () { rec(1e6); });
+overflows("construct", function () { function T(n) { if (n) new T(n - 1); } new T(1e6); });
+overflows("callback", function () { function g(n) { return [1].map(function () { return g(n - 1); }); } g(1e6); });
+
+print("rec", rec(10000));
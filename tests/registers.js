@@ -0,0 +1,77 @@
+// Lightweight functions (no closures, eval, with or arguments) run register
+// instructions that read and write local slots directly. They must give the
+// same results as the stack instructions (build with XCFLAGS=-DJS_NOREGISTERS
+// to compare), also when operands and results share a slot.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// result in the same slot as an operand
+function self(a, b) { a = a + b; b = a - b; a = a - b; return a + "," + b; }
+check("swap", self(3, 8), "8,3");
+function twice(a) { a = a + a; a = a * a; return a; }
+check("same operands", twice(3), 36);
+function moves(a) { var b, c; b = a; c = b; a = c; b = b; return a + b + c; }
+check("moves", moves(2), 6);
+
+// every binary operator into a local
+function ops(a, b) {
+	var r = [], t;
+	t = a + b; r.push(t);
+	t = a - b; r.push(t);
+	t = a * b; r.push(t);
+	t = a / b; r.push(t);
+	t = a % b; r.push(t);
+	t = a & b; r.push(t);
+	t = a | b; r.push(t);
+	t = a ^ b; r.push(t);
+	t = a << b; r.push(t);
+	t = a >> b; r.push(t);
+	t = a >>> b; r.push(t);
+	return r.join();
+}
+check("ops ints", ops(13, 3), "16,10,39,4.333333333333333,1,1,15,14,104,1,1");
+check("ops mixed", ops(-7.5, "2"), "-7.52,-9.5,-15,-3.75,-1.5,0,-5,-5,-28,-2,1073741822");
+
+// comparisons branching on locals
+function cmp(a, b) {
+	var r = "";
+	if (a < b) r += "<";
+	if (a <= b) r += "l";
+	if (a > b) r += ">";
+	if (a >= b) r += "g";
+	return r;
+}
+check("cmp", [cmp(1, 2), cmp(2, 2), cmp(3, 2), cmp(NaN, 1), cmp("a", "b"), cmp(null, 0)].join(), "<l,lg,>g,,<l,lg");
+function countdown(n) { var k = 0; while (n > 0) { n = n - 1; k = k + 2; } return k; }
+check("countdown", countdown(1000), 2000);
+
+// conversions run in operand order and may throw
+function order(a, b) { var t; t = a + b; return t; }
+var log = [];
+var x = { valueOf: function () { log.push("x"); return 1; } };
+var y = { valueOf: function () { log.push("y"); return 2; } };
+check("valueOf", order(x, y), 3);
+check("valueOf order", log.join(), "x,y");
+var bad = { valueOf: function () { throw "bad"; } };
+function guarded(a) { var t = 5; try { t = a * 2; } catch (e) { return t + e; } return t; }
+check("throw keeps local", guarded(bad), "5bad");
+
+// properties read into and written from locals
+function props(o) { var a, b; a = o.x; b = o.y; o.z = a; o.w = b; return o.z + o.w; }
+check("props", props({ x: 1, y: 2 }), 3);
+check("props missing", isNaN(props({})), true);
+function chain(o) { var v; v = o.a; v = v.b; v = v.c; return v; }
+check("chain", chain({ a: { b: { c: "deep" } } }), "deep");
+
+// many locals, beyond the first few slots
+function wide(p) {
+	var a = p, b = a + 1, c = b + 1, d = c + 1, e = d + 1, f = e + 1, g = f + 1, h = g + 1;
+	var i = h + 1, j = i + 1, k = j + 1, l = k + 1, m = l + 1, n = m + 1, o = n + 1, q = o + 1;
+	return a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + q;
+}
+check("wide", wide(0), 120);
+
+print("registers ok");
@@ -0,0 +1,59 @@
+// Long concatenations are built as ropes and flattened when the bytes are
+// needed. Every string operation must see the same text as if the string
+// had been copied at each step.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+// appending builds a left-leaning rope
+var s = "";
+for (var i = 0; i < 2000; ++i)
+	s += "x" + (i % 10);
+check("append length", s.length, 4000);
+check("append start", s.slice(0, 6), "x0x1x2");
+check("append end", s.slice(-4), "x8x9");
+check("append index", s.indexOf("x9x0"), 18);
+
+// prepending builds a right-leaning rope
+var p = "";
+for (i = 0; i < 2000; ++i)
+	p = (i % 10) + p;
+check("prepend length", p.length, 2000);
+check("prepend start", p.slice(0, 3), "987");
+check("prepend char", p.charAt(1999), "0");
+
+// a rope shared by two longer strings keeps its own value
+var base = "";
+for (i = 0; i < 100; ++i)
+	base += "ab";
+var left = base + "L", right = "R" + base;
+check("shared left", left.length, 201);
+check("shared right", right.charAt(0) + right.charAt(200), "Rb");
+check("shared base", base.length, 200);
+check("shared equal", left.slice(0, 200) === right.slice(1), true);
+
+// flattening happens on first use and the result is reused
+var r = "";
+for (i = 0; i < 100; ++i)
+	r += "abcdefghij";
+check("flat compare", r === new Array(101).join("abcdefghij"), true);
+check("flat key", ({})[r], undefined);
+var o = {};
+o[r] = 1;
+check("rope key", o[new Array(101).join("abcdefghij")], 1);
+check("rope number", +("1" + "0000" + "0000" + "0000"), 1e12);
+check("rope split", (r + ",x").split(",")[1], "x");
+check("rope regexp", /j(a)b/.exec(r)[1], "a");
+check("rope replace", r.replace(/a/g, "").length, 900);
+check("rope json", JSON.parse(JSON.stringify(r + "\n")).length, 1001);
+
+// ropes of ropes
+var t = "";
+for (i = 0; i < 50; ++i)
+	t = t + r + t.slice(0, 10);
+check("nested length", t.length, 50 * 1000 + 49 * 10);
+check("nested char", t.charAt(t.length - 1), "j");
+
+print("rope ok");
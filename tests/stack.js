@@ -0,0 +1,52 @@
+// The value stack starts small and moves to a larger array as it fills. Values
+// that are being converted while it moves must end up in the new array, and
+// running out of stack or heap while it grows must throw a catchable error.
+// Run with -m to have the heap limit stop the growth first.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+function deep(n) { return n == 0 ? 0 : 1 + deep(n - 1); }
+function wide(n) { var a = []; for (var i = 0; i < n; ++i) a.push(i); return Math.max.apply(null, a); }
+
+// valueOf and toString that grow the stack from a shallow caller
+var num = { valueOf: function () { return deep(3000); } };
+var str = { toString: function () { return "s" + deep(3000); } };
+check("add", num + 1, 3001);
+check("concat", "x" + str, "xs3000");
+check("compare", num < 3001, true);
+check("equal", num == 3000, true);
+check("equal reversed", 3000 == num, true);
+check("equal string", str == "s3000", true);
+check("String", String(str), "s3000");
+check("Number", Number(num), 3000);
+check("property name", ({ s3000: "ok" })[str], "ok");
+check("join", [str, str].join(), "s3000,s3000");
+check("apply", wide(20000), 19999);
+
+// the same from deeper in the stack, after it has grown
+function nested(n) { return n == 0 ? num + str : nested(n - 1); }
+check("nested", nested(2000), "3000s3000");
+
+// running out while growing
+function overflows(name, f) {
+	try {
+		f();
+	} catch (e) {
+		var msg = String(e);
+		if (msg.indexOf("stack overflow") < 0 && msg.indexOf("out of memory") < 0)
+			throw e;
+		return;
+	}
+	throw new Error(name + ": did not overflow");
+}
+overflows("recursion", function () { deep(1e6); });
+overflows("arguments", function () { wide(1e6); });
+overflows("conversion", function () { var o = { valueOf: function () { return o + 1; } }; return o + 1; });
+
+// and the stack still works afterwards
+check("again", deep(3000), 3000);
+
+print("stack ok");
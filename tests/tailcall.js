@@ -0,0 +1,64 @@
+"use strict";
+
+// A call returned from a strict function replaces the caller's frame, also
+// when it is one branch of a conditional or the last operand of a comma, so
+// tail recursion runs in constant stack however deep it goes.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var DEEP = 1000000;
+
+function plain(n, acc) { if (n == 0) return acc; return plain(n - 1, acc + 1); }
+check("plain", plain(DEEP, 0), DEEP);
+
+function cond(n) { return n == 0 ? "done" : cond(n - 1); }
+check("cond", cond(DEEP), "done");
+function condelse(n) { return n > 0 ? condelse(n - 1) : "done"; }
+check("cond else", condelse(DEEP), "done");
+function nested(n) { return n == 0 ? "done" : n % 2 ? nested(n - 1) : nested(n - 2 < 0 ? 0 : n - 2); }
+check("nested cond", nested(DEEP), "done");
+
+var log = 0;
+function comma(n) { return log++, n == 0 ? "done" : (log++, comma(n - 1)); }
+check("comma", comma(DEEP), "done");
+check("comma side effects", log, 2 * DEEP + 1);
+
+// mutual recursion, with methods and with closures
+function even(n) { return n == 0 ? true : odd(n - 1); }
+function odd(n) { return n == 0 ? false : even(n - 1); }
+check("mutual", even(DEEP + 1), false);
+var machine = {
+	count: 0,
+	a: function (n) { this.count++; return n == 0 ? this.count : this.b(n - 1); },
+	b: function (n) { return this.a(n); }
+};
+check("methods", machine.a(DEEP), DEEP + 1);
+function loop(n, f) { return n == 0 ? f() : loop(n - 1, function () { return f; }); }
+check("closures", typeof loop(1000, function () { return 1; }), "function");
+
+// arguments that do not match the parameters
+function args(n, a, b) { return n == 0 ? [a, b, arguments.length].join() : args(n - 1, a); }
+check("fewer arguments", args(1000, 1, 2), "1,,2");
+function varargs(n) { return n == 0 ? arguments.length : varargs(n - 1, 1, 2, 3); }
+check("more arguments", varargs(1000), 4);
+
+// tail calls to native functions and to functions that throw
+function native(n) { return n == 0 ? Math.max(1, 2) : native(n - 1); }
+check("native", native(1000), 2);
+function thrower(n) { if (n == 0) throw "thrown"; return thrower(n - 1); }
+var caught;
+try { thrower(DEEP); } catch (e) { caught = e; }
+check("throw", caught, "thrown");
+
+// a call that leaves a try block is not a tail call, but still returns
+function guarded(n) { try { return n == 0 ? "done" : guarded(n - 1); } catch (e) { return e; } }
+check("try", guarded(50), "done");
+
+// conditions and operands that are not calls
+function notcall(n) { return n ? (plain, n + 1) : n; }
+check("not a call", notcall(1) + notcall(0), 2);
+
+print("tailcall ok");
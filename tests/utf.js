@@ -0,0 +1,70 @@
+// Strings cache their character count. ASCII strings are indexed directly,
+// others through a table of byte offsets taken every few characters. Every
+// character must be found at its index whatever the mix of byte lengths.
+
+function check(name, got, want) {
+	if (got !== want)
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var chars = ["a", "é", "中", "😀", "z", "ß", "€", "b"];
+
+function build(n) {
+	var list = [];
+	for (var i = 0; i < n; ++i)
+		list.push(chars[(i * 7 + (i >> 3)) % chars.length]);
+	return list;
+}
+
+var list = build(1000);
+var s = list.join("");
+check("length", s.length, 1000);
+for (var i = 0; i < list.length; ++i) {
+	if (s.charAt(i) !== list[i])
+		throw new Error("charAt " + i + ": got " + s.charAt(i) + ", want " + list[i]);
+	if (s[i] !== list[i])
+		throw new Error("index " + i);
+}
+
+// walking backwards and jumping around must not depend on earlier lookups
+for (i = list.length - 1; i >= 0; i -= 37)
+	check("backwards " + i, s.charCodeAt(i), list[i].charCodeAt(0));
+check("past end", s.charAt(1000), "");
+check("negative", s.charAt(-1), "");
+
+check("slice", s.slice(500, 505), list.slice(500, 505).join(""));
+check("substring", s.substring(998), list.slice(998).join(""));
+check("substring mid", s.substring(66, 63), list.slice(63, 66).join(""));
+function find(from, n) {
+	var want = list.slice(700, 700 + n).join("");
+	while (list.slice(from, from + n).join("") !== want)
+		++from;
+	return from;
+}
+check("indexOf", s.indexOf(list.slice(700, 705).join(""), 600), find(600, 5));
+check("indexOf from", s.indexOf(list.slice(700, 705).join(""), 695), find(695, 5));
+var last = list.length - 1;
+while (list[last] !== "😀")
+	--last;
+check("lastIndexOf", s.lastIndexOf("😀"), last);
+check("split", s.split("").length, 1000);
+
+// the same text in a rope, as a short string, and from an object
+var r = "";
+for (i = 0; i < 10; ++i)
+	r += s.slice(i * 100, i * 100 + 100);
+check("rope", r === s, true);
+check("rope char", r.charAt(777), list[777]);
+check("short", "é中".charAt(1), "中");
+check("short length", "😀😀".length, 2);
+check("object", new String(s).charAt(901), list[901]);
+check("object length", new String(s).length, 1000);
+
+// ASCII strings past the short string length
+var a = "";
+for (i = 0; i < 300; ++i)
+	a += String.fromCharCode(33 + i % 90);
+check("ascii", a.charCodeAt(299), 33 + 299 % 90);
+check("ascii slice", a.slice(200, 203), a.charAt(200) + a.charAt(201) + a.charAt(202));
+
+print("utf ok");
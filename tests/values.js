@@ -0,0 +1,58 @@
+// Every kind of value must come back unchanged from the stack, properties,
+// array elements and closures, whichever representation js_Value has
+// (build with XCFLAGS=-DJS_NANBOX to run this against NaN-boxing).
+
+function check(name, got, want) {
+	if (got !== want && !(got !== got && want !== want))
+		throw new Error(name + ": got " + got + ", want " + want);
+}
+
+var values = [
+	undefined, null, true, false,
+	0, -0, 1, -1, 0.5, 1e300, -1e-300, 5e-324, Infinity, -Infinity, NaN,
+	2147483647, -2147483648, 4294967296, 9007199254740993,
+	"", "a", "abcd", "abcde", "abcdef", "abcdefghijklmno", "abcdefghijklmnop",
+	"été", "中文字",
+	{}, [], function () {}
+];
+
+function round(v) {
+	var o = { p: v }, a = [v];
+	var f = function () { return v; };
+	return [o.p, a[0], f(), JSON.parse(JSON.stringify([typeof v]))[0]];
+}
+
+for (var i = 0; i < values.length; ++i) {
+	var v = values[i], r = round(v);
+	check("property " + i, r[0], v);
+	check("element " + i, r[1], v);
+	check("upvalue " + i, r[2], v);
+	check("typeof " + i, r[3], typeof v);
+}
+
+check("minus zero", 1 / round(-0)[0], -Infinity);
+
+// every NaN is the same number, whatever bits made it
+var nans = [0 / 0, Math.sqrt(-1), Infinity - Infinity, Number("x"), parseFloat("nan"), Math.pow(-8, 1 / 3)];
+for (i = 0; i < nans.length; ++i) {
+	check("nan " + i, typeof nans[i], "number");
+	check("nan self " + i, nans[i] === nans[i], false);
+	check("nan string " + i, String(nans[i]), "NaN");
+	check("nan isNaN " + i, isNaN(nans[i]), true);
+}
+
+// short strings built at run time compare equal to the same literals
+var s = "";
+for (i = 0; i < 20; ++i) {
+	s += String.fromCharCode(97 + i);
+	check("short " + i, s, "abcdefghijklmnopqrst".slice(0, i + 1));
+	check("short length " + i, s.length, i + 1);
+}
+check("short key", { abcde: 1 }["abc" + "de"], 1);
+
+// booleans and null keep their identity through arithmetic
+check("true plus", true + 1, 2);
+check("null plus", null + 1, 1);
+check("undefined plus", undefined + 1, NaN);
+
+print("values ok");